@@ -9,6 +9,7 @@
 #include "emc/base/error.h"
 #include "emc/os/filesystem.h"
 #include "emc/base/image.h"
+#include "emc/base/image_reader.h"
 #include "emc/proc/program.h"
 #include "emc/proc/processor.h"
 #include "emc/proc/stats.h"
@@ -22,7 +23,8 @@ static const char USAGE[] =
       em-image --formats
       em-image create <create_dims> <output>
       em-image <input> [--stats]
-      em-image <input> <output>
+      em-image <input> <output> [--cache <cache_mode>]
+                                [--compress <compression>]
       em-image <input> ((add|sub|mul|div) <file_or_value>                    |
                          flip <flip_axis>                                    |
                          crop <crop_values>                                  |
@@ -30,7 +32,11 @@ static const char USAGE[] =
                          shift <shift_arg>                                   |
                          rotate <rotate_arg>                                 |
                          scale  <scale_arg>                                  |
-                       )... <output> [--fill <fill_value>]
+                         lowpass <lowpass_res>                               |
+                         highpass <highpass_res>                             |
+                         bandpass <band_low_res> <band_high_res>             |
+                       )... <output> [--fill <fill_value>] [--angpix <angpix>]
+                       [--cache <cache_mode>] [--compress <compression>]
 
     Options:
       <input>               An input file or a pattern matching many files.
@@ -44,6 +50,21 @@ static const char USAGE[] =
       crop <crop_values>    Crop a given amount of pixels from the image borders
                             <crop_values> can specify one or multiple values:
                             crop left,[top,[right,[bottom]]] # without spaces
+      lowpass <lowpass_res> Low-pass filter in Fourier space up to the given
+                            resolution (in A, or in pixels if no --angpix).
+                            For example: lowpass 8 --angpix 1.5
+      highpass <highpass_res>  High-pass filter from the given resolution.
+      bandpass <band_low_res> <band_high_res>  Band-pass filter keeping
+                            resolutions between the two values (low first).
+      --angpix <angpix>     Pixel size (in A) used by the filters [default: 1]
+      --cache <cache_mode>  How reading and writing the files use the system
+                            page cache: cached, direct (unbuffered I/O) or
+                            dontneed (drop the pages after use). The last two
+                            avoid evicting other cached data when streaming
+                            very big files.
+      --compress <compression>  Compression of the output images: none,
+                            lzw, deflate or zstd. Only used by formats that
+                            support it (e.g. tif).
 )";
 
 
@@ -121,6 +142,36 @@ void EmImageProgram::readArgs()
         }
     }
 
+    if (hasArg("--cache"))
+    {
+        auto mode = getArg("--cache");
+
+        if (mode == "cached")
+            ImageFile::setDefaultCacheMode(ImageFile::CACHED);
+        else if (mode == "direct")
+            ImageFile::setDefaultCacheMode(ImageFile::DIRECT);
+        else if (mode == "dontneed")
+            ImageFile::setDefaultCacheMode(ImageFile::DONTNEED);
+        else
+            THROW_ERROR(std::string("Invalid cache mode: ") + mode);
+    }
+
+    if (hasArg("--compress"))
+    {
+        auto compression = getArg("--compress");
+
+        if (compression == "none")
+            ImageFile::setDefaultCompression(ImageFile::NO_COMPRESSION);
+        else if (compression == "lzw")
+            ImageFile::setDefaultCompression(ImageFile::LZW);
+        else if (compression == "deflate")
+            ImageFile::setDefaultCompression(ImageFile::DEFLATE);
+        else if (compression == "zstd")
+            ImageFile::setDefaultCompression(ImageFile::ZSTD);
+        else
+            THROW_ERROR(std::string("Invalid compression: ") + compression);
+    }
+
     auto const &commandList = getCommandList();
 
     for (auto &cmd : getCommandList())
@@ -181,6 +232,32 @@ ImageProcessor* EmImageProgram::createProcessorFromCommand(const Command &cmd)
                 params["window_fill"] = getArg("<fill_value>");
             imgProc = new ImageWindowProc();
         }
+        else if (cmdName == "lowpass" || cmdName == "highpass" ||
+                 cmdName == "bandpass")
+        {
+            params["angpix"] = String::toFloat(getArg("--angpix").c_str());
+            if (cmdName == "lowpass")
+            {
+                params[ImageProcessor::OPERATION] =
+                        ImageFourierFilterProc::FILTER_LOWPASS;
+                params["lowpass_res"] = cmd.getArgAsFloat("<lowpass_res>");
+            }
+            else if (cmdName == "highpass")
+            {
+                params[ImageProcessor::OPERATION] =
+                        ImageFourierFilterProc::FILTER_HIGHPASS;
+                params["highpass_res"] = cmd.getArgAsFloat("<highpass_res>");
+            }
+            else
+            {
+                params[ImageProcessor::OPERATION] =
+                        ImageFourierFilterProc::FILTER_BANDPASS;
+                // The lowest resolution limits the high-pass part
+                params["highpass_res"] = cmd.getArgAsFloat("<band_low_res>");
+                params["lowpass_res"] = cmd.getArgAsFloat("<band_high_res>");
+            }
+            imgProc = new ImageFourierFilterProc();
+        }
     }
 
     imgProc->setParams(params);
@@ -289,7 +366,7 @@ int EmImageProgram::run()
         return 0;
     }
 
-    Image inputImage, outputImage;
+    Image outputImage;
     ImageFile inputIO;
 
     auto doProcess = pipeProc.getSize() > 0;
@@ -322,61 +399,67 @@ int EmImageProgram::run()
             ++count;
             inputIO.open(path);
             auto adim = inputIO.getDim();
-
-            for (int i = 1; i <= adim.n; ++i)
+            // Next images are read in background while processing this
+            // one. The reader is destroyed before closing the file.
             {
-                auto outIndex = Nto1 ? count : i;
-                std::cout << "(" << i << ", " << path << ")  ->  "
-                          << "(" << outIndex << ", " << localOutputFn << ")"
-                          << std::endl;
-                inputIO.read(i, inputImage);
-                if (doProcess) // apply operations
-                    pipeProc.process(inputImage, outputImage);
-                else
-                    outputImage.copy(inputImage, outputType); // just convert
-
-                // Open output file the first time we need to write an output
-                // image because we need to know output dimensions, in case
-                // it is not the same as input ones
-                auto odim = outputImage.getDim();
-
-                // If just a single output file, only open it once for writing
-                // and create an empty file with, at least, the number of inputs
-                if (Nto1)
+                ImageReader reader(inputIO);
+
+                while (reader.next())
                 {
-                    if (count == 1)
+                    auto i = reader.getIndex();
+                    auto& inputImage = reader.getImage();
+                    auto outIndex = Nto1 ? count : i;
+                    std::cout << "(" << i << ", " << path << ")  ->  "
+                              << "(" << outIndex << ", " << localOutputFn << ")"
+                              << std::endl;
+                    if (doProcess) // apply operations
+                        pipeProc.process(inputImage, outputImage);
+                    else
+                        outputImage.copy(inputImage, outputType); // just convert
+
+                    // Open output file the first time we need to write an output
+                    // image because we need to know output dimensions, in case
+                    // it is not the same as input ones
+                    auto odim = outputImage.getDim();
+
+                    // If just a single output file, only open it once for writing
+                    // and create an empty file with, at least, the number of inputs
+                    if (Nto1)
                     {
-                        outputIO.open(outputFn, File::TRUNCATE);
-                        odim.n = N;
-                        outputIO.createEmpty(odim, outputType);
+                        if (count == 1)
+                        {
+                            outputIO.open(outputFn, File::TRUNCATE);
+                            odim.n = N;
+                            outputIO.createEmpty(odim, outputType);
+                        }
                     }
-                }
-                else // If multiple outputs, we open one for each input file
-                {
-                    // Compute the output name for each input file
-                    // we will use outputFn as suffix in the basic case
-                    // or when outputFn ends with '_'.
-                    // if outputFn ends with '_', then it will be prefix
-                    // TODO: Implement more flexible options with BASE and COUNT
-                    if (!singleOutput)
+                    else // If multiple outputs, we open one for each input file
                     {
-                        auto base = Path::removeExtension(Path::getFileName(path));
-                        auto prefix = std::string();
-                        auto suffix = outputFn;
-                        if (outputFn.back() == '_')
+                        // Compute the output name for each input file
+                        // we will use outputFn as suffix in the basic case
+                        // or when outputFn ends with '_'.
+                        // if outputFn ends with '_', then it will be prefix
+                        // TODO: Implement more flexible options with BASE and COUNT
+                        if (!singleOutput)
                         {
-                            prefix = outputFn;
-                            suffix = "";
+                            auto base = Path::removeExtension(Path::getFileName(path));
+                            auto prefix = std::string();
+                            auto suffix = outputFn;
+                            if (outputFn.back() == '_')
+                            {
+                                prefix = outputFn;
+                                suffix = "";
+                            }
+                            localOutputFn = prefix + base + suffix + "." + outputFormat;
                         }
-                        localOutputFn = prefix + base + suffix + "." + outputFormat;
+                        odim.n = adim.n;
+                        outputIO.open(localOutputFn, File::TRUNCATE);
+                        outputIO.createEmpty(odim, outputType);
                     }
-                    odim.n = adim.n;
-                    outputIO.open(localOutputFn, File::TRUNCATE);
-                    outputIO.createEmpty(odim, outputType);
-                }
 
-                outputIO.write(outIndex, outputImage);
-                //outputImage.copy(inputImage, outputType);
+                    outputIO.write(outIndex, outputImage);
+                    //outputImage.copy(inputImage, outputType);
+                }
             }
             inputIO.close();
             if (!singleOutput)  // close every file if not single output
@@ -389,7 +472,7 @@ int EmImageProgram::run()
     else  // Just print information about the input images
     {
         auto hasStats = hasArg("--stats");
-        Stats stats;
+        StatsAccumulator totalStats;
 
         for (const auto& path: inputList)
         {
@@ -399,12 +482,24 @@ int EmImageProgram::run()
 
             if (hasStats)
             {
-                inputIO.read(1, inputImage);
-                stats = Stats::compute(inputImage);
-                std::cout << "Stats: " << stats << std::endl;
+                // Images are read one by one, never loading the whole stack
+                StatsAccumulator fileStats;
+                auto itemStats = fileStats.add(inputIO);
+
+                if (itemStats.size() > 1)
+                    for (size_t i = 0; i < itemStats.size(); ++i)
+                        std::cout << "Stats (" << i + 1 << "): "
+                                  << itemStats[i] << std::endl;
+
+                std::cout << "Stats: " << fileStats.getStats() << std::endl;
+                totalStats.add(fileStats.getStats(), fileStats.getCount());
             }
             inputIO.close();
         }
+
+        if (hasStats && inputList.size() > 1)
+            std::cout << std::endl << "Stats (all files): "
+                      << totalStats.getStats() << std::endl;
     }
 
     return 0;
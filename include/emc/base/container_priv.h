@@ -68,10 +68,15 @@ namespace emcore
             // If the type have the same size and we are going to allocate the
             // same number of elements, then we will use the same amount of
             // memory, so there is not need for a new allocation if we own the memory
+            // The single element case is also checked because it is
+            // allocated with new instead of new[].
             if (data != nullptr && type.isTriviallyCopyable()
-                && getDataSize() == n * type.getSize())
+                && this->type.isTriviallyCopyable()
+                && getDataSize() == n * type.getSize()
+                && (size > 1) == (n > 1))
             {
                 this->type = type; // set new type and return, not allocation needed
+                this->size = n; // deallocate will use the new type and size
                 return;
             }
 
@@ -98,6 +103,7 @@ namespace emcore
             std::swap(data, other.data);
             std::swap(type, other.type);
             std::swap(size, other.size);
+            std::swap(view, other.view);
         }
 
         /** Copy or cast the elements from the other Type::TypedContainer.
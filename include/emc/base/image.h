@@ -17,6 +17,8 @@
 
 namespace emcore
 {
+    class Table;
+
     /** @ingroup image
      * This class represent the location of one or several images in disk.
      * It contains a path to a physical file on disk, and a given index.
@@ -66,9 +68,12 @@ namespace emcore
          */
         Image();
 
-        // Constructor from dimensions and type
+        /** Constructor from dimensions and type.
+         * As with Array, the memory could be provided and then the Image
+         * will be a view that does not own it.
+         */
         // TODO: In C++ 11 the base constructor can be generated
-        Image(const ArrayDim &adim, const Type & type);
+        Image(const ArrayDim &adim, const Type & type, void * memory = nullptr);
 
         /** Copy constructor from another Array.
          * This Array will have the same dimensions, data type
@@ -76,10 +81,17 @@ namespace emcore
          * @param other Other Array to be copied
          */
         Image(const Image &other);
+
+        /** Move constructor */
+        Image(Image &&other);
+
         virtual ~Image();
 
         Image& operator=(const Image &other);
 
+        /** Move assignment */
+        Image& operator=(Image &&other);
+
         /** Return the header of a given image.
          *
          * @param index If 0, return the main header, if not, the specified one
@@ -93,10 +105,9 @@ namespace emcore
         /** Read image data from a given location.
          * This function is a shortcut to easily read an image from a location
          * without using the ImageFile class.
-         * The file will be open before data is read and closed after it.
-         * If you want to read multiple images from the same file, it
-         * would be better to first open the file explicitly using ImageFile,
-         * read all the images and then close the file.
+         * The file is opened through the default ImageFileCache, so it is
+         * kept opened (and its header parsed only once) for reading other
+         * images from the same file later.
          * @param location Input image location (index range and path) to be read
          */
         void read(const ImageLocation &location);
@@ -104,7 +115,8 @@ namespace emcore
 
         /** Write the image data into a file location.
          * This function is a shortcut to easily write an image without
-         * using the ImageFile class.
+         * using the ImageFile class. Handles of the file in the default
+         * ImageFileCache are closed before writing.
          * @param location Input location where the image will be written.
          */
         void write(const ImageLocation &location) const;
@@ -161,6 +173,62 @@ namespace emcore
          */
         static bool hasImpl(const std::string &extOrName);
 
+        /** Access patterns that can be advised to the system about how the
+         * images of a mapped file will be read. */
+        enum Advice { NORMAL = 0, SEQUENTIAL = 1, RANDOM = 2 };
+
+        /** Backends used to read the data of a list of images (see read()
+         * with several indexes). IO_URING submits all the reads to the
+         * kernel at once (see IORing) and falls back to IO_PREAD (one
+         * positional read per image) when it is not available.
+         */
+        enum IOBackend { IO_PREAD = 0, IO_URING = 1 };
+
+        /** Set the backend used by files opened after this call */
+        static void setDefaultBackend(IOBackend backend);
+        static IOBackend getDefaultBackend();
+
+        /** Ways in which the reads and writes of images data use the
+         * system page cache. CACHED is the normal buffered I/O. DIRECT
+         * bypasses the page cache (O_DIRECT), using aligned bounce buffers
+         * when the positions or the memory of the images are not aligned
+         * (e.g. after the 1024 bytes header of MRC files). DONTNEED uses
+         * the page cache but advises the system to drop the pages after
+         * each read or write, a lighter way to stream big files without
+         * evicting other cached data.
+         */
+        enum CacheMode { CACHED = 0, DIRECT = 1, DONTNEED = 2 };
+
+        /** Set the cache mode used by files opened after this call */
+        static void setDefaultCacheMode(CacheMode mode);
+        static CacheMode getDefaultCacheMode();
+
+        /** Compressions of the images data when writing files. Only some
+         * formats support them (e.g. TIFF, where ZSTD also depends on how
+         * libtiff was built), see supportsCompression().
+         */
+        enum Compression { NO_COMPRESSION = 0, LZW = 1, DEFLATE = 2,
+                           ZSTD = 3 };
+
+        /** Set the compression used by files created after this call, when
+         * supported by their format (the others are not compressed). */
+        static void setDefaultCompression(Compression compression);
+        static Compression getDefaultCompression();
+
+        /** Set how EER movies (electron events recorded by Falcon 4
+         * detectors) are rendered into images by files opened after this
+         * call. Events are placed at 1x, 2x or 4x the sensor size
+         * (upsampling) using their sub-pixel positions, and each image is
+         * the sum of grouping raw frames (the last frames are discarded if
+         * they are not enough for a whole group). The defaults can be
+         * changed from any thread, and each file keeps the rendering it
+         * was opened with (see setEerRendering).
+         */
+        static void setDefaultEerRendering(size_t upsampling,
+                                           size_t grouping);
+        static size_t getDefaultEerUpsampling();
+        static size_t getDefaultEerGrouping();
+
         /** Return data types supported by a given format implementation.
          *
          * An exception will be raised if the implementation can not be found,
@@ -172,6 +240,29 @@ namespace emcore
          */
         static FormatTypes getFormatTypes();
 
+        /** Read only the headers of many files, from several threads, and
+         * return a Table with one row per file and the columns: path, x,
+         * y, z, n, type (type name), size (in bytes), mtime (the
+         * modification time in nanoseconds) and error.
+         *
+         * Only the information needed for the dimensions and type is read
+         * (e.g. only the first TIFF image directory is parsed). If a file
+         * can not be scanned, the scan goes on with the others and its
+         * row has the error message and a null type. The error column is
+         * empty for the other rows.
+         * @param paths Files to be scanned, their format is taken from
+         *  the extension.
+         * @param cachePath If not empty, file with the results of previous
+         *  scans. Files with the same path, size and modification time as
+         *  in the cache are not opened again, and the cache is updated
+         *  with the new results. EER movies are also scanned again if
+         *  the default EER rendering changed.
+         * @param threads Number of threads to use (0 means default).
+         */
+        static Table scanHeaders(const StringVector &paths,
+                                 const std::string &cachePath = "",
+                                 size_t threads = 0);
+
         /** Read from file and swap the data if needed.
          *
          * @param file File handler
@@ -243,16 +334,125 @@ namespace emcore
         /** Return the type of the opened file */
         Type getType() const;
 
+        /** Map the data of the opened file in memory.
+         *
+         * After this, read() will return images that are views of the
+         * mapping (when no bytes swapping is needed) instead of copying the
+         * data, so random access to the images of a big stack only costs
+         * the page faults of the pages that are used. The mapping is
+         * private, so modifying the views does not change the file.
+         * The views are only valid until the file is closed.
+         *
+         * Only files opened as READ_ONLY can be mapped, and only for the
+         * formats that store images contiguously at fixed offsets
+         * (e.g. MRC, SPIDER, EM or IMAGIC).
+         * @param advice Expected access pattern to the images. If the file
+         *      is already mapped, only the advice is changed.
+         */
+        void map(Advice advice = NORMAL);
+
+        /** Return true if the file data is mapped in memory */
+        bool isMapped() const;
+
+        /** Set the backend used to read lists of images from the opened
+         * file, overriding the default one. */
+        void setBackend(IOBackend backend);
+        IOBackend getBackend() const;
+
+        /** Set the cache mode of the opened file, overriding the default
+         * one. If the file system does not support unbuffered I/O, DIRECT
+         * falls back to DONTNEED (returned by getCacheMode()). Headers and
+         * mapped files always use the page cache.
+         */
+        void setCacheMode(CacheMode mode);
+        CacheMode getCacheMode() const;
+
+        /** Return true if the format of the opened file can write images
+         * with the given compression. */
+        bool supportsCompression(Compression compression) const;
+
+        /** Set the compression of the opened file, overriding the default
+         * one. It should be set before creating the file (createEmpty or
+         * the first write) and be supported by its format.
+         */
+        void setCompression(Compression compression);
+        Compression getCompression() const;
+
+        /** Set how the opened EER movie is rendered, overriding the
+         * default one, which also changes the dimensions of the file. An
+         * exception is thrown for other formats.
+         */
+        void setEerRendering(size_t upsampling, size_t grouping);
+
+        /** Return the rendering of the opened EER movie, or 0 for files
+         * of other formats. */
+        size_t getEerUpsampling() const;
+        size_t getEerGrouping() const;
+
         /** Read an image from an already opened ImageFile.
+         *
+         * Several threads can read images (also ranges or regions) from
+         * the same ImageFile at the same time, as long as no one is writing
+         * to it. Formats with raw layout use positional reads (pread) that
+         * do not share the file position, and the other formats decode one
+         * image at a time.
          *
          * @param index Should be greater that 1 and less or equal to the
          *      number of images stored in the file.
          * @param image Output image object that will be used read the
          *      data from file. The type and dimensions of this output
          *      Image can be modified if needed to fit the data read.
+         *      If the file is mapped, the image can become a view of the
+         *      mapping (see map()).
          */
         void read(size_t index, Image &image);
 
+        /** Read a range of consecutive images into a single Image.
+         *
+         * For formats that store the images contiguously, all of them are
+         * read with a single (vectored) read, instead of one per image.
+         * Other formats decode each image into its place in the output.
+         * @param first Index of the first image to read (starting at 1).
+         * @param last Index of the last image to read (included).
+         * @param image Output image that will be resized to contain the
+         *      last - first + 1 images. If the file is mapped (and there is
+         *      no padding between images), it will be a view of the mapping.
+         */
+        void read(size_t first, size_t last, Image &image);
+
+        /** Read a list of images, in any order, into a single Image.
+         *
+         * This is intended to load many particles from random positions
+         * of a big stack. For formats that store the images contiguously,
+         * the reads are issued with the backend of the file, so with
+         * IO_URING all of them are submitted at once instead of doing one
+         * system call per image.
+         * @param indexes Indexes of the images to read (starting at 1),
+         *      they can be repeated.
+         * @param image Output image that will be resized to contain all
+         *      images, in the same order of the indexes.
+         */
+        void read(const std::vector<size_t> &indexes, Image &image);
+
+        /** Read only a region (e.g. a sub-volume or some slices) of an image.
+         *
+         * For formats that store the images contiguously, only the rows of
+         * the region are read from the file (or copied from the mapping),
+         * so the whole image is never loaded. Bytes swapping and casting
+         * are also applied only to the region.
+         * @param index Index of the image (or volume) in the file.
+         * @param x, y, z Position in the image of the first element of the
+         *      region.
+         * @param regionDim Dimensions of the region (n is ignored), it
+         *      should be inside the image from the given position.
+         * @param image Output image with the region dimensions.
+         * @param type If not null, the region will be casted to this type,
+         *      otherwise the output will have the type of the file.
+         */
+        void readRegion(size_t index, size_t x, size_t y, size_t z,
+                        const ArrayDim &regionDim, Image &image,
+                        const Type &type = typeNull);
+
         // TODO: DOCUMENT
         void write(size_t index, const Image &image);
 
@@ -292,6 +492,11 @@ namespace emcore
         // Pointer to implementation class, PIMPL idiom
         Impl* impl = nullptr;
 
+        /** Write consecutive images starting at index, with the same
+         * validations of write(). Used by ImageWriter to coalesce writes. */
+        void writeImages(size_t index, const std::vector<const Image*> &images);
+
+        friend class ImageWriter;
     }; // class ImageFile
 
     std::ostream& operator<< (std::ostream &ostream, const ImageFile &t);
@@ -0,0 +1,88 @@
+//
+// Created on 10/18/26.
+//
+
+#ifndef EM_CORE_IMAGE_CACHE_H
+#define EM_CORE_IMAGE_CACHE_H
+
+#include <memory>
+
+#include "emc/base/image.h"
+
+
+namespace emcore
+{
+    /** @ingroup image
+     * Pool of opened ImageFile handles, keyed by path and open mode, that
+     * keeps at most a given number of files opened and closes the least
+     * recently used one when that limit is reached.
+     *
+     * This avoids opening the file and parsing its header for each image
+     * when reading many images from the same stacks, for example the
+     * particles of a STAR table given as index@stack.mrcs. The location
+     * based Image::read uses the default cache (see getDefault()).
+     *
+     * Before returning a read-only handle, the file is checked to be the
+     * same (same inode, size and modification time) as when it was
+     * opened, otherwise it is opened again. The cache can be used from
+     * several threads: files are opened without locking the cache, and
+     * if the same file is opened by several threads at once, only the
+     * first handle is kept and returned to all of them.
+     */
+    class ImageFileCache
+    {
+    public:
+        /** Create a cache that will keep at most maxFiles opened files */
+        explicit ImageFileCache(size_t maxFiles = 64);
+
+        ImageFileCache(const ImageFileCache &other) = delete;
+        ImageFileCache& operator=(const ImageFileCache &other) = delete;
+
+        /** Return the cache used by the location based Image::read and
+         * Image::write functions. */
+        static ImageFileCache& getDefault();
+
+        /** Set the maximum number of opened files, closing the least
+         * recently used ones if there are more. */
+        void setMaxFiles(size_t maxFiles);
+        size_t getMaxFiles() const;
+
+        /** Return the number of files currently in the cache */
+        size_t getSize() const;
+
+        /** Return the opened file for the given path and mode, opening it
+         * if it is not in the cache. A read-only request can also return
+         * a file opened for writing, and opening a file for writing
+         * closes the read-only handles of the same path.
+         * The returned pointer keeps the file opened even if it is
+         * removed from the cache later.
+         */
+        std::shared_ptr<ImageFile> get(const std::string &path,
+                                       File::Mode mode = File::READ_ONLY);
+
+        /** Read the image at the given location using a cached file */
+        void read(const ImageLocation &location, Image &image);
+
+        /** Write the image at the given location. Cached handles of the
+         * path are closed first, and the file used for writing is closed
+         * after it, so the file is complete (e.g. headers statistics are
+         * updated) when this function returns.
+         */
+        void write(const ImageLocation &location, const Image &image);
+
+        /** Remove all the handles of a path from the cache */
+        void close(const std::string &path);
+
+        /** Remove all the handles from the cache */
+        void clear();
+
+        ~ImageFileCache();
+
+    private:
+        class Impl;
+        Impl * impl;
+    }; // class ImageFileCache
+
+} // namespace emcore
+
+#endif //EM_CORE_IMAGE_CACHE_H
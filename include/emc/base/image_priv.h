@@ -5,6 +5,10 @@
 #ifndef EM_CORE_IMAGE_PRIV_H
 #define EM_CORE_IMAGE_PRIV_H
 
+#include <mutex>
+#include <utility>
+#include <sys/uio.h>
+
 #include "image.h"
 
 
@@ -39,6 +43,25 @@ namespace emcore
 
         Image image; ///< Temporary image used as buffer to read from disk
 
+        // Memory map of the whole file, if it has been mapped
+        uint8_t * mapData = nullptr;
+        size_t mapSize = 0;
+
+        // Serialize the decoding of images for formats that are not raw,
+        // since their libraries keep state between calls
+        std::mutex decodeMutex;
+
+        // Backend used to read lists of images
+        IOBackend backend = ImageFile::getDefaultBackend();
+
+        // How reads and writes use the page cache, and the descriptor
+        // opened with O_DIRECT for unbuffered I/O
+        CacheMode cacheMode = CACHED;
+        int directFd = -1;
+
+        // Compression used when writing the images data
+        Compression compression = NO_COMPRESSION;
+
         friend class ImageFile;
 
         virtual ~Impl();
@@ -46,6 +69,18 @@ namespace emcore
         /** Return a list of the supported types of this implementation. */
         TypeVector getTypes() const;
 
+        /** Return true if images can be written with this compression. By
+         * default, only NO_COMPRESSION is supported. */
+        virtual bool supportsCompression(Compression compression) const;
+
+        /** Set the upsampling and grouping used to render the images and
+         * update the dimensions. Only EER movies support it. */
+        virtual void setEerRendering(size_t upsampling, size_t grouping);
+
+        /** Return the upsampling and grouping used to render the images,
+         * or zeros if the format is not rendered. */
+        virtual std::pair<size_t, size_t> getEerRendering() const;
+
     protected:
         /** Read the main header of an image file */
         virtual void readHeader() = 0;
@@ -53,6 +88,12 @@ namespace emcore
         /** Write the main header of an image file */
         virtual void writeHeader() = 0;
 
+        /** Read only the information of the main header needed for the
+         * dimensions and type (used by ImageFile::scanHeaders). By default
+         * the whole header is read with readHeader().
+         */
+        virtual void scanHeader();
+
         /** Return the size of the header for this format */
         virtual size_t getHeaderSize() const;
 
@@ -76,6 +117,42 @@ namespace emcore
         virtual void openFile();
         virtual void closeFile();
 
+        /** Return the file descriptor to be used for positional reads and
+         * writes (pread/pwrite), which can be used from several threads
+         * since they do not change the file position. */
+        int getDescriptor() const;
+
+        /** Open (or close) the descriptor for unbuffered I/O as required
+         * by the cache mode. */
+        void setCacheMode(CacheMode mode);
+
+        /** Read (or write) the buffers from the given position of the file,
+         * handling the cache mode. All formats should use this function
+         * for reading or writing images data. */
+        void transferData(struct iovec *iov, int iovcnt, size_t pos,
+                          bool write);
+
+        /** Advise the system to drop the cached pages of a range of the
+         * file if the cache mode is DONTNEED. Written pages are synced
+         * first, since dirty pages can not be dropped. */
+        void dropCache(size_t pos, size_t size, bool written);
+
+        /** Return true if the data of each image is stored contiguously at
+         * the position computed from getHeaderSize(), getImageSize() and
+         * getPadSize(), as read by the default readImageData. Only formats
+         * with this raw layout can be mapped in memory.
+         */
+        virtual bool hasRawLayout() const;
+
+        /** Map the whole file in memory (if not mapped yet) and
+         * advise the system about the expected access pattern. */
+        virtual void mapFile(Advice advice);
+        virtual void unmapFile();
+
+        /** Return a pointer to the data of the image at the given index
+         * in the memory map. The file should be mapped. */
+        uint8_t * getMappedData(size_t index) const;
+
         /**
          * Expand the existing file with unset values.
          * This function should be called after setting dim and type.
@@ -86,8 +163,35 @@ namespace emcore
         virtual void writeImageHeader(const size_t index, const Image &image);
 
         virtual void readImageData(const size_t index, Image &image);
+
+        /** Read the data of the images at the given indexes into
+         * consecutive places of the image, that should already have the
+         * dimensions for all of them. This is used for both ranges and
+         * lists of images. Formats with raw layout read each run of
+         * consecutive images with a single vectored read, or issue one
+         * read per image with the selected backend, the others decode
+         * each one with readImageData.
+         */
+        virtual void readItemsData(const std::vector<size_t> &indexes,
+                                   Image &image);
+
+        /** Read a region of the image at index, starting at the element
+         * (x, y, z) and with the dimensions of the input image (already
+         * allocated with the file type). Formats with raw layout only read
+         * the rows of the region, others decode the whole image and
+         * extract the region from it.
+         */
+        virtual void readRegionData(const size_t index, size_t x, size_t y,
+                                    size_t z, Image &image);
         virtual void writeImageData(const size_t index, const Image &image);
 
+        /** Write consecutive images starting at index. Formats with raw
+         * layout and no padding between images write all of them with a
+         * single vectored write, others write each one with writeImageData.
+         */
+        virtual void writeImagesData(const size_t index,
+                                     const std::vector<const Image*> &images);
+
         /**
          * Return a map between the format integer modes and the supported
          * Types for storing images.
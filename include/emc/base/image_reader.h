@@ -0,0 +1,67 @@
+//
+// Created on 10/18/26.
+//
+
+#ifndef EM_CORE_IMAGE_READER_H
+#define EM_CORE_IMAGE_READER_H
+
+#include "emc/base/image.h"
+
+
+namespace emcore
+{
+    /** @ingroup image
+     * Read the images of an ImageFile in order, prefetching the next ones
+     * from a background thread while the current one is being processed.
+     *
+     * Images are read into a bounded ring of buffers that are reused, so
+     * at most the given number of images are kept in memory. Typical usage:
+     *
+     *  ImageReader reader(imgFile);
+     *  while (reader.next())
+     *      process(reader.getIndex(), reader.getImage());
+     *
+     * The ImageFile should not be used by others while the reader exists.
+     */
+    class ImageReader
+    {
+    public:
+        /** Create a reader for all the images of an opened file.
+         * @param imgFile The opened input file.
+         * @param prefetch Number of images that can be read ahead (at
+         *      least 1), which is also the number of buffers.
+         */
+        ImageReader(ImageFile &imgFile, size_t prefetch = 4);
+
+        /** Create a reader for the images from first to last (included) */
+        ImageReader(ImageFile &imgFile, size_t first, size_t last,
+                    size_t prefetch = 4);
+
+        ImageReader(const ImageReader &other) = delete;
+        ImageReader& operator=(const ImageReader &other) = delete;
+
+        /** Move to the next image, waiting until it has been read.
+         * The previous image buffer is released to be reused.
+         * If there was any error reading the image, it is re-thrown here.
+         * @return False if there are no more images.
+         */
+        bool next();
+
+        /** Return the index in the file of the current image */
+        size_t getIndex() const;
+
+        /** Return the current image. It is only valid until the next call
+         * to next(), so it should be copied if needed later. */
+        Image& getImage();
+
+        /** Stop the background thread and release the buffers */
+        ~ImageReader();
+
+    private:
+        class Impl;
+        Impl * impl;
+    }; // class ImageReader
+
+} // namespace emcore
+
+#endif //EM_CORE_IMAGE_READER_H
@@ -0,0 +1,66 @@
+//
+// Created on 10/18/26.
+//
+
+#ifndef EM_CORE_IMAGE_WRITER_H
+#define EM_CORE_IMAGE_WRITER_H
+
+#include "emc/base/image.h"
+
+
+namespace emcore
+{
+    /** @ingroup image
+     * Write images to an ImageFile from a background thread, so the
+     * caller can continue processing while the data is written.
+     *
+     * Images are queued with their index in a bounded queue, and the
+     * caller only blocks when the queue is full. Queued images are written
+     * in index order, and consecutive images are written together with a
+     * single call for the formats that store them contiguously (e.g. MRC).
+     * Errors in the background writes are re-thrown by the next call to
+     * write(), flush() or close().
+     *
+     * The ImageFile should not be used by others until the writer is closed.
+     */
+    class ImageWriter
+    {
+    public:
+        /** Create a writer for an ImageFile opened for writing.
+         * @param imgFile The opened output file. If it has no images yet,
+         *      it will be created from the dimensions and type of the
+         *      first written image.
+         * @param queueSize Maximum number of images waiting to be written
+         *      (at least 1).
+         */
+        ImageWriter(ImageFile &imgFile, size_t queueSize = 4);
+
+        ImageWriter(const ImageWriter &other) = delete;
+        ImageWriter& operator=(const ImageWriter &other) = delete;
+
+        /** Queue the image to be written at the given index, taking its
+         * memory without copying it (the input image is left empty). */
+        void write(size_t index, Image &&image);
+
+        /** Queue a copy of the image to be written at the given index */
+        void write(size_t index, const Image &image);
+
+        /** Wait until all queued images have been written */
+        void flush();
+
+        /** Write all queued images and stop the background thread.
+         * The writer can not be used after it is closed. */
+        void close();
+
+        /** Close the writer. Since the destructor can not throw, errors
+         * are lost if close() was not called before. */
+        ~ImageWriter();
+
+    private:
+        class Impl;
+        Impl * impl;
+    }; // class ImageWriter
+
+} // namespace emcore
+
+#endif //EM_CORE_IMAGE_WRITER_H
@@ -8,6 +8,8 @@
 #include <map>
 #include <vector>
 #include <complex>
+#include <cstdlib>
+#include <new>
 
 #include "emc/base/error.h"
 
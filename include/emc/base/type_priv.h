@@ -188,8 +188,34 @@ public:
         }
     } // function TypeImplBaseT.copy
 
+    /** Return true if the memory for nbytes bytes will be aligned to
+     * memory pages. This is done for big arrays of trivially copyable types,
+     * so they can be used for unbuffered (O_DIRECT) reads and writes.
+     * The decision only depends on the number of bytes, so memory reused
+     * by a TypedContainer with another type of the same byte size is still
+     * released in the same way that it was allocated. */
+    static bool isPageAligned(size_t nbytes)
+    {
+        return std::is_trivially_copyable<T>::value && nbytes >= (1 << 20);
+    }
+
     virtual void * allocate(size_t count) const override
     {
+        if (isPageAligned(count * sizeof(T)))
+        {
+            void * mem = nullptr;
+            if (posix_memalign(&mem, 4096, count * sizeof(T)) != 0)
+                throw std::bad_alloc();
+            // Keep the same initialization that new T[count] would do
+            if (!std::is_trivial<T>::value)
+            {
+                auto ptr = static_cast<T*>(mem);
+                for (size_t i = 0; i < count; ++i)
+                    new (ptr + i) T();
+            }
+            return mem;
+        }
+
         if (count > 1)
             return new T[count];
         else
@@ -198,6 +224,13 @@ public:
 
     virtual void deallocate(void *mem, size_t count) const override
     {
+        // Trivially copyable types are also trivially destructible
+        if (isPageAligned(count * sizeof(T)))
+        {
+            free(mem);
+            return;
+        }
+
         auto ptr = static_cast<T*>(mem);
         if (count > 1)
             delete [] ptr;
@@ -0,0 +1,64 @@
+//
+// Created on 10/18/26.
+//
+
+#ifndef EM_CORE_IO_RING_H
+#define EM_CORE_IO_RING_H
+
+#include <cstddef>
+#include <vector>
+
+
+namespace emcore
+{
+    /**
+     * Submit batches of positional reads to the kernel at once, through
+     * the Linux io_uring interface, instead of issuing a system call for
+     * each of them. This is useful to read many small items (e.g.
+     * particles) from random positions of one or several files.
+     *
+     * The support is only built when the io_uring header is found at
+     * compile time (EM_CORE_IO_URING), and the running kernel should also
+     * provide it, so isAvailable() should be checked before creating a
+     * ring. A ring should be used from a single thread at a time.
+     */
+    class IORing
+    {
+    public:
+        /** Read of size bytes from the file descriptor fd, starting at
+         * the given offset, into the memory pointed by data. */
+        struct Request
+        {
+            int fd;
+            void * data;
+            size_t size;
+            size_t offset;
+        };
+
+        /** Return true if io_uring support was built and a ring can be
+         * created in the running system, and its kernel supports the read
+         * operation (Linux 5.6 or later). */
+        static bool isAvailable();
+
+        /** Create a ring that will keep up to depth reads in flight.
+         * An exception is thrown if io_uring is not available.
+         */
+        explicit IORing(size_t depth = 64);
+        ~IORing();
+
+        /** Return the maximum number of reads in flight */
+        size_t getDepth() const;
+
+        /** Submit all the requests and wait until they are completed.
+         * @param requests Reads to be done, in any order.
+         */
+        void read(const std::vector<Request> &requests);
+
+    private:
+        class Impl;
+        Impl * impl;
+    }; // class IORing
+
+} // namespace emcore
+
+#endif //EM_CORE_IO_RING_H
@@ -0,0 +1,61 @@
+//
+// Created on 10/18/26.
+//
+
+#ifndef EM_CORE_THREAD_H
+#define EM_CORE_THREAD_H
+
+#include <cstddef>
+#include <functional>
+
+
+namespace emcore
+{
+    /**
+     * Class to contain some static functions to split work in
+     * several threads.
+     */
+    class Thread
+    {
+    public:
+        /** Function to be called for each chunk of a range processed in
+         * parallel. It receives the first and last (exclusive) index of
+         * the chunk and the index of the chunk (between 0 and the value
+         * returned by getChunks).
+         */
+        using RangeFunc = std::function<void(size_t start, size_t end,
+                                             size_t chunk)>;
+
+        /** Return the number of threads that will be used by default.
+         * If it has not been set, the number of hardware threads is used.
+         */
+        static size_t getDefaultThreads();
+
+        /** Set the number of threads to be used by default. If 0, the number
+         * of hardware threads will be used.
+         */
+        static void setDefaultThreads(size_t threads);
+
+        /** Return the number of chunks in which a range of n elements
+         * will be split by parallelFor, using the given number of threads
+         * (0 means default) and with at least minChunk elements per chunk.
+         */
+        static size_t getChunks(size_t n, size_t threads = 0,
+                                size_t minChunk = 1);
+
+        /** Split the range [0, n) in contiguous chunks and call func for
+         * each of them from a different thread. Chunks are run by the
+         * calling thread and by a pool of workers that are started when
+         * first needed and kept for the next calls, and this function
+         * returns when all chunks are done. Each chunk is run by a single
+         * thread, so the chunk index can be used to select per-thread data.
+         * If any call throws an exception, it will be re-thrown after
+         * all chunks have finished.
+         */
+        static void parallelFor(size_t n, const RangeFunc &func,
+                                size_t threads = 0, size_t minChunk = 1);
+    }; // class Thread
+
+} // namespace emcore
+
+#endif //EM_CORE_THREAD_H
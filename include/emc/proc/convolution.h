@@ -0,0 +1,84 @@
+//
+// Created on 10/18/26.
+//
+
+#ifndef EM_CORE_CONVOLUTION_H
+#define EM_CORE_CONVOLUTION_H
+
+#include <memory>
+
+#include "emc/base/image.h"
+#include "emc/proc/fft.h"
+
+
+namespace emcore
+{
+    /** Convolve (or correlate) 2D images with an arbitrary kernel.
+     * @ingroup proc
+     *
+     * The output has the same dimensions of the input (values outside
+     * the input are considered zero) and the kernel origin is at its
+     * center (dim / 2). The computation can be done by:
+     *  - DIRECT: summing over the kernel for each output pixel.
+     *  - FULL_FFT: a single transform of the input padded with the
+     *    kernel size.
+     *  - TILED_FFT: overlap-save, the output is computed in blocks from
+     *    overlapping tiles of a fixed FFT size. Tiles are processed in
+     *    parallel, each thread reusing its transformer (and plans) and
+     *    working images, so the extra memory is bounded by the tile size
+     *    and not by the image size.
+     * With AUTO, the method is selected from the image and kernel sizes.
+     */
+    class Convolver
+    {
+    public:
+        enum Method {AUTO, DIRECT, FULL_FFT, TILED_FFT};
+
+        Convolver(Method method = AUTO);
+
+        /** Set the kernel to be used. If correlate is true, the output
+         * will be the correlation with the kernel instead of the
+         * convolution (i.e. the kernel is not flipped).
+         */
+        void setKernel(const Image &kernel, bool correlate = false);
+
+        /** Set the maximum size of the FFTs used in each dimension (2048 by
+         * default). This limits the memory used by the FFT methods, and
+         * FULL_FFT will not be selected for bigger padded images. */
+        void setMaxFftSize(size_t size);
+
+        /** Return the method that will be used for the given input
+         * dimensions, resolving AUTO from the current kernel. */
+        Method getMethod(const ArrayDim &inputDim) const;
+
+        /** Return the size (in each dimension) of the FFT tiles that will be
+         * used for the given input dimensions with the FFT methods. */
+        ArrayDim getTileDim(const ArrayDim &inputDim, Method method) const;
+
+        /** Apply the convolution (or correlation) to the input image and
+         * store the result, of type float, in the output. */
+        void apply(const Image &input, Image &output);
+
+    private:
+        Method method;
+        size_t maxFftSize = 2048;
+        // Kernel stored in correlation form: out(x) = sum in(x + k - o) w(k)
+        std::vector<float> weights;
+        size_t kx = 0, ky = 0;  // Kernel dimensions
+        long ox = 0, oy = 0;  // Kernel origin
+
+        // Cache of the kernel FT for the tiles dimensions
+        Image kernelFT;
+        ArrayDim kernelTileDim;
+        // One transformer and working images for each thread
+        std::vector<std::unique_ptr<FourierTransformer>> transformers;
+        std::vector<Image> tiles, fTiles;
+
+        void applyDirect(const float * in, const ArrayDim &dim, float * out);
+        void applyTiled(const float * in, const ArrayDim &dim, float * out,
+                        const ArrayDim &tileDim);
+    }; // class Convolver
+
+} // namespace emcore
+
+#endif //EM_CORE_CONVOLUTION_H
@@ -0,0 +1,111 @@
+//
+// Created on 10/18/26.
+//
+
+#ifndef EM_CORE_CORRELATION_H
+#define EM_CORE_CORRELATION_H
+
+#include "emc/base/image.h"
+#include "emc/proc/fft.h"
+
+
+namespace emcore
+{
+    /** Position of the maximum of a correlation map.
+     * The position is given as the shift (in pixels, with sub-pixel
+     * precision) that should be applied to the reference to match
+     * the image, so a zero shift is at the center of the map.
+     */
+    struct CorrPeak
+    {
+        double x = 0, y = 0, z = 0;
+        double value = 0;  // Value of the map at the maximum (integer) position
+    };
+
+    std::ostream& operator<< (std::ostream &ostrm, const CorrPeak &p);
+
+    /** Compute correlations between images using Fourier transforms.
+     * @ingroup proc
+     *
+     * A reference is set first and its Fourier transform is kept, so it
+     * can be correlated against many images (e.g. a stack) paying only one
+     * forward and one backward transform per image. The FFTW plans and the
+     * working images are also reused between calls.
+     *
+     * The following modes are supported:
+     *  - CROSS: plain circular cross-correlation, sum of img(x) * ref(x - s).
+     *  - NORMALIZED: cross-correlation of the images with zero mean and
+     *    divided by the norms of both, so values are between -1 and 1.
+     *  - PHASE: phase correlation, the cross-power spectrum is normalized
+     *    to unit magnitude before the backward transform, giving a sharp
+     *    peak of height close to 1 for a pure translation.
+     */
+    class Correlator
+    {
+    public:
+        enum Mode {CROSS, NORMALIZED, PHASE};
+
+        Correlator(Mode mode = CROSS);
+
+        Mode getMode() const;
+
+        /** Set the reference image and compute its Fourier transform.
+         * All images correlated later should have the same dimensions.
+         */
+        void setReference(const Image &ref);
+
+        /** Correlate the image with the current reference.
+         * @param img Input image with the same dimensions of the reference.
+         * It can also be a stack (n > 1), then each item is correlated
+         * with the reference, whose FT is computed only once.
+         * @param ccMap Output correlation map (float), with the same
+         * dimensions of the input and the zero shift at the center
+         * (dim / 2 in each dimension). For a stack, it will contain the
+         * map of each item.
+         */
+        void correlate(const Image &img, Image &ccMap);
+
+        /** Set img1 as reference and correlate img2 against it */
+        void correlate(const Image &img1, const Image &img2, Image &ccMap);
+
+        /** Correlate the image with the current reference and return only
+         * the peak of the correlation map, refined to sub-pixel precision.
+         * The image should be a single item (n = 1).
+         */
+        CorrPeak findPeak(const Image &img);
+
+        /** Correlate the image (that can be a stack) with the current
+         * reference and store in peaks the peak of each item map.
+         */
+        void findPeak(const Image &img, std::vector<CorrPeak> &peaks);
+
+        /** Return the peak of a correlation map centered as the output of
+         * correlate(). The sub-pixel position is refined by fitting a
+         * parabola through the maximum and its two neighbours (taken with
+         * periodic boundaries) in each dimension.
+         * The map should be a single item (n = 1).
+         */
+        static CorrPeak getPeak(const Image &ccMap);
+
+        /** Store in peaks the peak of each item of a stack of correlation
+         * maps, as returned by getPeak() for every item alone.
+         */
+        static void getPeak(const Image &ccMap, std::vector<CorrPeak> &peaks);
+
+    private:
+        /** Compute the uncentered correlation map of a single item with
+         * the reference into ccWork */
+        void correlateItem(const Image &input);
+
+        Mode mode;
+        FourierTransformer ft;
+        Image rImg;  // Real-space image converted to float if needed
+        Image refFT;  // Conjugated and scaled Fourier transform of reference
+        Image fImg;  // Fourier transform of the current image
+        Image ccWork;  // Uncentered correlation map
+        double refNorm = 1;  // Norm of the reference with zero mean
+    }; // class Correlator
+
+} // namespace emcore
+
+#endif //EM_CORE_CORRELATION_H
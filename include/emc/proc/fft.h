@@ -30,6 +30,10 @@ namespace emcore
         /** Initialize the transformer with a pair of images */
         //FourierTransformer(Image &rImg, Image &fImg);
 
+        /** The transformer keeps FFTW plans, so it can not be copied */
+        FourierTransformer(const FourierTransformer &other) = delete;
+        FourierTransformer& operator=(const FourierTransformer &other) = delete;
+
         ~FourierTransformer();
 
         /** Change the dimensions of the current Array.
@@ -39,11 +43,32 @@ namespace emcore
         //virtual void resize(const ArrayDim &adim, const Type & type=typeNull);
         //void transform(FT direction=FT::FORWARD);
 
-        /** TODO: Document!!! */
+        /** Compute the Fourier transform of rImg into fImg, using the
+         * half-complex layout (x / 2 + 1 elements along X). If rImg is a
+         * stack (n > 1), all items are transformed with a single batched
+         * FFTW plan and backward() also works item by item.
+         */
         void forward(const Image &rImg, Image &fImg);
 
-        /** TODO: Document!!! */
-        void backward(Image &fImg, Image &rImg);
+        /** Forward transform with the implicit shift mode.
+         * If implicitShift is true, the input image is multiplied in place
+         * by a (-1)^(y+z) checkerboard (see checkerboard()) before
+         * computing the transform. For even dimensions, the resulting
+         * transform has the zero-frequency already centered along Y and Z,
+         * so no extra shift pass over the Fourier image is needed. X is not
+         * shifted, as in the half-complex layout it only contains the
+         * non-negative frequencies.
+         * The input image is left modulated after this call.
+         */
+        void forward(Image &rImg, Image &fImg, bool implicitShift);
+
+        /** Backward transform with the implicit shift mode.
+         * If implicitShift is true, the input is expected to be a transform
+         * computed with the implicit shift mode. The checkerboard is then
+         * applied together with the normalization, so the output image
+         * in real space is not modulated.
+         */
+        void backward(Image &fImg, Image &rImg, bool implicitShift = false);
 
         /** Shift zero-frequency component to center of spectrum if the
          * direction is FT::FORWARD.
@@ -51,22 +76,40 @@ namespace emcore
          * of the input Fourier transform will by shifted to the center of
          * the array.
          *
-         * If y = 1, swaps the left and right halves of X (single row)
-         * If z = 1, swaps the first quadrant with the third,
-         *           and the second quadrant with the fourth.
-         * If z > 1, swaps half-spaces of X along each dimension.
+         * Half-spaces are swapped along each dimension greater than one,
+         * dimensions do not need to be equal and can be even or odd.
+         * If the input contains several items (n > 1), each of them is
+         * shifted independently.
          *
          * This operation is similar to Matlab fftshift.
          *
          * If the direction is FT::BACKWARD, the modification done by
          * a forward center will be undone, similar to Matlab ifftshift
+         *
+         * The out-of-place version writes each output row from its source
+         * row in a single pass. The in-place version moves each row only
+         * once following the cycles of the permutation, using a single row
+         * as temporary buffer.
          */
         void shift(const Image &fImgIn, Image &fImgOut,
                    FT direction = FT::FORWARD);
         void shift(Image &inOutImg, FT direction = FT::FORWARD);
 
+        /** Multiply, in place, the input image in real space by a
+         * (-1)^(y+z) checkerboard. This modulation shifts the half-complex
+         * Fourier transform by half of the Y and Z dimensions, which is
+         * equivalent to shift() along those axes when they are even.
+         * Applying it twice restores the original image. Only float and
+         * double images are allowed.
+         */
+        static void checkerboard(Image &rImg);
+
         /** Change the dimensions of an image resulting from a forward
          * transform. The dimensions can be reduced or augmented.
+         * Images (rank 2) and volumes (rank 3) of equal sizes are supported,
+         * and each item of a stack is windowed in the same way.
+         * When augmenting, frequencies beyond the input Nyquist sphere are
+         * set to zero. The work is split across z-planes in several threads.
          */
         void windowFT(const Image &fImgIn, Image &fImgOut, size_t newdim);
         void windowFT(Image &inOutImg, size_t newdim);
@@ -76,6 +119,8 @@ namespace emcore
          * @param inputImg Input image in real space.
          * @param outputImg Output image in real space with new dimension.
          * @param newdim New dimension of the output image
+         * Volumes are also supported. Plans are cached by the transformer,
+         * so scaling several images of the same size reuses them.
          */
         void scale(const Image &inputImg, Image &outputImg, size_t newdim);
         void scale(Image &inOutImg, size_t newdim);
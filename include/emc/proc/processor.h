@@ -5,7 +5,10 @@
 #ifndef EM_CORE_PROCESSOR_H
 #define EM_CORE_PROCESSOR_H
 
+#include <memory>
+
 #include "emc/base/image.h"
+#include "emc/proc/fft.h"
 
 
 namespace emcore
@@ -126,6 +129,10 @@ namespace emcore
 
     protected:
         virtual void validateParams() override ;
+
+    private:
+        // Keep the transformer to reuse its plans between images
+        FourierTransformer ft;
     }; // class ImageScaleProc
 
 
@@ -156,6 +163,112 @@ namespace emcore
         virtual void validateParams() override ;
     }; // class ImageScaleProc
 
+
+    /** Processor to filter images in Fourier space.
+     * The following operations are supported: low-pass, high-pass,
+     * band-pass (all of them with raised-cosine edges) and Gaussian low-pass.
+     *
+     * Frequencies are given in digital units (cycles per pixel, between 0
+     * and 0.5) through the parameters "freq_low" and "freq_high", or as a
+     * resolution in Angstroms with "lowpass_res" and "highpass_res" together
+     * with the pixel size "angpix" (1 if not provided). The width of the
+     * raised-cosine edges can be set with "freq_decay" (0.02 by default).
+     * The Gaussian filter uses "freq_high" as its sigma.
+     *
+     * The frequency weights are computed only once for given dimensions,
+     * so filtering many images of the same size only requires the pair of
+     * Fourier transforms and one multiplication per Fourier coefficient.
+     */
+    class ImageFourierFilterProc: public ImageProcessor
+    {
+    public:
+        enum OP {FILTER_LOWPASS, FILTER_HIGHPASS, FILTER_BANDPASS,
+                 FILTER_GAUSSIAN};
+
+        ImageFourierFilterProc() = default;
+
+        /** Set the params after construction, so validateParams() of this
+         * class is called (it would not be from the base constructor). */
+        ImageFourierFilterProc(const ObjectDict &params);
+
+        /** Filter the input image and store the result in output.
+         * Output will be of type float unless input is double.
+         */
+        virtual void process(const Image &input, Image &output) override ;
+
+        /** Filter the image and store the result in the same input image.
+         * If the image is a stack, every item is filtered in the same way.
+         */
+        virtual void process(Image &inputOutput) override ;
+
+        /** Return the weights (float) that will be applied to the Fourier
+         * transform of an image with the given dimensions in real space.
+         * The number of items is ignored, a single item of weights is used
+         * for all items of a stack.
+         * The weights are cached until dimensions or parameters change.
+         */
+        const Image& getWeights(const ArrayDim &rDim);
+
+    protected:
+        virtual void validateParams() override ;
+
+    private:
+        // Keep the transformer to reuse its plans between images
+        FourierTransformer ft;
+        Image fImg;  // Fourier transform of the last processed image
+        Image weights;  // Cached weights for the dimensions in weightsDim
+        ArrayDim weightsDim;
+    }; // class ImageFourierFilterProc
+
+
+    /** Processor to compute the averaged power spectrum of an image by
+     * splitting it in overlapping square tiles (periodogram averaging).
+     *
+     * Each tile has its mean removed and is multiplied by a 2D Hann window
+     * before its Fourier transform. The squared modules are accumulated in
+     * double precision and averaged. Tiles are distributed across threads,
+     * each of them reusing its own transformer (and so its plan) and
+     * working images for all its tiles.
+     *
+     * Parameters: "tile_size" (512 by default) and "tile_overlap", as
+     * a fraction of the tile size between 0 and 1 (0.5 by default).
+     */
+    class ImagePowerSpectrumProc: public ImageProcessor
+    {
+    public:
+        ImagePowerSpectrumProc() = default;
+        ImagePowerSpectrumProc(const ObjectDict &params);
+
+        /** Compute the averaged power spectrum of the input image.
+         * The output will be a float image of tile_size x tile_size with
+         * the zero frequency in the center (tile_size / 2).
+         */
+        virtual void process(const Image &input, Image &output) override ;
+
+        /** Store the power spectrum in the same input image. */
+        virtual void process(Image &inputOutput) override ;
+
+        /** Return the rotational average of the last computed spectrum.
+         * Element i is the average of the frequencies with radius (in
+         * pixels of the spectrum) closest to i, up to tile_size / 2.
+         */
+        const std::vector<double>& getRadialProfile() const;
+
+        /** Return the number of tiles used in the last computed spectrum */
+        size_t getTilesCount() const;
+
+    protected:
+        virtual void validateParams() override ;
+
+    private:
+        // One transformer and working stacks of tiles for each thread
+        std::vector<std::unique_ptr<FourierTransformer>> transformers;
+        std::vector<Image> tiles, fTiles;
+        std::vector<double> window;  // 1D Hann window
+        std::vector<double> profile;
+        size_t tilesCount = 0;
+    }; // class ImagePowerSpectrumProc
+
 } // namespace emcore
 
 #endif //EM_CORE_PROCESSOR_H
@@ -5,11 +5,17 @@
 #ifndef EM_CORE_STATS_H
 #define EM_CORE_STATS_H
 
+#include <vector>
+#include <memory>
+#include <mutex>
+
 #include "emc/base/image.h"
 
 
 namespace emcore
 {
+    class StatsMask;
+
     /** Computing min, max, avg and std on a given Array. */
     struct Stats
     {
@@ -18,7 +24,11 @@ namespace emcore
          */
         enum Operation {ALL, MIN_MAX};
 
-        /** Compute min, max, avg and std on the input array */
+        /** Compute min, max, avg and std on the input array.
+         * The std is the population standard deviation (as numpy.std).
+         * Values are reduced in a single pass by blocks, using several
+         * threads for big arrays and merging partial results exactly.
+         */
         static Stats compute(const Array& array,
                              Operation op=ALL);
 
@@ -26,11 +36,155 @@ namespace emcore
         static Stats compute(const Type& type, const void * memory, size_t n,
                              Operation op=ALL);
 
+        /** Compute the stats of each item (image or volume) in the
+         * input array, using only the values in the mask.
+         * Items are distributed across threads.
+         */
+        static std::vector<Stats> computeMasked(const Array& array,
+                                                const StatsMask &mask,
+                                                Operation op=ALL);
+
         double min, max, mean, std;
     };
 
     std::ostream& operator<< (std::ostream &ostrm, const Stats &s);
 
+
+    /** Mask with the elements of an item (image or volume) that will be
+     * used to compute masked statistics. It is stored as a list of spans
+     * of consecutive elements, so iterating over it does not require
+     * checking each element.
+     */
+    class StatsMask
+    {
+    public:
+        /** Span of consecutive masked elements, as offsets in the item */
+        struct Span
+        {
+            size_t start, length;
+        };
+
+        StatsMask() = default;
+
+        /** Create the mask from an array, using its non-zero elements */
+        StatsMask(const Array &mask);
+
+        /** Return a circular (or spherical for volumes) mask with the
+         * center at dim / 2. If inside is false, the mask will contain the
+         * elements outside the circle instead.
+         * The most recently used masks are cached, so they are only
+         * generated once for the same dimensions, radius and inside flag.
+         * The cache is bounded and the returned pointer keeps the mask
+         * alive even if it is removed from the cache later.
+         */
+        static std::shared_ptr<const StatsMask> circular(const ArrayDim &dim,
+                                                         double radius,
+                                                         bool inside = true);
+
+        /** Return the dimensions of the items for which the mask was made */
+        const ArrayDim& getDim() const;
+
+        /** Return the number of masked elements */
+        size_t getCount() const;
+
+        const std::vector<Span>& getSpans() const;
+
+    private:
+        ArrayDim dim;
+        size_t count = 0;
+        std::vector<Span> spans;
+
+        /** Add a span, merging it with the last one if consecutive */
+        void addSpan(size_t start, size_t length);
+    }; // class StatsMask
+
+
+    /** Accumulate the statistics of several arrays, for example the images
+     * of a stack, without keeping all of them in memory. The partial
+     * results are merged exactly, so the global stats are the same as if
+     * they were computed on all values at once.
+     * Items can be added from several threads.
+     */
+    class StatsAccumulator
+    {
+    public:
+        /** Compute the stats of the array, merge them into the global
+         * ones and return the stats of the array. */
+        Stats add(const Array &array);
+
+        /** Merge stats already computed from n values */
+        void add(const Stats &stats, size_t n);
+
+        /** Add all images of the file. Images are read through an
+         * ImageReader, so the next one is read while the stats of the
+         * current one are computed.
+         * @return The stats of each image in the file.
+         */
+        std::vector<Stats> add(ImageFile &imgFile);
+
+        /** Return the stats of all the values added so far */
+        Stats getStats() const;
+
+        /** Return the number of values added so far */
+        size_t getCount() const;
+
+        void clear();
+
+    private:
+        mutable std::mutex mutex;
+        size_t count = 0;
+        double min = 0, max = 0, mean = 0, m2 = 0;
+    }; // class StatsAccumulator
+
+
+    /** Histogram of the values of an Array with bins of equal width.
+     * It also provides approximate quantiles (percentiles) of big arrays
+     * without sorting them.
+     */
+    struct Histogram
+    {
+        double min = 0, max = 0;  // Range covered by the bins
+        std::vector<size_t> counts;  // Number of values in each bin
+
+        /** Compute the histogram with the given number of bins between
+         * min and max. Values outside that range are not counted. */
+        static Histogram compute(const Array& array, size_t bins,
+                                 double min, double max);
+
+        /** Compute the histogram with the range taken from the minimum
+         * and maximum values of the array (computed in a previous pass) */
+        static Histogram compute(const Array& array, size_t bins = 256);
+
+        /** Compute the histogram of the input raw memory */
+        static Histogram compute(const Type& type, const void * memory,
+                                 size_t n, size_t bins, double min, double max);
+
+        /** Return the total number of values counted in the histogram */
+        size_t getTotal() const;
+
+        /** Return an approximation of the quantile q (between 0 and 1)
+         * by interpolating inside the bin that contains it. */
+        double getQuantile(double q) const;
+
+        /** Compute the quantiles qs (each between 0 and 1) of the values,
+         * with the same definition of numpy.quantile (linear interpolation
+         * between the closest ranks). The values are counted in a single
+         * pass over the data:
+         *  - 8 and 16 bits integer types are counted exactly, so the
+         *    quantiles are also exact.
+         *  - Other types are counted in a sketch of 65536 buckets given by
+         *    the most significant bits of their float representation, so
+         *    the relative error of each quantile is below 2^-7.
+         */
+        static std::vector<double> quantiles(const Array& array,
+                                             const std::vector<double> &qs);
+
+        /** Compute the quantiles of the input raw memory */
+        static std::vector<double> quantiles(const Type& type,
+                                             const void * memory, size_t n,
+                                             const std::vector<double> &qs);
+    }; // struct Histogram
+
 } // namespace emcore
 
 #endif //EM_CORE_STATS_H
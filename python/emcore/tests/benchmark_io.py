@@ -0,0 +1,62 @@
+#!/usr/bin/env python
+from __future__ import print_function
+
+import os
+import random
+import sys
+import tempfile
+import time
+
+import emcore as emc
+
+
+def timeit(func, repeat=3):
+    """ Return the best time (in secs) of several calls. """
+    best = None
+    for _ in range(repeat):
+        t = time.time()
+        func()
+        t = time.time() - t
+        best = t if best is None else min(best, t)
+    return best
+
+
+def readEach(imgFile, indexes):
+    """ Read one image per call, as done before batched reads. """
+    img = emc.Image()
+    for i in indexes:
+        imgFile.read(i, img)
+
+
+if __name__ == '__main__':
+    # Number of particles in the stack, particle size and number of
+    # random particles to read can be given as arguments
+    args = [int(a) for a in sys.argv[1:]]
+    n, size, count = args + [20000, 128, 5000][len(args):]
+
+    fn = os.path.join(tempfile.gettempdir(), 'benchmark_io.mrcs')
+    img = emc.Image(emc.ArrayDim(size, size, 1, 1), emc.typeFloat)
+    output = emc.ImageFile(fn, emc.File.TRUNCATE)
+    output.createEmpty(emc.ArrayDim(size, size, 1, n), emc.typeFloat)
+    output.write(n, img)
+    output.close()
+
+    indexes = [random.randint(1, n) for _ in range(count)]
+    imgFile = emc.ImageFile(fn)
+    batch = emc.Image()
+
+    print("Benchmark of reading %d random particles of %dx%d from a stack "
+          "of %d (best of 3 runs, page cache warm)" % (count, size, size, n))
+    print("%24s %12s %12s" % ("method", "time(s)", "speedup"))
+
+    tEach = timeit(lambda: readEach(imgFile, indexes))
+    print("%24s %12.5f %12.2f" % ("one read per image", tEach, 1))
+
+    for name, backend in [("batch pread", emc.ImageFile.IO_PREAD),
+                          ("batch io_uring", emc.ImageFile.IO_URING)]:
+        imgFile.setBackend(backend)
+        t = timeit(lambda: imgFile.read(indexes, batch))
+        print("%24s %12.5f %12.2f" % (name, t, tEach / t))
+
+    imgFile.close()
+    os.remove(fn)
@@ -0,0 +1,50 @@
+#!/usr/bin/env python
+from __future__ import print_function
+
+import time
+import sys
+
+import emcore as emc
+import numpy as np
+
+
+def timeit(func, repeat=5):
+    """ Return the best time (in secs) of several calls and the result. """
+    best = None
+    for _ in range(repeat):
+        t = time.time()
+        result = func()
+        t = time.time() - t
+        best = t if best is None else min(best, t)
+    return best, result
+
+
+def numpyStats(data):
+    return np.amin(data), np.amax(data), np.mean(data), np.std(data)
+
+
+if __name__ == '__main__':
+    # Sizes to benchmark, can be given as arguments (number of elements)
+    sizes = [int(a) for a in sys.argv[1:]] or [10**4, 10**6, 4096 * 4096,
+                                               8 * 10**7]
+
+    print("Benchmark of Stats.compute against numpy (best of 5 runs)")
+    print("%12s %8s %12s %12s %12s %12s" % ("size", "type", "emcore(s)",
+                                            "numpy(s)", "speedup",
+                                            "std rel.err"))
+
+    for n in sizes:
+        for emcType, npType in [(emc.typeFloat, np.float32),
+                                (emc.typeDouble, np.float64)]:
+            img = emc.Image(emc.ArrayDim(n, 1, 1, 1), emcType)
+            data = np.array(img, copy=False)
+            data[:] = np.random.normal(1000, 2, n).astype(npType)
+
+            tEmc, s = timeit(lambda: emc.Stats.compute(img))
+            tNp, (mn, mx, mean, std) = timeit(lambda: numpyStats(data))
+
+            assert s.min == mn and s.max == mx
+            assert abs(s.mean - mean) <= 1e-6 * abs(mean)
+            print("%12d %8s %12.5f %12.5f %12.2f %12.2e"
+                  % (n, npType.__name__, tEmc, tNp, tNp / tEmc,
+                     abs(s.std - std) / std))
@@ -74,6 +74,26 @@ class TestImageFile(BaseTest):
 
             self.assertEqual(img.getDim(), micDim)
 
+    def test_reader(self):
+        import numpy as np
+        fn = 'test_reader.mrcs'
+        img = emc.Image(emc.ArrayDim(16, 16, 1, 1), emc.typeFloat)
+        output = emc.ImageFile(fn, emc.File.TRUNCATE)
+        for i in range(1, 6):
+            np.array(img, copy=False)[:] = i
+            output.write(i, img)
+        output.close()
+
+        # Images are read in order, prefetching the next ones
+        indexes = []
+        imgFile = emc.ImageFile(fn)
+        for index, image in emc.ImageReader(imgFile, 2):
+            self.assertEqual(np.array(image, copy=False).mean(), index)
+            indexes.append(index)
+        imgFile.close()
+        os.remove(fn)
+        self.assertEqual(indexes, list(range(1, 6)))
+
 
 class TestImage(BaseTest):
     def test_basic(self):
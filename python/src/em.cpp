@@ -10,6 +10,7 @@ using namespace emcore;
 // Define each submodule separately
 void init_submodule_base(py::module &);
 void init_submodule_image(py::module &);
+void init_submodule_proc(py::module &);
 
 
 PYBIND11_MODULE(_emcore, m) {
@@ -28,6 +29,7 @@ PYBIND11_MODULE(_emcore, m) {
 
     init_submodule_base(m);
     init_submodule_image(m);
+    init_submodule_proc(m);
 
 #ifdef EMCORE_VERSION
     m.attr("__version__") = EMCORE_VERSION;
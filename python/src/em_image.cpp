@@ -6,6 +6,10 @@
 #include <pybind11/stl.h>
 
 #include "emc/base/image.h"
+#include "emc/base/image_cache.h"
+#include "emc/base/image_reader.h"
+#include "emc/base/image_writer.h"
+#include "emc/base/table.h"
 
 namespace py = pybind11;
 
@@ -39,10 +43,14 @@ void init_submodule_image(py::module &m) {
         .def("write", (void (Image::*)(const ImageLocation&) const) &Image::write)
         .def("write", (void (Image::*)(const std::string &) const) &Image::write);
 
-    py::class_<ImageFile>(m, "ImageFile")
-        .def_static("hasImpl", &ImageFile::hasImpl)
+    py::class_<ImageFile> imgFile(m, "ImageFile");
+    imgFile.def_static("hasImpl", &ImageFile::hasImpl)
         .def_static("getImplTypes", &ImageFile::getImplTypes)
         .def_static("getFormatTypes", &ImageFile::getFormatTypes)
+        .def_static("scanHeaders", &ImageFile::scanHeaders,
+                 py::arg("paths"), py::arg("cachePath")="",
+                 py::arg("threads")=0,
+                 py::call_guard<py::gil_scoped_release>())
         .def(py::init<>())
         .def(py::init<const std::string&, const File::Mode, const std::string&>(),
                  py::arg("path"),
@@ -54,10 +62,112 @@ void init_submodule_image(py::module &m) {
                  py::arg("formatName")="")
         .def("getDim", &ImageFile::getDim)
         .def("getType", &ImageFile::getType)
-        .def("read", &ImageFile::read)
+        .def("read", (void (ImageFile::*)(size_t, Image&)) &ImageFile::read)
+        .def("read", (void (ImageFile::*)(size_t, size_t, Image&)) &ImageFile::read)
+        .def("read", (void (ImageFile::*)(const std::vector<size_t>&, Image&))
+                 &ImageFile::read, py::call_guard<py::gil_scoped_release>())
+        .def_static("setDefaultBackend", &ImageFile::setDefaultBackend)
+        .def_static("getDefaultBackend", &ImageFile::getDefaultBackend)
+        .def("setBackend", &ImageFile::setBackend)
+        .def("getBackend", &ImageFile::getBackend)
+        .def_static("setDefaultCacheMode", &ImageFile::setDefaultCacheMode)
+        .def_static("getDefaultCacheMode", &ImageFile::getDefaultCacheMode)
+        .def("setCacheMode", &ImageFile::setCacheMode)
+        .def("getCacheMode", &ImageFile::getCacheMode)
+        .def_static("setDefaultCompression", &ImageFile::setDefaultCompression)
+        .def_static("getDefaultCompression", &ImageFile::getDefaultCompression)
+        .def_static("setDefaultEerRendering",
+                    &ImageFile::setDefaultEerRendering)
+        .def_static("getDefaultEerUpsampling",
+                    &ImageFile::getDefaultEerUpsampling)
+        .def_static("getDefaultEerGrouping", &ImageFile::getDefaultEerGrouping)
+        .def("supportsCompression", &ImageFile::supportsCompression)
+        .def("setCompression", &ImageFile::setCompression)
+        .def("getCompression", &ImageFile::getCompression)
+        .def("setEerRendering", &ImageFile::setEerRendering)
+        .def("getEerUpsampling", &ImageFile::getEerUpsampling)
+        .def("getEerGrouping", &ImageFile::getEerGrouping)
+        .def("readRegion", &ImageFile::readRegion,
+                 py::arg("index"), py::arg("x"), py::arg("y"), py::arg("z"),
+                 py::arg("regionDim"), py::arg("image"),
+                 py::arg("type")=typeNull)
         .def("write", &ImageFile::write)
         .def("createEmpty", &ImageFile::createEmpty)
         .def("expand", &ImageFile::expand)
         .def("close", &ImageFile::close);
 
+    py::enum_<ImageFile::IOBackend>(imgFile, "IOBackend")
+            .value("IO_PREAD", ImageFile::IO_PREAD)
+            .value("IO_URING", ImageFile::IO_URING)
+            .export_values();
+
+    py::enum_<ImageFile::CacheMode>(imgFile, "CacheMode")
+            .value("CACHED", ImageFile::CACHED)
+            .value("DIRECT", ImageFile::DIRECT)
+            .value("DONTNEED", ImageFile::DONTNEED)
+            .export_values();
+
+    py::enum_<ImageFile::Compression>(imgFile, "Compression")
+            .value("NO_COMPRESSION", ImageFile::NO_COMPRESSION)
+            .value("LZW", ImageFile::LZW)
+            .value("DEFLATE", ImageFile::DEFLATE)
+            .value("ZSTD", ImageFile::ZSTD)
+            .export_values();
+
+    py::class_<ImageFileCache>(m, "ImageFileCache")
+        .def(py::init<size_t>(), py::arg("maxFiles")=64)
+        .def_static("getDefault", &ImageFileCache::getDefault,
+                    py::return_value_policy::reference)
+        .def("setMaxFiles", &ImageFileCache::setMaxFiles)
+        .def("getMaxFiles", &ImageFileCache::getMaxFiles)
+        .def("getSize", &ImageFileCache::getSize)
+        .def("read", &ImageFileCache::read)
+        .def("write", &ImageFileCache::write)
+        .def("close", &ImageFileCache::close)
+        .def("clear", &ImageFileCache::clear);
+
+    // The reader keeps the ImageFile alive and can be used as an iterator
+    // of (index, image) tuples, where the image is only valid until the
+    // next iteration
+    py::class_<ImageReader>(m, "ImageReader")
+        .def(py::init<ImageFile&, size_t>(),
+             py::arg("imgFile"), py::arg("prefetch")=4,
+             py::keep_alive<1, 2>())
+        .def(py::init<ImageFile&, size_t, size_t, size_t>(),
+             py::arg("imgFile"), py::arg("first"), py::arg("last"),
+             py::arg("prefetch")=4, py::keep_alive<1, 2>())
+        .def("next", &ImageReader::next,
+             py::call_guard<py::gil_scoped_release>())
+        .def("getIndex", &ImageReader::getIndex)
+        .def("getImage", &ImageReader::getImage,
+             py::return_value_policy::reference_internal)
+        .def("__iter__", [](ImageReader &r) -> ImageReader& { return r; },
+             py::return_value_policy::reference)
+        .def("__next__", [](py::object self) {
+            auto& reader = self.cast<ImageReader&>();
+            bool hasNext;
+            {
+                py::gil_scoped_release release;
+                hasNext = reader.next();
+            }
+            if (!hasNext)
+                throw py::stop_iteration();
+            auto image = py::cast(&reader.getImage(),
+                                  py::return_value_policy::reference_internal,
+                                  self);
+            return py::make_tuple(reader.getIndex(), image);
+        });
+
+    // Images are copied when queued, so they can be modified after write
+    py::class_<ImageWriter>(m, "ImageWriter")
+        .def(py::init<ImageFile&, size_t>(),
+             py::arg("imgFile"), py::arg("queueSize")=4,
+             py::keep_alive<1, 2>())
+        .def("write", (void (ImageWriter::*)(size_t, const Image&)) &ImageWriter::write,
+             py::call_guard<py::gil_scoped_release>())
+        .def("flush", &ImageWriter::flush,
+             py::call_guard<py::gil_scoped_release>())
+        .def("close", &ImageWriter::close,
+             py::call_guard<py::gil_scoped_release>());
+
 } // emc/image sub-module definition
@@ -0,0 +1,37 @@
+#include <string>
+#include <sstream>
+
+#include <pybind11/pybind11.h>
+#include <pybind11/operators.h>
+#include <pybind11/pytypes.h>
+#include <pybind11/stl.h>
+
+#include "emc/base/array.h"
+#include "emc/proc/stats.h"
+
+namespace py = pybind11;
+
+using namespace emcore;
+
+
+void init_submodule_proc(py::module &m) {
+
+    py::class_<Stats> stats(m, "Stats");
+    stats.def_static("compute",
+                     (Stats (*)(const Array&, Stats::Operation)) &Stats::compute,
+                     py::arg("array"), py::arg("op")=Stats::ALL)
+         .def_readonly("min", &Stats::min)
+         .def_readonly("max", &Stats::max)
+         .def_readonly("mean", &Stats::mean)
+         .def_readonly("std", &Stats::std)
+         .def("__str__", [](const Stats &s) {
+             std::stringstream ss;
+             ss << s;
+             return ss.str();
+         });
+
+    py::enum_<Stats::Operation>(stats, "Operation")
+            .value("ALL", Stats::ALL)
+            .value("MIN_MAX", Stats::MIN_MAX)
+            .export_values();
+} // emc/proc sub-module definition
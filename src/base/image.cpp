@@ -7,14 +7,30 @@
 #include <cassert>
 #include <vector>
 #include <algorithm>
+#include <cstring>
+#include <climits>
+#include <memory>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 
 #include "emc/base/error.h"
 #include "emc/base/log.h"
 #include "emc/base/type.h"
 #include "emc/base/array.h"
 #include "emc/base/registry.h"
+#include "emc/base/table.h"
 #include "emc/os/filesystem.h"
+#include "emc/os/io_ring.h"
+#include "emc/os/thread.h"
 #include "emc/base/image_priv.h"
+#include "emc/base/image_cache.h"
 
 
 using namespace emcore;
@@ -82,7 +98,8 @@ Image::Image(): Array()
     impl = new Impl();
 } // empty Ctor
 
-Image::Image(const ArrayDim &adim, const Type & type): Array(adim, type)
+Image::Image(const ArrayDim &adim, const Type & type, void * memory):
+    Array(adim, type, memory)
 {
     impl = new Impl();
     // Type should be not null
@@ -96,6 +113,14 @@ Image::Image(const Image &other): Array(other)
     *this = other;
 } // Copy ctor Image
 
+Image::Image(Image &&other): Array()
+{
+    // Move-assign the base, so other keeps a valid (empty) Array impl
+    Array::operator=(std::move(other));
+    impl = new Impl();
+    std::swap(impl, other.impl);
+} // Move ctor Image
+
 Image& Image::operator=(const Image &other)
 {
     Array::operator=(other);
@@ -103,6 +128,13 @@ Image& Image::operator=(const Image &other)
     return *this;
 } //operator=
 
+Image& Image::operator=(Image &&other)
+{
+    Array::operator=(std::move(other));
+    std::swap(impl, other.impl);
+    return *this;
+} // function Image.operator= (move)
+
 Image::~Image()
 {
     delete impl;
@@ -138,11 +170,8 @@ std::istream& emc::operator>>(std::istream &istream, Image &image)
 
 void Image::read(const ImageLocation &location)
 {
-    ImageFile imgio;
-    imgio.open(location.path);
-    // FIXME: Now only reading the first image in the location range
-    imgio.read(location.index, *this);
-    imgio.close();
+    // Files are kept opened in the cache for the next reads
+    ImageFileCache::getDefault().read(location, *this);
 } // function Image::read
 
 void Image::read(const std::string &path)
@@ -152,18 +181,7 @@ void Image::read(const std::string &path)
 
 void Image::write(const ImageLocation &location) const
 {
-    ImageFile imgio;
-
-    if (Path::exists(location.path))
-        imgio.open(location.path,  File::Mode::READ_WRITE);
-    else
-    {
-        imgio.open(location.path,  File::Mode::TRUNCATE);
-        imgio.createEmpty(getDim(), getType());
-    }
-
-    imgio.write(location.index, *this);
-    imgio.close();
+    ImageFileCache::getDefault().write(location, *this);
 } // function Image::write
 
 void Image::write(const std::string &path) const
@@ -232,6 +250,221 @@ ImageFile::FormatTypes ImageFile::getFormatTypes()
     return dict;
 } // ImageFile::getFormatTypes
 
+/** Information about the header of a file, as returned by
+ * ImageFile::scanHeaders and stored in its cache file. */
+struct HeaderInfo
+{
+    size_t size = 0;
+    int64_t mtime = 0;  // Modification time in nanoseconds
+    ArrayDim dim;
+    Type type;
+    // Rendering of EER movies when scanned, since their dimensions depend
+    // on it (see ImageFile::Impl::getEerRendering, {0, 0} for other files)
+    std::pair<size_t, size_t> eerRendering = {0, 0};
+    std::string error;  // Message of the error scanning the file, if any
+};
+
+using HeaderInfoMap = std::map<std::string, HeaderInfo>;
+
+static std::string _typeToName(const Type &type)
+{
+    return type.isNull() ? "null" : type.getName();
+} // function _typeToName
+
+static Type _typeFromName(const std::string &name)
+{
+    for (auto &type: {typeInt8, typeUInt8, typeInt16, typeUInt16,
+                      typeInt32, typeUInt32, typeInt64, typeUInt64,
+                      typeFloat, typeDouble, typeCFloat, typeCDouble})
+        if (type.getName() == name)
+            return type;
+
+    return typeNull;
+} // function _typeFromName
+
+/** Read the headers cache file, one line per file with the fields: size,
+ * mtime, x, y, z, n, type, EER upsampling and grouping and path (last,
+ * since it can contain spaces).
+ * Malformed lines are ignored. */
+static void _readHeadersCache(const std::string &cachePath,
+                              HeaderInfoMap &infoMap)
+{
+    std::ifstream ifs(cachePath);
+    std::string line, typeName, path;
+
+    while (std::getline(ifs, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        std::istringstream iss(line);
+        HeaderInfo info;
+        auto &dim = info.dim;
+
+        if (iss >> info.size >> info.mtime >> dim.x >> dim.y >> dim.z
+                >> dim.n >> typeName >> info.eerRendering.first
+                >> info.eerRendering.second
+                && std::getline(iss >> std::ws, path))
+        {
+            info.type = _typeFromName(typeName);
+            infoMap[path] = info;
+        }
+    }
+} // function _readHeadersCache
+
+/** Write the headers cache to a temporary file that is then renamed, so
+ * other processes never read a partially written cache. */
+static void _writeHeadersCache(const std::string &cachePath,
+                               const HeaderInfoMap &infoMap)
+{
+    auto tmpPath = cachePath + ".tmp" + std::to_string(getpid());
+    std::ofstream ofs(tmpPath);
+
+    if (!ofs)
+        THROW_SYS_ERROR(std::string("Could not open file: ") + tmpPath);
+
+    ofs << "# size mtime x y z n type eer_upsampling eer_grouping path"
+        << std::endl;
+
+    for (auto &kv: infoMap)
+    {
+        auto &info = kv.second;
+        auto &dim = info.dim;
+        ofs << info.size << ' ' << info.mtime << ' ' << dim.x << ' '
+            << dim.y << ' ' << dim.z << ' ' << dim.n << ' '
+            << _typeToName(info.type) << ' ' << info.eerRendering.first << ' '
+            << info.eerRendering.second << ' ' << kv.first << '\n';
+    }
+    ofs.close();
+
+    if (!ofs || rename(tmpPath.c_str(), cachePath.c_str()) != 0)
+    {
+        remove(tmpPath.c_str());
+        THROW_SYS_ERROR(std::string("Could not write file: ") + cachePath);
+    }
+} // function _writeHeadersCache
+
+// Defined below, with the other EER defaults
+static std::pair<size_t, size_t> _getDefaultEerRendering();
+
+Table ImageFile::scanHeaders(const StringVector &paths,
+                             const std::string &cachePath, size_t threads)
+{
+    HeaderInfoMap cacheMap;
+    // EER entries are only valid if scanned with the current rendering
+    auto eerRendering = _getDefaultEerRendering();
+
+    if (!cachePath.empty() && Path::exists(cachePath))
+        _readHeadersCache(cachePath, cacheMap);
+
+    std::vector<HeaderInfo> infos(paths.size());
+    std::vector<char> scanned(paths.size(), 0);
+
+    // Read the header of the file at position i, unless it is in the cache
+    auto scanFile = [&](size_t i)
+    {
+        auto &path = paths[i];
+        auto &info = infos[i];
+        struct stat status;
+
+        if (stat(path.c_str(), &status) != 0)
+            THROW_SYS_ERROR(std::string("Could not 'stat' file: ") + path);
+
+        info.size = status.st_size;
+        info.mtime = status.st_mtim.tv_sec * 1000000000LL
+                     + status.st_mtim.tv_nsec;
+
+        auto it = cacheMap.find(path);
+        if (it != cacheMap.end() && it->second.size == info.size &&
+            it->second.mtime == info.mtime &&
+            (it->second.eerRendering.first == 0 ||
+             it->second.eerRendering == eerRendering))
+        {
+            info = it->second;
+            return;
+        }
+
+        // Only the header is read, without the rest of the state
+        // that ImageFile::open sets up for reading the images
+        std::unique_ptr<Impl> impl(
+                getImageIORegistry()->buildImpl(Path::getExtension(path)));
+        impl->path = path;
+        impl->openFile();
+
+        try
+        {
+            impl->scanHeader();
+        }
+        catch (...)
+        {
+            impl->closeFile();
+            throw;
+        }
+
+        info.dim = impl->dim;
+        info.type = impl->type;
+        info.eerRendering = impl->getEerRendering();
+        impl->closeFile();
+        scanned[i] = 1;
+    };
+
+    // The cache map is only read here, so it can be shared by all threads.
+    // Errors are reported in the row of the file and the scan goes on.
+    Thread::parallelFor(paths.size(), [&](size_t start, size_t end, size_t)
+    {
+        for (size_t i = start; i < end; ++i)
+        {
+            try
+            {
+                scanFile(i);
+            }
+            catch (const std::exception &e)
+            {
+                infos[i] = HeaderInfo();
+                infos[i].error = e.what();
+            }
+        }
+    }, threads);
+
+    Table table({Table::Column(1, "path", typeString),
+                 Table::Column(2, "x", typeSizeT),
+                 Table::Column(3, "y", typeSizeT),
+                 Table::Column(4, "z", typeSizeT),
+                 Table::Column(5, "n", typeSizeT),
+                 Table::Column(6, "type", typeString),
+                 Table::Column(7, "size", typeSizeT),
+                 Table::Column(8, "mtime", typeInt64),
+                 Table::Column(9, "error", typeString)});
+    auto row = table.createRow();
+    bool modified = false;
+
+    for (size_t i = 0; i < paths.size(); ++i)
+    {
+        auto &info = infos[i];
+        row["path"] = paths[i];
+        row["x"] = info.dim.x;
+        row["y"] = info.dim.y;
+        row["z"] = info.dim.z;
+        row["n"] = info.dim.n;
+        row["type"] = _typeToName(info.type);
+        row["size"] = info.size;
+        row["mtime"] = info.mtime;
+        row["error"] = info.error;
+        table.addRow(row);
+
+        if (scanned[i])
+        {
+            cacheMap[paths[i]] = info;
+            modified = true;
+        }
+    }
+
+    if (!cachePath.empty() && modified)
+        _writeHeadersCache(cachePath, cacheMap);
+
+    return table;
+} // function ImageFile.scanHeaders
+
 size_t ImageFile::fread(FILE *file, void *data, size_t count,
                         size_t typeSize, bool swap)
 {
@@ -280,6 +513,11 @@ void ImageFile::open(const std::string &path, const File::Mode mode,
 
     if (impl->fileMode !=  File::Mode::TRUNCATE)
         impl->readHeader();
+
+    impl->setCacheMode(getDefaultCacheMode());
+
+    if (impl->supportsCompression(getDefaultCompression()))
+        impl->compression = getDefaultCompression();
 } // function ImageFile.open
 
 ArrayDim ImageFile::getDim() const
@@ -294,9 +532,184 @@ Type ImageFile::getType() const
     return impl->type;
 } // function ImageFile.getType
 
-// TODO: Allow to read more than one image
-// TODO: Allow to read only a slice of a volume
+void ImageFile::map(Advice advice)
+{
+    // This will check that the file has been opened
+    auto fileType = getType();
+
+    ASSERT_ERROR(impl->fileMode != File::Mode::READ_ONLY,
+                 std::string("Only files opened as READ_ONLY can be mapped: ")
+                 + impl->path);
+    ASSERT_ERROR(fileType.isNull() || impl->dim.getSize() == 0,
+                 std::string("Can not map a file without images: ")
+                 + impl->path);
+    ASSERT_ERROR(!impl->hasRawLayout(),
+                 std::string("Memory mapping is not supported for this "
+                             "format: ") + impl->path);
+
+    impl->mapFile(advice);
+} // function ImageFile.map
+
+bool ImageFile::isMapped() const
+{
+    return impl != nullptr && impl->mapData != nullptr;
+} // function ImageFile.isMapped
+
+// Atomic since files can be opened from other threads while it is changed
+static std::atomic<ImageFile::IOBackend> defaultBackend(ImageFile::IO_PREAD);
+
+void ImageFile::setDefaultBackend(IOBackend backend)
+{
+    defaultBackend.store(backend);
+} // function ImageFile.setDefaultBackend
+
+ImageFile::IOBackend ImageFile::getDefaultBackend()
+{
+    return defaultBackend.load();
+} // function ImageFile.getDefaultBackend
+
+void ImageFile::setBackend(IOBackend backend)
+{
+    ASSERT_ERROR(impl == nullptr, "File has not been opened.");
+    impl->backend = backend;
+} // function ImageFile.setBackend
+
+ImageFile::IOBackend ImageFile::getBackend() const
+{
+    ASSERT_ERROR(impl == nullptr, "File has not been opened.");
+    return impl->backend;
+} // function ImageFile.getBackend
+
+// Atomic since files can be opened from other threads while it is changed
+static std::atomic<ImageFile::CacheMode> defaultCacheMode(ImageFile::CACHED);
+
+void ImageFile::setDefaultCacheMode(CacheMode mode)
+{
+    defaultCacheMode.store(mode);
+} // function ImageFile.setDefaultCacheMode
+
+ImageFile::CacheMode ImageFile::getDefaultCacheMode()
+{
+    return defaultCacheMode.load();
+} // function ImageFile.getDefaultCacheMode
+
+void ImageFile::setCacheMode(CacheMode mode)
+{
+    ASSERT_ERROR(impl == nullptr, "File has not been opened.");
+    impl->setCacheMode(mode);
+} // function ImageFile.setCacheMode
+
+ImageFile::CacheMode ImageFile::getCacheMode() const
+{
+    ASSERT_ERROR(impl == nullptr, "File has not been opened.");
+    return impl->cacheMode;
+} // function ImageFile.getCacheMode
+
+// Atomic since files can be opened from other threads while it is changed
+static std::atomic<ImageFile::Compression> defaultCompression(
+        ImageFile::NO_COMPRESSION);
+
+void ImageFile::setDefaultCompression(Compression compression)
+{
+    defaultCompression.store(compression);
+} // function ImageFile.setDefaultCompression
+
+ImageFile::Compression ImageFile::getDefaultCompression()
+{
+    return defaultCompression.load();
+} // function ImageFile.getDefaultCompression
+
+// Default rendering of EER movies, that can be changed from any thread
+static std::mutex eerMutex;
+static size_t eerUpsampling = 1;
+static size_t eerGrouping = 1;
+
+static void _checkEerRendering(size_t upsampling, size_t grouping)
+{
+    ASSERT_ERROR(upsampling != 1 && upsampling != 2 && upsampling != 4,
+                 "The EER upsampling should be 1, 2 or 4.");
+    ASSERT_ERROR(grouping == 0, "The EER grouping should be greater than 0.");
+} // function _checkEerRendering
+
+/** Return both values of the default EER rendering, consistent with each
+ * other even if they are changed from another thread. */
+static std::pair<size_t, size_t> _getDefaultEerRendering()
+{
+    std::lock_guard<std::mutex> lock(eerMutex);
+    return {eerUpsampling, eerGrouping};
+} // function _getDefaultEerRendering
+
+void ImageFile::setDefaultEerRendering(size_t upsampling, size_t grouping)
+{
+    _checkEerRendering(upsampling, grouping);
+    std::lock_guard<std::mutex> lock(eerMutex);
+    eerUpsampling = upsampling;
+    eerGrouping = grouping;
+} // function ImageFile.setDefaultEerRendering
+
+size_t ImageFile::getDefaultEerUpsampling()
+{
+    return _getDefaultEerRendering().first;
+} // function ImageFile.getDefaultEerUpsampling
+
+size_t ImageFile::getDefaultEerGrouping()
+{
+    return _getDefaultEerRendering().second;
+} // function ImageFile.getDefaultEerGrouping
+
+bool ImageFile::supportsCompression(Compression compression) const
+{
+    ASSERT_ERROR(impl == nullptr, "File has not been opened.");
+    return impl->supportsCompression(compression);
+} // function ImageFile.supportsCompression
+
+void ImageFile::setCompression(Compression compression)
+{
+    ASSERT_ERROR(impl == nullptr, "File has not been opened.");
+    ASSERT_ERROR(!impl->supportsCompression(compression),
+                 std::string("Unsupported compression for this file "
+                             "format: ") + impl->path);
+    impl->compression = compression;
+} // function ImageFile.setCompression
+
+ImageFile::Compression ImageFile::getCompression() const
+{
+    ASSERT_ERROR(impl == nullptr, "File has not been opened.");
+    return impl->compression;
+} // function ImageFile.getCompression
+
+void ImageFile::setEerRendering(size_t upsampling, size_t grouping)
+{
+    ASSERT_ERROR(impl == nullptr, "File has not been opened.");
+    _checkEerRendering(upsampling, grouping);
+    impl->setEerRendering(upsampling, grouping);
+} // function ImageFile.setEerRendering
+
+size_t ImageFile::getEerUpsampling() const
+{
+    ASSERT_ERROR(impl == nullptr, "File has not been opened.");
+    return impl->getEerRendering().first;
+} // function ImageFile.getEerUpsampling
+
+size_t ImageFile::getEerGrouping() const
+{
+    ASSERT_ERROR(impl == nullptr, "File has not been opened.");
+    return impl->getEerRendering().second;
+} // function ImageFile.getEerGrouping
+
 void ImageFile::read(size_t index, Image &image)
+{
+    // Check that the index to be ready is within the file number of images
+    ArrayDim adim = getDim(); // This will check that the file was open
+    ASSERT_ERROR(index > adim.n, "Invalid index");
+
+    if (index == ImageLocation::ALL)
+        index = ImageLocation::FIRST;
+
+    read(index, index, image);
+} // function ImageFile::read
+
+void ImageFile::read(size_t first, size_t last, Image &image)
 {
     // Get first the type of the file, this will check
     // if the file has already been opened
@@ -307,52 +720,139 @@ void ImageFile::read(size_t index, Image &image)
     // so there is no type and we can't read
     ASSERT_ERROR(fileType.isNull(), "Can not read without a valid type.");
 
-    // Check that the index to be ready is within the file number of images
-    ArrayDim adim = getDim(); // This will check that the file was open
-    ASSERT_ERROR(index > adim.n, "Invalid index");
+    ArrayDim adim = getDim();
+    ASSERT_ERROR(first < 1 || first > last || last > adim.n,
+                 "Invalid range of indexes");
 
-    if (index == ImageLocation::ALL)
-        index = ImageLocation::FIRST;
+    adim.n = last - first + 1;
+
+    // If the file is mapped and the data does not need to be swapped,
+    // the image will be just a view of the mapped data (only possible
+    // for several images if there is no padding between them)
+    if (impl->mapData != nullptr && !impl->swap &&
+        (adim.n == 1 || impl->getPadSize() == 0))
+    {
+        image = Image(adim, fileType, impl->getMappedData(first));
+        return;
+    }
+
+    // Views can not be resized, so release it to allocate new memory
+    if (image.isView())
+        image = Image();
+
+    image.resize(adim, fileType);
+
+    std::vector<size_t> indexes(adim.n);
+    for (size_t i = 0; i < adim.n; ++i)
+        indexes[i] = first + i;
+
+    impl->readItemsData(indexes, image);
+
+    if (impl->swap)
+        Type::swapBytes(image.getData(), adim.getSize(),
+                        fileType.getSize());
+} // function ImageFile::read
+
+void ImageFile::read(const std::vector<size_t> &indexes, Image &image)
+{
+    auto fileType = getType();
+    ASSERT_ERROR(fileType.isNull(), "Can not read without a valid type.");
+
+    ArrayDim adim = getDim();
+    ASSERT_ERROR(indexes.empty(), "The list of indexes is empty.");
+
+    for (auto index: indexes)
+        ASSERT_ERROR(index < 1 || index > adim.n, "Invalid index");
+
+    adim.n = indexes.size();
+
+    if (image.isView())
+        image = Image();
 
-    adim.n = 1; // Allocate for just one element for now
     image.resize(adim, fileType);
-    impl->readImageData(index, image);
+    impl->readItemsData(indexes, image);
 
     if (impl->swap)
-        Type::swapBytes(image.getData(), adim.getItemSize(),
+        Type::swapBytes(image.getData(), adim.getSize(),
                         fileType.getSize());
 } // function ImageFile::read
 
+void ImageFile::readRegion(size_t index, size_t x, size_t y, size_t z,
+                           const ArrayDim &regionDim, Image &image,
+                           const Type &type)
+{
+    auto fileType = getType();
+    ASSERT_ERROR(fileType.isNull(), "Can not read without a valid type.");
+
+    ArrayDim adim = getDim();
+    ASSERT_ERROR(index < 1 || index > adim.n, "Invalid index");
+    ASSERT_ERROR(regionDim.getItemSize() == 0 ||
+                 x + regionDim.x > adim.x || y + regionDim.y > adim.y ||
+                 z + regionDim.z > adim.z,
+                 "Region should be inside the image dimensions.");
+
+    ArrayDim rdim(regionDim.x, regionDim.y, regionDim.z, 1);
+    bool cast = !type.isNull() && type != fileType;
+    // Read into a local buffer if the region needs to be casted, so
+    // several threads can read regions at the same time
+    Image buffer;
+    Image &output = cast ? buffer : image;
+
+    if (output.isView())
+        output = Image();
+
+    output.resize(rdim, fileType);
+    impl->readRegionData(index, x, y, z, output);
+
+    if (impl->swap)
+        Type::swapBytes(output.getData(), rdim.getSize(),
+                        fileType.getSize());
+
+    if (cast)
+    {
+        if (image.isView())
+            image = Image();
+        image.copy(output, type);
+    }
+} // function ImageFile::readRegion
+
 void ImageFile::write(size_t index, const Image &image)
+{
+    // FIXME: Check what to do with ALL as index
+    if (index == ImageLocation::ALL)
+        index = ImageLocation::FIRST;
+
+    writeImages(index, {&image});
+} // function ImageFile::write
+
+void ImageFile::writeImages(size_t index, const std::vector<const Image*> &images)
 {
     // Get first the type of the file, this will check
     // if the file has already been opened
     auto fileType = getType();
-    auto imageType = image.getType();
+    auto imageType = images[0]->getType();
+    size_t last = index + images.size() - 1;
 
     // If the file has been opened with TRUNCATE, it will
     // not have any type and we will use the one from the image
     // Otherwise, the image and file type should be the same
     if (fileType.isNull())
     {
-        auto adim = image.getDim();
-        adim.n = index;
+        auto adim = images[0]->getDim();
+        adim.n = last;
         createEmpty(adim, imageType);
     }
-    else
-        ASSERT_ERROR(imageType != fileType,
-                 "Image should have the same type of the file.");
 
-    // FIXME: Check what to do with ALL as index
-    if (index == ImageLocation::ALL)
-        index = ImageLocation::FIRST;
+    for (auto image: images)
+        ASSERT_ERROR(image->getType() != impl->type,
+                     "Image should have the same type of the file.");
 
     // If the file is not big enough to write in this position,
     // let's expand it to enable the write operation
-    expand(index);
+    expand(last);
 
-    impl->writeImageData(index, image);
-} // function ImageFile::write
+    impl->writeImagesData(index, images);
+} // function ImageFile::writeImages
 
 void ImageFile::createEmpty(const ArrayDim &adim, const Type & type)
 {
@@ -454,6 +954,22 @@ TypeVector ImageFile::Impl::getTypes() const
     return types;
 } // function ImageFile::Impl.getTypes
 
+bool ImageFile::Impl::supportsCompression(Compression compression) const
+{
+    return compression == NO_COMPRESSION;
+} // function ImageFile::Impl::supportsCompression
+
+void ImageFile::Impl::setEerRendering(size_t, size_t)
+{
+    THROW_ERROR(std::string("Only EER movies can set their rendering: ")
+                + path);
+} // function ImageFile::Impl::setEerRendering
+
+std::pair<size_t, size_t> ImageFile::Impl::getEerRendering() const
+{
+    return {0, 0};
+} // function ImageFile::Impl::getEerRendering
+
 size_t ImageFile::Impl::getHeaderSize() const
 {
     return 0;
@@ -474,6 +990,11 @@ const char * ImageFile::Impl::getModeString() const
     return File::modeToString(fileMode);
 } // function ImageFile::Impl::getModeString
 
+void ImageFile::Impl::scanHeader()
+{
+    readHeader();
+} // function ImageFile::Impl::scanHeader
+
 void ImageFile::Impl::openFile()
 {
     file = fopen(path.c_str(), getModeString());
@@ -484,6 +1005,9 @@ void ImageFile::Impl::openFile()
 
 void ImageFile::Impl::closeFile()
 {
+    unmapFile();
+    setCacheMode(CACHED);
+
     if (file != nullptr)
     {
         fclose(file);
@@ -491,6 +1015,52 @@ void ImageFile::Impl::closeFile()
     }
 } // function ImageFile::Impl::closeFile
 
+bool ImageFile::Impl::hasRawLayout() const
+{
+    return false;
+} // function ImageFile::Impl::hasRawLayout
+
+void ImageFile::Impl::mapFile(Advice advice)
+{
+    if (mapData == nullptr)
+    {
+        mapSize = getHeaderSize() + getImageSize() * dim.n;
+        ASSERT_ERROR(Path::getFileSize(path) < mapSize,
+                     std::string("File is smaller than expected from its "
+                                 "header: ") + path);
+
+        // Private mapping with write access, so the images read as views
+        // can be modified (copy-on-write) without changing the file
+        auto ptr = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE, fileno(file), 0);
+
+        if (ptr == MAP_FAILED)
+            THROW_SYS_ERROR(std::string("Could not 'mmap' file: ") + path);
+
+        mapData = static_cast<uint8_t *>(ptr);
+    }
+
+    static const int advices[] = {MADV_NORMAL, MADV_SEQUENTIAL, MADV_RANDOM};
+    // This is just a hint to the system, so errors are ignored
+    madvise(mapData, mapSize, advices[advice]);
+} // function ImageFile::Impl::mapFile
+
+void ImageFile::Impl::unmapFile()
+{
+    if (mapData != nullptr)
+    {
+        munmap(mapData, mapSize);
+        mapData = nullptr;
+        mapSize = 0;
+    }
+} // function ImageFile::Impl::unmapFile
+
+uint8_t * ImageFile::Impl::getMappedData(size_t index) const
+{
+    return mapData + getHeaderSize() + getImageSize() * (index - 1)
+           + getPadSize();
+} // function ImageFile::Impl::getMappedData
+
 void ImageFile::Impl::expand()
 {
     // When exanding the file, always writeHeader, since the number of
@@ -513,6 +1083,241 @@ void ImageFile::Impl::readImageHeader(const size_t index, Image &image) {}
 
 void ImageFile::Impl::writeImageHeader(const size_t index, const Image &image) {}
 
+/** Read (or write) from the file descriptor at the given position until
+ * all the buffers are transferred, issuing as many vectored calls as needed.
+ */
+static void _pioAll(int fd, struct iovec *iov, int iovcnt, off_t pos,
+                    bool write, const std::string &path)
+{
+    while (iovcnt > 0)
+    {
+        int n = std::min(iovcnt, IOV_MAX);
+        auto bytes = write ? pwritev(fd, iov, n, pos) : preadv(fd, iov, n, pos);
+
+        if (bytes <= 0)
+            THROW_SYS_ERROR(std::string(write ? "Could not 'pwritev' data to "
+                                              : "Could not 'preadv' data from ")
+                            + "file: " + path);
+
+        pos += bytes;
+        // Skip the buffers already filled and advance the partial one
+        for (; iovcnt > 0 && (size_t) bytes >= iov->iov_len; ++iov, --iovcnt)
+            bytes -= iov->iov_len;
+
+        if (iovcnt > 0)
+        {
+            iov->iov_base = static_cast<uint8_t *>(iov->iov_base) + bytes;
+            iov->iov_len -= bytes;
+        }
+    }
+} // function _pioAll
+
+// Alignment of positions, sizes and memory for unbuffered I/O
+static const size_t DIRECT_ALIGN = 4096;
+
+/** Return true if the memory, position and size of a transfer are aligned
+ * as required for unbuffered I/O. */
+static bool _isDirectAligned(const void *data, size_t pos, size_t size)
+{
+    return ((size_t) data | pos | size) % DIRECT_ALIGN == 0;
+} // function _isDirectAligned
+
+/** Unbuffered read (or write) of the buffers from the given position of a
+ * file opened with O_DIRECT. If the position, sizes and memory of all
+ * buffers are aligned, they are transferred directly. Otherwise the data
+ * goes through an aligned bounce buffer, and the partial blocks at the
+ * edges are read before being written.
+ */
+static void _directAll(int fd, struct iovec *iov, int iovcnt, size_t pos,
+                       size_t size, bool write, const std::string &path)
+{
+    auto isAligned = [](size_t value) { return value % DIRECT_ALIGN == 0; };
+    bool aligned = isAligned(pos);
+
+    for (int i = 0; aligned && i < iovcnt; ++i)
+        aligned = _isDirectAligned(iov[i].iov_base, 0, iov[i].iov_len);
+
+    if (aligned)
+    {
+        _pioAll(fd, iov, iovcnt, pos, write, path);
+        return;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+        THROW_SYS_ERROR(std::string("Could not 'fstat' file: ") + path);
+
+    size_t fileSize = st.st_size;
+    size_t start = pos - pos % DIRECT_ALIGN;
+    size_t end = pos + size;
+    size_t alignedEnd = (end + DIRECT_ALIGN - 1) / DIRECT_ALIGN * DIRECT_ALIGN;
+    const size_t chunkSize = 8 * 1024 * 1024;
+
+    void * mem = nullptr;
+    if (posix_memalign(&mem, DIRECT_ALIGN,
+                       std::min(chunkSize, alignedEnd - start)) != 0)
+        throw std::bad_alloc();
+
+    std::unique_ptr<void, void (*)(void *)> bounce(mem, free);
+    auto buffer = static_cast<uint8_t *>(mem);
+
+    // Copy n bytes between the bounce buffer and the current position
+    // in the input buffers
+    int i = 0;
+    size_t offset = 0;
+    auto copy = [&](uint8_t *data, size_t n)
+    {
+        while (n > 0)
+        {
+            size_t k = std::min(n, iov[i].iov_len - offset);
+            auto base = static_cast<uint8_t *>(iov[i].iov_base) + offset;
+
+            if (write)
+                memcpy(data, base, k);
+            else
+                memcpy(base, data, k);
+
+            data += k;
+            n -= k;
+            offset += k;
+
+            if (offset == iov[i].iov_len)
+            {
+                ++i;
+                offset = 0;
+            }
+        }
+    };
+
+    // Read len bytes from blockPos into the bounce buffer (at bufferPos),
+    // requiring at least need bytes. Bytes after the end of the file are
+    // set to zero.
+    auto readBlocks = [&](size_t bufferPos, size_t blockPos, size_t len,
+                          size_t need)
+    {
+        size_t done = 0;
+
+        while (done < len)
+        {
+            auto n = pread(fd, buffer + bufferPos + done, len - done,
+                           blockPos + done);
+            if (n < 0)
+                THROW_SYS_ERROR(std::string("Could not 'pread' data from "
+                                            "file: ") + path);
+            done += n;
+
+            // Only a read reaching the end of the file can be unaligned
+            if (n == 0 || !isAligned(done))
+                break;
+        }
+
+        ASSERT_ERROR(done < need,
+                     std::string("Unexpected end of file: ") + path);
+        memset(buffer + bufferPos + done, 0, len - done);
+    };
+
+    for (size_t blockPos = start; blockPos < alignedEnd; blockPos += chunkSize)
+    {
+        size_t len = std::min(chunkSize, alignedEnd - blockPos);
+        // Range of the data in the bounce buffer
+        size_t first = std::max(blockPos, pos) - blockPos;
+        size_t last = std::min(blockPos + len, end) - blockPos;
+
+        if (!write)
+        {
+            readBlocks(0, blockPos, len, last);
+            copy(buffer + first, last - first);
+            continue;
+        }
+
+        if (first > 0)
+            readBlocks(0, blockPos, DIRECT_ALIGN, 0);
+        if (last < len)
+            readBlocks(len - DIRECT_ALIGN, blockPos + len - DIRECT_ALIGN,
+                       DIRECT_ALIGN, 0);
+
+        copy(buffer + first, last - first);
+        struct iovec blockIov = {buffer, len};
+        _pioAll(fd, &blockIov, 1, blockPos, true, path);
+    }
+
+    // Writing the last block can make the file bigger than needed
+    if (write && alignedEnd > fileSize &&
+        ftruncate(fd, std::max(fileSize, end)) != 0)
+        THROW_SYS_ERROR(std::string("Could not 'ftruncate' file: ") + path);
+} // function _directAll
+
+int ImageFile::Impl::getDescriptor() const
+{
+    // Data written through the FILE stream (e.g. headers) should be in
+    // the file before using positional reads or writes
+    if (fileMode != File::Mode::READ_ONLY)
+        fflush(file);
+
+    return fileno(file);
+} // function ImageFile::Impl::getDescriptor
+
+void ImageFile::Impl::setCacheMode(CacheMode mode)
+{
+    if (directFd >= 0 && mode != DIRECT)
+    {
+        ::close(directFd);
+        directFd = -1;
+    }
+
+    cacheMode = mode;
+
+    if (mode == DIRECT && directFd < 0)
+    {
+#ifdef O_DIRECT
+        int flags = fileMode == File::Mode::READ_ONLY ? O_RDONLY : O_RDWR;
+        directFd = ::open(path.c_str(), flags | O_DIRECT);
+#endif
+        // Some file systems (e.g. tmpfs) do not support unbuffered I/O
+        if (directFd < 0)
+            cacheMode = DONTNEED;
+    }
+} // function ImageFile::Impl::setCacheMode
+
+void ImageFile::Impl::transferData(struct iovec *iov, int iovcnt, size_t pos,
+                                   bool write)
+{
+    size_t size = 0;
+    for (int i = 0; i < iovcnt; ++i)
+        size += iov[i].iov_len;
+
+    if (cacheMode == DIRECT)
+    {
+        // Data written through the FILE stream should be in the file
+        if (fileMode != File::Mode::READ_ONLY)
+            fflush(file);
+
+        _directAll(directFd, iov, iovcnt, pos, size, write, path);
+        return;
+    }
+
+    _pioAll(getDescriptor(), iov, iovcnt, pos, write, path);
+    dropCache(pos, size, write);
+} // function ImageFile::Impl::transferData
+
+void ImageFile::Impl::dropCache(size_t pos, size_t size, bool written)
+{
+    if (cacheMode != DONTNEED)
+        return;
+
+    int fd = fileno(file);
+    // These are only hints to the system, so errors are ignored
+#ifdef SYNC_FILE_RANGE_WRITE
+    if (written)
+        sync_file_range(fd, pos, size, SYNC_FILE_RANGE_WAIT_BEFORE |
+                                       SYNC_FILE_RANGE_WRITE |
+                                       SYNC_FILE_RANGE_WAIT_AFTER);
+#endif
+#ifdef POSIX_FADV_DONTNEED
+    posix_fadvise(fd, pos, size, POSIX_FADV_DONTNEED);
+#endif
+} // function ImageFile::Impl::dropCache
+
 void ImageFile::Impl::readImageData(const size_t index, Image &image)
 {
     size_t itemSize = getImageSize(); // Size of an item containing the padSize
@@ -521,31 +1326,238 @@ void ImageFile::Impl::readImageData(const size_t index, Image &image)
     // Compute the position of the item data in the file given its size
     size_t itemPos = getHeaderSize() + itemSize * (index - 1) + padSize;
 
-    if (fseek(file, itemPos, SEEK_SET) != 0)
-        THROW_SYS_ERROR(std::string("Could not 'fseek' in file. ") + path);
+    // Copy from the memory map if the file is mapped
+    if (mapData != nullptr)
+    {
+        memcpy(image.getData(), getMappedData(index), readSize);
+        return;
+    }
 
-    // FIXME: change this to read by chunks when we change this
-    // approach, right now only read a big chunk of one item size
+    // Positional read, so several threads can read at the same time
+    struct iovec iov = {image.getData(), readSize};
+    transferData(&iov, 1, itemPos, false);
+} // function ImageFile::Impl::readImageData
 
-    if (::fread(image.getData(), readSize, 1, file) != 1)
-        THROW_SYS_ERROR(std::string("Could not 'fread' data from file: ") + path);
-}
+void ImageFile::Impl::readItemsData(const std::vector<size_t> &indexes,
+                                    Image &image)
+{
+    size_t itemSize = getImageSize();
+    size_t padSize = getPadSize();
+    size_t readSize = itemSize - padSize;
+    size_t count = indexes.size();
+    auto data = static_cast<uint8_t *>(image.getData());
 
-void ImageFile::Impl::writeImageData(const size_t index, const Image &image)
+    // Decode one image at a time for formats that are not raw
+    if (!hasRawLayout())
+    {
+        std::lock_guard<std::mutex> lock(decodeMutex);
+        ArrayDim adim(dim);
+        adim.n = 1;
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            Image item(adim, type, data + i * readSize);
+            readImageData(indexes[i], item);
+        }
+        return;
+    }
+
+    if (mapData != nullptr)
+    {
+        for (size_t i = 0; i < count; ++i)
+            memcpy(data + i * readSize, getMappedData(indexes[i]), readSize);
+        return;
+    }
+
+    auto itemPos = [&](size_t index)
+    {
+        return getHeaderSize() + itemSize * (index - 1) + padSize;
+    };
+
+    // Split the indexes in runs of consecutive images, given by the
+    // position in indexes of their first image and their number of images
+    std::vector<std::pair<size_t, size_t>> runs;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (i > 0 && indexes[i] == indexes[i - 1] + 1)
+            ++runs.back().second;
+        else
+            runs.emplace_back(i, 1);
+    }
+
+    if (runs.size() > 1 && backend == IO_URING && IORing::isAvailable())
+    {
+        // Keep a ring per thread, so it is created only once and
+        // several threads can read at the same time
+        static thread_local std::unique_ptr<IORing> ring;
+        if (!ring)
+            ring.reset(new IORing());
+
+        bool direct = cacheMode == DIRECT;
+        int fd = direct ? directFd : getDescriptor();
+
+        // Data written through the FILE stream should be in the file
+        if (direct && fileMode != File::Mode::READ_ONLY)
+            fflush(file);
+
+        // Unbuffered reads of aligned images are submitted to the ring,
+        // the unaligned ones go through a bounce buffer
+        std::vector<IORing::Request> requests;
+        std::vector<size_t> unaligned;
+        requests.reserve(count);
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            auto ptr = data + i * readSize;
+            size_t pos = itemPos(indexes[i]);
+
+            if (direct && !_isDirectAligned(ptr, pos, readSize))
+                unaligned.push_back(i);
+            else
+                requests.push_back({fd, ptr, readSize, pos});
+        }
+
+        ring->read(requests);
+
+        for (auto i: unaligned)
+        {
+            struct iovec iov = {data + i * readSize, readSize};
+            _directAll(directFd, &iov, 1, itemPos(indexes[i]), readSize,
+                       false, path);
+        }
+
+        for (size_t i = 0; i < count; ++i)
+            dropCache(itemPos(indexes[i]), readSize, false);
+        return;
+    }
+
+    // Read each run with a single vectored read, where the padding
+    // between images is read into a scratch buffer
+    std::vector<uint8_t> padBuffer(padSize);
+    std::vector<struct iovec> iov;
+
+    for (auto &run: runs)
+    {
+        iov.clear();
+
+        for (size_t i = run.first; i < run.first + run.second; ++i)
+        {
+            if (i > run.first && padSize > 0)
+                iov.push_back({padBuffer.data(), padSize});
+            iov.push_back({data + i * readSize, readSize});
+        }
+
+        transferData(iov.data(), (int) iov.size(),
+                     itemPos(indexes[run.first]), false);
+    }
+} // function ImageFile::Impl::readItemsData
+
+void ImageFile::Impl::readRegionData(const size_t index, size_t x, size_t y,
+                                     size_t z, Image &image)
+{
+    auto rdim = image.getDim();
+    size_t typeSize = type.getSize();
+    size_t rowSize = rdim.x * typeSize;
+    auto data = static_cast<uint8_t *>(image.getData());
+    // Offset in the image data of the first element of each row
+    auto rowOffset = [&](size_t j, size_t k)
+    {
+        return (((z + k) * dim.y + y + j) * dim.x + x) * typeSize;
+    };
+
+    // Other formats are decoded completely and the region extracted
+    if (!hasRawLayout())
+    {
+        ArrayDim adim(dim);
+        adim.n = 1;
+        Image item(adim, type);
+        {
+            std::lock_guard<std::mutex> lock(decodeMutex);
+            readImageData(index, item);
+        }
+        auto itemData = static_cast<const uint8_t *>(item.getData());
+
+        for (size_t k = 0; k < rdim.z; ++k)
+            for (size_t j = 0; j < rdim.y; ++j, data += rowSize)
+                memcpy(data, itemData + rowOffset(j, k), rowSize);
+        return;
+    }
+
+    if (mapData != nullptr)
+    {
+        auto itemData = getMappedData(index);
+
+        for (size_t k = 0; k < rdim.z; ++k)
+            for (size_t j = 0; j < rdim.y; ++j, data += rowSize)
+                memcpy(data, itemData + rowOffset(j, k), rowSize);
+        return;
+    }
+
+    // Read consecutive rows with a single vectored read when the gap
+    // between them is small (it is read into a scratch buffer), otherwise
+    // start a new read for the next row
+    const size_t maxGap = 64 * 1024;
+    size_t rowGap = (dim.x - rdim.x) * typeSize;
+    std::vector<uint8_t> gapBuffer(std::min(rowGap, maxGap));
+    std::vector<struct iovec> iov;
+    size_t itemPos = getHeaderSize() + getImageSize() * (index - 1)
+                     + getPadSize();
+    size_t readPos = 0, lastEnd = 0;
+
+    for (size_t k = 0; k < rdim.z; ++k)
+        for (size_t j = 0; j < rdim.y; ++j, data += rowSize)
+        {
+            size_t pos = itemPos + rowOffset(j, k);
+
+            if (!iov.empty() && pos - lastEnd > gapBuffer.size())
+            {
+                transferData(iov.data(), (int) iov.size(), readPos, false);
+                iov.clear();
+            }
+
+            if (iov.empty())
+                readPos = pos;
+            else if (pos > lastEnd)
+                iov.push_back({gapBuffer.data(), pos - lastEnd});
+
+            iov.push_back({data, rowSize});
+            lastEnd = pos + rowSize;
+        }
+
+    transferData(iov.data(), (int) iov.size(), readPos, false);
+} // function ImageFile::Impl::readRegionData
+
+void ImageFile::Impl::writeImagesData(const size_t index,
+                                      const std::vector<const Image*> &images)
 {
     size_t itemSize = getImageSize();
     size_t padSize = getPadSize();
-    size_t writeSize = itemSize - padSize;
-    size_t itemPos = getHeaderSize() + itemSize * (index - 1) + padSize;
 
-    //std::cerr << "ImageFile::Impl::write: itemPos: " << itemPos << std::endl;
-    //std::cerr << "ImageFile::Impl::write: itemSize: " << itemSize << std::endl;
+    // Only contiguous images can be written at once
+    if (images.size() == 1 || !hasRawLayout() || padSize > 0)
+    {
+        for (size_t i = 0; i < images.size(); ++i)
+            writeImageData(index + i, *images[i]);
+        return;
+    }
+
+    std::vector<struct iovec> iov;
+    for (auto image: images)
+        iov.push_back({const_cast<void *>(image->getData()), itemSize});
 
-    if (fseek(file, itemPos, SEEK_SET) != 0)
-        THROW_SYS_ERROR(std::string("Could not 'fseek' in file: ") + path);
+    size_t itemPos = getHeaderSize() + itemSize * (index - 1);
+    transferData(iov.data(), (int) iov.size(), itemPos, true);
+} // function ImageFile::Impl::writeImagesData
 
-    fwrite(image.getData(), writeSize, 1, file);
+void ImageFile::Impl::writeImageData(const size_t index, const Image &image)
+{
+    size_t itemSize = getImageSize();
+    size_t padSize = getPadSize();
+    size_t writeSize = itemSize - padSize;
+    size_t itemPos = getHeaderSize() + itemSize * (index - 1) + padSize;
 
+    struct iovec iov = {const_cast<void *>(image.getData()), writeSize};
+    transferData(&iov, 1, itemPos, true);
 } // function ImageFile::Impl::write
 
 Type ImageFile::Impl::getTypeFromMode(int mode) const
@@ -575,6 +1587,7 @@ void ImageFile::Impl::toStream(std::ostream &ostream, int verbosity) const
 #include "image_formats/image_mrc.cpp"
 #include "image_formats/image_spider.cpp"
 #include "image_formats/image_tiff.cpp"
+#include "image_formats/image_eer.cpp"
 #include "image_formats/image_em.cpp"
 #include "image_formats/image_dm.cpp"
 #include "image_formats/image_imagic.cpp"
@@ -0,0 +1,270 @@
+//
+// Created on 10/18/26.
+//
+
+#include <list>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <sys/stat.h>
+
+#include "emc/base/error.h"
+#include "emc/os/filesystem.h"
+#include "emc/base/image_cache.h"
+
+
+using namespace emcore;
+
+
+// ===================== ImageFileCache Implementation =======================
+
+class ImageFileCache::Impl
+{
+public:
+    // Files opened for writing (also with TRUNCATE) are stored with the
+    // READ_WRITE mode, since they can also be used for reading. EER movies
+    // keep the rendering they were opened with, so their upsampling and
+    // grouping are also part of the key (zeros for other formats).
+    using Key = std::tuple<std::string, File::Mode, size_t, size_t>;
+
+    /** Return the key of a file that would be opened now, with the
+     * default rendering for EER movies */
+    static Key getKey(const std::string &path, File::Mode mode)
+    {
+        size_t upsampling = 0, grouping = 0;
+
+        if (Path::getExtension(path) == "eer")
+        {
+            upsampling = ImageFile::getDefaultEerUpsampling();
+            grouping = ImageFile::getDefaultEerGrouping();
+        }
+        return Key(path, mode, upsampling, grouping);
+    } // function getKey
+
+    /** Return the key of an opened file */
+    static Key getKey(const std::string &path, File::Mode mode,
+                      const ImageFile &file)
+    {
+        return Key(path, mode, file.getEerUpsampling(),
+                   file.getEerGrouping());
+    } // function getKey
+
+    struct Entry
+    {
+        Key key;
+        std::shared_ptr<ImageFile> file;
+        struct stat status;  // Status of the file when it was opened
+    };
+
+    // Entries sorted from the most to the least recently used
+    using EntryList = std::list<Entry>;
+
+    size_t maxFiles;
+    EntryList entries;
+    std::map<Key, EntryList::iterator> index;
+    mutable std::mutex mutex;
+
+    Impl(size_t maxFiles): maxFiles(maxFiles) {}
+
+    void remove(const Key &key)
+    {
+        auto it = index.find(key);
+        if (it != index.end())
+        {
+            entries.erase(it->second);
+            index.erase(it);
+        }
+    } // function remove
+
+    /** Remove the handles of the path opened with the given mode, with
+     * any rendering */
+    void remove(const std::string &path, File::Mode mode)
+    {
+        auto it = index.lower_bound(Key(path, mode, 0, 0));
+
+        while (it != index.end() && std::get<0>(it->first) == path &&
+               std::get<1>(it->first) == mode)
+        {
+            entries.erase(it->second);
+            it = index.erase(it);
+        }
+    } // function remove
+
+    /** Close the least recently used files until the limit is fulfilled */
+    void evict()
+    {
+        while (entries.size() > maxFiles)
+        {
+            index.erase(entries.back().key);
+            entries.pop_back();
+        }
+    } // function evict
+
+    /** Return the entry for the key if it is still valid, moving it to the
+     * front, or nullptr (removing the entry if it was not valid) */
+    Entry * find(const Key &key, bool exists, const struct stat &status)
+    {
+        auto it = index.find(key);
+        if (it == index.end())
+            return nullptr;
+
+        auto &s = it->second->status;
+        bool valid = exists && s.st_dev == status.st_dev &&
+                     s.st_ino == status.st_ino;
+
+        // Files opened for reading should not have been modified, while
+        // the ones opened for writing are modified through the handle
+        if (valid && std::get<1>(key) == File::READ_ONLY)
+            valid = s.st_size == status.st_size &&
+                    s.st_mtim.tv_sec == status.st_mtim.tv_sec &&
+                    s.st_mtim.tv_nsec == status.st_mtim.tv_nsec;
+
+        if (!valid)
+        {
+            remove(key);
+            return nullptr;
+        }
+
+        entries.splice(entries.begin(), entries, it->second);
+        return &entries.front();
+    } // function find
+}; // class ImageFileCache::Impl
+
+ImageFileCache::ImageFileCache(size_t maxFiles)
+{
+    ASSERT_ERROR(maxFiles == 0, "The maximum number of files should be "
+                                "greater than 0.");
+    impl = new Impl(maxFiles);
+} // ImageFileCache ctor
+
+ImageFileCache& ImageFileCache::getDefault()
+{
+    static ImageFileCache cache;
+    return cache;
+} // function ImageFileCache.getDefault
+
+void ImageFileCache::setMaxFiles(size_t maxFiles)
+{
+    ASSERT_ERROR(maxFiles == 0, "The maximum number of files should be "
+                                "greater than 0.");
+    std::lock_guard<std::mutex> lock(impl->mutex);
+    impl->maxFiles = maxFiles;
+    impl->evict();
+} // function ImageFileCache.setMaxFiles
+
+size_t ImageFileCache::getMaxFiles() const
+{
+    std::lock_guard<std::mutex> lock(impl->mutex);
+    return impl->maxFiles;
+} // function ImageFileCache.getMaxFiles
+
+size_t ImageFileCache::getSize() const
+{
+    std::lock_guard<std::mutex> lock(impl->mutex);
+    return impl->entries.size();
+} // function ImageFileCache.getSize
+
+std::shared_ptr<ImageFile> ImageFileCache::get(const std::string &path,
+                                               File::Mode mode)
+{
+    struct stat status;
+    bool exists = stat(path.c_str(), &status) == 0;
+
+    auto readKey = Impl::getKey(path, File::READ_ONLY);
+    auto writeKey = Impl::getKey(path, File::READ_WRITE);
+
+    // Return a valid cached handle for the requested mode, if any
+    auto findEntry = [&]() -> Impl::Entry *
+    {
+        Impl::Entry * entry = impl->find(writeKey, exists, status);
+
+        if (entry == nullptr && mode == File::READ_ONLY)
+            entry = impl->find(readKey, exists, status);
+
+        return entry;
+    };
+
+    if (mode != File::TRUNCATE)
+    {
+        std::lock_guard<std::mutex> lock(impl->mutex);
+        if (auto entry = findEntry())
+            return entry->file;
+    }
+
+    // Open the file and parse its header without holding the lock, so
+    // other files can be used from the cache meanwhile
+    auto file = std::make_shared<ImageFile>(path, mode);
+
+    if (stat(path.c_str(), &status) != 0)
+        THROW_SYS_ERROR(std::string("Could not 'stat' file: ") + path);
+    exists = true;
+
+    // The default rendering could have changed while opening the file
+    Impl::Key &key = mode == File::READ_ONLY ? readKey : writeKey;
+    key = Impl::getKey(path, std::get<1>(key), *file);
+
+    std::lock_guard<std::mutex> lock(impl->mutex);
+
+    // Another thread could have opened the same file meanwhile, then its
+    // handle is used (unless this one truncated the file)
+    if (mode != File::TRUNCATE)
+    {
+        if (auto entry = findEntry())
+            return entry->file;
+    }
+    else
+        impl->remove(path, File::READ_WRITE);
+
+    // The read-only handles would not see the changes
+    if (mode != File::READ_ONLY)
+        impl->remove(path, File::READ_ONLY);
+
+    impl->entries.push_front({key, file, status});
+    impl->index[key] = impl->entries.begin();
+    impl->evict();
+
+    return file;
+} // function ImageFileCache.get
+
+void ImageFileCache::read(const ImageLocation &location, Image &image)
+{
+    // FIXME: Now only reading the first image in the location range
+    get(location.path)->read(location.index, image);
+} // function ImageFileCache.read
+
+void ImageFileCache::write(const ImageLocation &location, const Image &image)
+{
+    close(location.path);
+
+    ImageFile imgio;
+
+    if (Path::exists(location.path))
+        imgio.open(location.path,  File::Mode::READ_WRITE);
+    else
+    {
+        imgio.open(location.path,  File::Mode::TRUNCATE);
+        imgio.createEmpty(image.getDim(), image.getType());
+    }
+
+    imgio.write(location.index, image);
+    imgio.close();
+} // function ImageFileCache.write
+
+void ImageFileCache::close(const std::string &path)
+{
+    std::lock_guard<std::mutex> lock(impl->mutex);
+    impl->remove(path, File::READ_ONLY);
+    impl->remove(path, File::READ_WRITE);
+} // function ImageFileCache.close
+
+void ImageFileCache::clear()
+{
+    std::lock_guard<std::mutex> lock(impl->mutex);
+    impl->index.clear();
+    impl->entries.clear();
+} // function ImageFileCache.clear
+
+ImageFileCache::~ImageFileCache()
+{
+    delete impl;
+} // ImageFileCache dtor
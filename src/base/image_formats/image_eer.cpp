@@ -0,0 +1,400 @@
+//
+// Created on 10/18/26.
+//
+
+#include <mutex>
+
+#include "tiffio.h"
+
+#include "emc/base/error.h"
+#include "emc/base/image.h"
+#include "emc/base/image_priv.h"
+#include "emc/os/thread.h"
+
+using namespace emcore;
+
+
+// Compression codes of the EER frames (one for each version of the
+// encoding) and tags with the bits of each field in the last version
+#define EER_COMPRESSION_8BIT     65000
+#define EER_COMPRESSION_7BIT     65001
+#define EER_COMPRESSION_VARIABLE 65002
+#define EER_TAG_RLE_BITS         65007
+#define EER_TAG_HORZ_SUB_BITS    65008
+#define EER_TAG_VERT_SUB_BITS    65009
+
+
+static TIFFExtendProc eerParentExtender = nullptr;
+
+/** Register the EER tags in every TIFF handle opened, so they can be read
+ * with TIFFGetField, and call the previously installed extender. */
+static void eerTagExtender(TIFF *tif)
+{
+    static const TIFFFieldInfo eerFields[] = {
+        {EER_TAG_RLE_BITS, 1, 1, TIFF_SHORT, FIELD_CUSTOM, 1, 0,
+         (char*) "EerRleBits"},
+        {EER_TAG_HORZ_SUB_BITS, 1, 1, TIFF_SHORT, FIELD_CUSTOM, 1, 0,
+         (char*) "EerHorzSubBits"},
+        {EER_TAG_VERT_SUB_BITS, 1, 1, TIFF_SHORT, FIELD_CUSTOM, 1, 0,
+         (char*) "EerVertSubBits"}
+    };
+    TIFFMergeFieldInfo(tif, eerFields, 3);
+
+    if (eerParentExtender != nullptr)
+        eerParentExtender(tif);
+} // function eerTagExtender
+
+
+/** Bit layout of the events of an EER frame. Each event is the number of
+ * pixels without electrons before it (run length) followed by its
+ * sub-pixel position (horizontal bits first). A run length with all its
+ * bits set means that there is no electron at the end of the run. */
+struct EerCode
+{
+    unsigned rleBits = 7;
+    unsigned horzBits = 2;
+    unsigned vertBits = 2;
+    unsigned subMask = 0;   // Xor applied to the stored sub-pixel bits
+}; // EerCode
+
+
+/** Decode the events of an EER frame of width x height pixels, calling
+ * func(x, y) with the position of each electron in the image upsampled by
+ * 2^upBits. The data should be followed by (at least) 8 zero bytes.
+ * Events are extracted from a 64-bit buffer refilled 32 bits at a time,
+ * so each field is read with a single shift and mask. */
+template <class Func>
+static void decodeEerFrame(const uint8_t *data, size_t size,
+                           const EerCode &code, size_t width, size_t height,
+                           unsigned upBits, Func func)
+{
+    const size_t total = width * height;
+    const uint64_t rleMax = (uint64_t(1) << code.rleBits) - 1;
+    const unsigned subBits = code.horzBits + code.vertBits;
+    const uint64_t subMax = (uint64_t(1) << subBits) - 1;
+    const unsigned horzMax = (1u << code.horzBits) - 1;
+    const unsigned xShift = code.horzBits - upBits;
+    const unsigned yShift = code.vertBits - upBits;
+
+    const uint8_t *ptr = data;
+    uint64_t bits = 0;
+    unsigned nbits = 0;
+    size_t bitsLeft = size * 8;
+    size_t pos = 0;
+
+    while (bitsLeft >= code.rleBits)
+    {
+        // Bytes are assembled in little-endian order, as they are stored
+        if (nbits < 32)
+        {
+            uint64_t word = uint64_t(ptr[0]) | uint64_t(ptr[1]) << 8 |
+                            uint64_t(ptr[2]) << 16 | uint64_t(ptr[3]) << 24;
+            bits |= word << nbits;
+            nbits += 32;
+            ptr += 4;
+        }
+
+        uint64_t run = bits & rleMax;
+        bits >>= code.rleBits;
+        nbits -= code.rleBits;
+        bitsLeft -= code.rleBits;
+        pos += run;
+
+        if (pos >= total)
+            break;
+        if (run == rleMax)
+            continue;
+        if (bitsLeft < subBits)
+            break;
+
+        unsigned sub = unsigned(bits & subMax) ^ code.subMask;
+        bits >>= subBits;
+        nbits -= subBits;
+        bitsLeft -= subBits;
+
+        size_t x = pos % width, y = pos / width;
+        func(((x << code.horzBits) | (sub & horzMax)) >> xShift,
+             ((y << code.vertBits) | (sub >> code.horzBits)) >> yShift);
+        ++pos;
+    }
+} // function decodeEerFrame
+
+
+/**
+ * EER (Electron Event Representation) movies written by Falcon 4
+ * detectors. Each TIFF directory is a raw frame storing the electron
+ * events, that are rendered into images of the size and grouping given by
+ * ImageFile::setDefaultEerRendering when the file is opened, or later by
+ * ImageFile::setEerRendering. Writing is not supported.
+ */
+class EerImageFile: public TiffImageFile
+{
+public:
+    EerCode code;
+    size_t sensorWidth = 0, sensorHeight = 0;
+    size_t frames = 0;
+    size_t upsampling = 1;
+    size_t grouping = 1;     // Raw frames summed in each image
+    unsigned upBits = 0;     // Log2 of the upsampling
+
+    void openFile() override
+    {
+        static std::once_flag flag;
+        std::call_once(flag, []()
+        {
+            eerParentExtender = TIFFSetTagExtender(eerTagExtender);
+        });
+        TiffImageFile::openFile();
+    } // function openFile
+
+    /** Read the encoding of the events from the first directory */
+    void readCode()
+    {
+        uint16 compression = 0;
+        TIFFGetField(tif, TIFFTAG_COMPRESSION, &compression);
+
+        if (compression == EER_COMPRESSION_8BIT)
+        {
+            code.rleBits = 8;
+            code.horzBits = code.vertBits = 0;
+        }
+        else if (compression == EER_COMPRESSION_7BIT)
+        {
+            code.rleBits = 7;
+            code.horzBits = code.vertBits = 2;
+        }
+        else if (compression == EER_COMPRESSION_VARIABLE)
+        {
+            uint16 rle = 0, horz = 0, vert = 0;
+            if (!TIFFGetField(tif, EER_TAG_RLE_BITS, &rle) ||
+                !TIFFGetField(tif, EER_TAG_HORZ_SUB_BITS, &horz) ||
+                !TIFFGetField(tif, EER_TAG_VERT_SUB_BITS, &vert))
+                THROW_ERROR(std::string("EerImageFile: Missing encoding "
+                                        "tags in file ") + path);
+            code.rleBits = rle;
+            code.horzBits = horz;
+            code.vertBits = vert;
+        }
+        else
+            THROW_ERROR(std::string("EerImageFile: Unknown compression of "
+                                    "file ") + path);
+
+        // Bits of each event should fit in a single refill of the decoder
+        ASSERT_ERROR(code.rleBits == 0 ||
+                     code.rleBits + code.horzBits + code.vertBits > 32,
+                     std::string("EerImageFile: Invalid encoding of file ")
+                     + path);
+
+        code.subMask = 0;
+        if (code.horzBits > 0 && code.vertBits > 0)
+            code.subMask = 1u << (code.horzBits - 1) |
+                           1u << (code.horzBits + code.vertBits - 1);
+    } // function readCode
+
+    void readHeader() override
+    {
+        readCode();
+
+        uint32 width = 0, length = 0;
+        if (!TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &width) ||
+            !TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &length))
+            THROW_ERROR(std::string("EerImageFile: Error reading the size "
+                                    "of file ") + path);
+
+        sensorWidth = width;
+        sensorHeight = length;
+        frames = TIFFNumberOfDirectories(tif);
+        type = typeUInt16;
+
+        auto rendering = _getDefaultEerRendering();
+        setEerRendering(rendering.first, rendering.second);
+    } // function readHeader
+
+    void setEerRendering(size_t upsampling, size_t grouping) override
+    {
+        unsigned bits = upsampling == 4 ? 2 : upsampling == 2 ? 1 : 0;
+
+        ASSERT_ERROR(bits > code.horzBits || bits > code.vertBits,
+                     std::string("EerImageFile: Events are not stored with "
+                                 "enough precision for the upsampling "
+                                 "in file ") + path);
+        ASSERT_ERROR(frames < grouping,
+                     std::string("EerImageFile: Less frames than the "
+                                 "grouping in file ") + path);
+
+        this->upsampling = upsampling;
+        this->grouping = grouping;
+        upBits = bits;
+        dim = ArrayDim(sensorWidth * upsampling, sensorHeight * upsampling, 1,
+                       frames / grouping);
+        written = dim.n;
+    } // function setEerRendering
+
+    std::pair<size_t, size_t> getEerRendering() const override
+    {
+        return {upsampling, grouping};
+    } // function getEerRendering
+
+    void scanHeader() override
+    {
+        readHeader();
+    } // function scanHeader
+
+    bool supportsCompression(ImageFile::Compression compression) const override
+    {
+        return compression == ImageFile::NO_COMPRESSION;
+    } // function supportsCompression
+
+    /** Read the events of a raw frame (all its strips one after the other)
+     * into the buffer, followed by 8 zero bytes, and return their size. */
+    size_t readRawFrame(TIFF *handle, size_t frame,
+                        std::vector<uint8_t> &buffer)
+    {
+        // Frames are mostly read in order, and reading the next directory
+        // avoids walking the chain from the first one
+        bool next = frame == size_t(TIFFCurrentDirectory(handle)) + 1;
+
+        if (!(next ? TIFFReadDirectory(handle)
+                   : TIFFSetDirectory(handle, (tdir_t) frame)))
+            THROW_ERROR(std::string("EerImageFile: Error reading frame "
+                                    "of file ") + path);
+
+        size_t strips = TIFFNumberOfStrips(handle);
+        toff_t * counts = nullptr;
+        if (!TIFFGetField(handle, TIFFTAG_STRIPBYTECOUNTS, &counts))
+            THROW_ERROR(std::string("EerImageFile: Error reading frame "
+                                    "of file ") + path);
+
+        size_t size = 0;
+        for (size_t s = 0; s < strips; ++s)
+            size += counts[s];
+
+        buffer.resize(size + 8);
+        size_t offset = 0;
+
+        for (size_t s = 0; s < strips; ++s)
+        {
+            if (TIFFReadRawStrip(handle, s, buffer.data() + offset,
+                                 counts[s]) < 0)
+                THROW_ERROR(std::string("EerImageFile: Error reading frame "
+                                        "of file ") + path);
+            offset += counts[s];
+        }
+        memset(buffer.data() + size, 0, 8);
+
+        return size;
+    } // function readRawFrame
+
+    /** Add the electrons of the raw frames [first, last) to the image */
+    void renderFrames(TIFF *handle, size_t first, size_t last, uint16_t *data)
+    {
+        std::vector<uint8_t> buffer;
+        size_t width = dim.x;
+
+        for (size_t f = first; f < last; ++f)
+        {
+            size_t size = readRawFrame(handle, f, buffer);
+            decodeEerFrame(buffer.data(), size, code, sensorWidth,
+                           sensorHeight, upBits, [&](size_t x, size_t y)
+            {
+                ++data[y * width + x];
+            });
+        }
+    } // function renderFrames
+
+    /** Render a single image, decoding its raw frames from several
+     * threads. Each thread keeps the positions of its electrons, that are
+     * added to the image afterwards, to avoid a copy of the image for
+     * each one. */
+    void readImageData(const size_t index, Image &image) override
+    {
+        auto data = static_cast<uint16_t*>(image.getData());
+        size_t first = (index - 1) * grouping;
+        memset(data, 0, dim.getItemSize() * type.getSize());
+
+        size_t threads = Thread::getChunks(grouping);
+        auto handles = getHandles(threads);
+
+        if (threads == 1)
+        {
+            renderFrames(tif, first, first + grouping, data);
+            return;
+        }
+
+        std::vector<std::vector<uint32_t>> events(threads);
+        size_t width = dim.x;
+
+        Thread::parallelFor(grouping, [&](size_t start, size_t end,
+                                          size_t chunk)
+        {
+            std::vector<uint8_t> buffer;
+            auto &positions = events[chunk];
+
+            for (size_t f = first + start; f < first + end; ++f)
+            {
+                size_t size = readRawFrame(handles[chunk], f, buffer);
+                decodeEerFrame(buffer.data(), size, code, sensorWidth,
+                               sensorHeight, upBits, [&](size_t x, size_t y)
+                {
+                    positions.push_back(uint32_t(y * width + x));
+                });
+            }
+        }, threads);
+
+        for (auto &positions: events)
+            for (auto p: positions)
+                ++data[p];
+    } // function readImageData
+
+    /** Render the images at the given indexes into consecutive places of
+     * the image, each thread rendering whole images with its own handle. */
+    void readItemsData(const std::vector<size_t> &indexes,
+                       Image &image) override
+    {
+        std::lock_guard<std::mutex> lock(decodeMutex);
+        size_t count = indexes.size();
+        auto data = static_cast<uint16_t*>(image.getData());
+        size_t itemSize = dim.getItemSize();
+
+        if (count == 1)
+        {
+            readImageData(indexes[0], image);
+            return;
+        }
+
+        size_t threads = Thread::getChunks(count);
+        auto handles = getHandles(threads);
+        memset(data, 0, count * itemSize * type.getSize());
+
+        Thread::parallelFor(count, [&](size_t start, size_t end, size_t chunk)
+        {
+            for (size_t i = start; i < end; ++i)
+            {
+                size_t first = (indexes[i] - 1) * grouping;
+                renderFrames(handles[chunk], first, first + grouping,
+                             data + i * itemSize);
+            }
+        }, threads);
+    } // function readItemsData
+
+
+    void writeHeader() override
+    {
+        THROW_ERROR("EerImageFile: Writing in EER format is not supported.");
+    } // function writeHeader
+
+    void writeImageData(const size_t, const Image &) override
+    {
+        THROW_ERROR("EerImageFile: Writing in EER format is not supported.");
+    } // function writeImageData
+
+    const IntTypeMap &getTypeMap() const override
+    {
+        static const IntTypeMap tm = {{16+SAMPLEFORMAT_UINT, typeUInt16}};
+        return tm;
+    } // function getTypeMap
+}; // class EerImageFile
+
+StringVector eerExts = {"eer"};
+
+REGISTER_IMAGE_IO(eerExts, EerImageFile);
@@ -160,6 +160,11 @@ public:
         return EM_HEADER_SIZE;
     } // function getHeaderSize
 
+    virtual bool hasRawLayout() const override
+    {
+        return true;
+    } // function hasRawLayout
+
     virtual const IntTypeMap & getTypeMap() const override
     {
         static const IntTypeMap tm = {
@@ -295,6 +295,12 @@ public:
             THROW_SYS_ERROR(std::string("Error opening file ") + headerPath);
     } // function openFile
 
+    // Images are stored one after the other in the .img file
+    bool hasRawLayout() const override
+    {
+        return true;
+    } // function hasRawLayout
+
     void closeFile() override
     {
         ImageFile::Impl::closeFile();
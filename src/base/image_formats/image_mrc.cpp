@@ -1,8 +1,10 @@
+#include <cstddef>
 #include <iomanip>
 
 #include "emc/base/error.h"
 #include "emc/base/image.h"
 #include "emc/base/image_priv.h"
+#include "emc/proc/stats.h"
 
 using namespace emcore;
 
@@ -94,6 +96,18 @@ public:
     MrcHeader header;
     bool isMrc2014 = true;
 
+    // Stats of each written image, used to update the header on close
+    std::vector<Stats> itemStats;
+    std::vector<bool> hasItemStats;
+    Stats fileStats;
+    bool hasFileStats = false;
+
+    // Stats in the header when the file was opened (if well determined)
+    // and the number of images they were computed from
+    Stats headerStats;
+    bool hasHeaderStats = false;
+    size_t headerItems = 0;
+
     virtual void readHeader() override
     {
         // Try to read the main header from the (already opened) file stream
@@ -130,6 +144,15 @@ public:
         type = getTypeFromMode(header.mode);
         ASSERT_ERROR(type.isNull(), "Unknown MRC type mode.");
 
+        // Keep the stats to update them if images are written later
+        headerItems = dim.n;
+        headerStats.min = header.dmin;
+        headerStats.max = header.dmax;
+        headerStats.mean = header.dmean;
+        headerStats.std = header.rms;
+        hasHeaderStats = header.dmax >= header.dmin &&
+                         header.dmean >= header.dmin && header.rms >= 0;
+
         // TODO: Check special cases where image is a transform
         // TODO: Determine swap order (little vs big endian)
 
@@ -191,8 +214,7 @@ public:
         header.mapr = 2;
         header.maps = 3;
 
-        // For the moment, set that Image statistics are not well determined
-        header.rms = -1;
+        setHeaderStats();
 
         // Set if volume or not, if stack or not
         // ispg = 0 if image or stack, 1 if volume, 401 if volume stack
@@ -211,6 +233,42 @@ public:
 
     } // function writeHeader
 
+    /** Set the statistics fields of the header. They are only known when
+     * closing after writing, otherwise they are marked as not well
+     * determined (dmax < dmin, dmean < min(dmin, dmax) and rms < 0) */
+    void setHeaderStats()
+    {
+        if (hasFileStats)
+        {
+            header.dmin = fileStats.min;
+            header.dmax = fileStats.max;
+            header.dmean = fileStats.mean;
+            header.rms = fileStats.std;
+        }
+        else
+        {
+            header.dmin = 0;
+            header.dmax = -1;
+            header.dmean = -2;
+            header.rms = -1;
+        }
+    } // function setHeaderStats
+
+    /** Write only the statistics fields in the header of the file (dmin,
+     * dmax and dmean at offset 76 and rms at 216), keeping the rest of
+     * the existing header as it is */
+    void writeHeaderStats()
+    {
+        setHeaderStats();
+
+        if (fseek(file, offsetof(MrcHeader, dmin), SEEK_SET) != 0 ||
+            fwrite(&header.dmin, sizeof(float), 3, file) != 3 ||
+            fseek(file, offsetof(MrcHeader, rms), SEEK_SET) != 0 ||
+            fwrite(&header.rms, sizeof(float), 1, file) != 1)
+            THROW_SYS_ERROR(std::string("Error writing MRC header in file: ")
+                            + path);
+    } // function writeHeaderStats
+
     // Override this method to support the 101 special MRC flag in which
     // the ImageSize is half of the normal size, because each pixel value
     // is stored only in 4 bits
@@ -228,9 +286,6 @@ public:
             // Compute the position of the item data in the file given its size
             size_t itemPos = getHeaderSize() + half * (index - 1);
 
-            if (fseek(file, itemPos, SEEK_SET) != 0)
-                THROW_SYS_ERROR("Could not 'fseek' in file. ");
-
             // Read the 4-bit data in the second half of the data array.
             // In that way, we can iterate in normal order and expand the
             // value of each pixel by shifting bits or masking
@@ -238,8 +293,8 @@ public:
             auto data = static_cast<uint8_t *>(image.getData());
             size_t start = size - half;
 
-            if (::fread(data + start, half, 1, file) != 1)
-                THROW_SYS_ERROR("Could not 'fread' data from file. ");
+            struct iovec iov = {data + start, half};
+            transferData(&iov, 1, itemPos, false);
 
             for (size_t i = 0, j = start; i < dim.getItemSize() - 1; i += 2, ++j)
             {
@@ -250,11 +305,103 @@ public:
         }
     } // function readImageData
 
+    virtual void writeImageData(const size_t index,
+                                const Image &image) override
+    {
+        ImageFile::Impl::writeImageData(index, image);
+        addItemStats(index, image);
+    } // function writeImageData
+
+    virtual void writeImagesData(const size_t index,
+                                 const std::vector<const Image*> &images) override
+    {
+        // Images written at once do not call writeImageData
+        if (images.size() == 1)
+            writeImageData(index, *images[0]);
+        else
+        {
+            ImageFile::Impl::writeImagesData(index, images);
+            for (size_t i = 0; i < images.size(); ++i)
+                addItemStats(index + i, *images[i]);
+        }
+    } // function writeImagesData
+
+    /** Keep the stats of a written image to update the header */
+    void addItemStats(const size_t index, const Image &image)
+    {
+        if (itemStats.size() < dim.n)
+        {
+            itemStats.resize(dim.n);
+            hasItemStats.resize(dim.n, false);
+        }
+        itemStats[index - 1] = Stats::compute(image);
+        hasItemStats[index - 1] = true;
+    } // function addItemStats
+
+    /** Merge the stats of the images written in this session with the
+     * ones of the other images, that are not read again: images not
+     * written in a new file (or after the previous end of the file) are
+     * zeros, while the old ones are taken from the header stats. If some
+     * old images were overwritten while others were kept, the header
+     * stats still include the overwritten values, so none of the stats
+     * can be known and all are marked as not well determined. The same
+     * happens if the old images are kept but there were no header stats. */
+    void updateFileStats()
+    {
+        StatsAccumulator acc;
+        size_t itemSize = dim.getItemSize();
+        size_t oldItems = fileMode == File::Mode::TRUNCATE ? 0 : headerItems;
+        size_t untouched = 0;  // Old images not written in this session
+        bool overwritten = false;
+        Stats zero;
+        zero.min = zero.max = zero.mean = zero.std = 0;
+
+        for (size_t i = 0; i < dim.n; ++i)
+        {
+            bool written = i < itemStats.size() && hasItemStats[i];
+
+            if (written)
+                acc.add(itemStats[i], itemSize);
+            else if (i >= oldItems)
+                acc.add(zero, itemSize);
+            else
+                ++untouched;
+
+            overwritten |= written && i < oldItems;
+        }
+
+        hasFileStats = untouched == 0 || (hasHeaderStats && !overwritten);
+
+        if (untouched > 0 && hasFileStats)
+            acc.add(headerStats, untouched * itemSize);
+
+        fileStats = acc.getStats();
+    } // function updateFileStats
+
+    virtual void closeFile() override
+    {
+        // Update the header statistics if any image was written
+        if (file != nullptr && !itemStats.empty())
+        {
+            updateFileStats();
+            writeHeaderStats();
+        }
+
+        ImageFile::Impl::closeFile();
+    } // function closeFile
+
     virtual size_t getHeaderSize() const override
     {
         return MRC_HEADER_SIZE;
     } // function getHeaderSize
 
+    // Images in the 101 mode are packed in 4 bits, so they can not be
+    // read directly from memory
+    virtual bool hasRawLayout() const override
+    {
+        return header.mode != 101;
+    } // function hasRawLayout
+
     virtual const IntTypeMap & getTypeMap() const override
     {
         static const IntTypeMap tm = {
@@ -289,6 +436,10 @@ public:
             std::cout << std::setw(7) << "nz: " << header.nz << std::endl;
             std::cout << std::setw(7) << "mode: " << header.mode << std::endl;
             std::cout << std::setw(7) << "nversion: " << header.nversion << std::endl;
+            std::cout << std::setw(7) << "dmin: " << header.dmin << std::endl;
+            std::cout << std::setw(7) << "dmax: " << header.dmax << std::endl;
+            std::cout << std::setw(7) << "dmean: " << header.dmean << std::endl;
+            std::cout << std::setw(7) << "rms: " << header.rms << std::endl;
         }
     } // function toStream
 
@@ -193,6 +193,11 @@ public:
         return dim.n > 1 ? pad : 0;
     }
 
+    virtual bool hasRawLayout() const override
+    {
+        return true;
+    } // function hasRawLayout
+
     virtual const IntTypeMap & getTypeMap() const override
     {
         static const IntTypeMap tm = {{0, typeFloat}};
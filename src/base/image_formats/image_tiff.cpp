@@ -7,13 +7,14 @@
 #include "emc/base/error.h"
 #include "emc/base/image.h"
 #include "emc/base/image_priv.h"
+#include "emc/os/thread.h"
 
 using namespace emcore;
 
 
 struct TiffHeader
 {                                   // Header for each Directory in TIFF
-    uint16          dirIndex;      // Directory index
+    tdir_t          dirIndex;      // Directory index (thumbnails included)
     unsigned short  bitsPerSample;
     unsigned short  samplesPerPixel;
     unsigned int    imageWidth;
@@ -25,6 +26,7 @@ struct TiffHeader
     uint16          pNumber, pTotal; // pagenumber and total number of pages of current directory
     TiffHeader()
     {
+        dirIndex=0;
         bitsPerSample=samplesPerPixel=resUnit=0;
         imageWidth=imageLength=subFileType=0;
         imageSampleFormat=pNumber=pTotal=0;
@@ -42,6 +44,9 @@ class TiffImageFile: public ImageFile::Impl
 public:
     std::vector<TiffHeader> vHeader;
     TIFF*      tif;        // TIFF Image file handler
+    std::vector<TIFF*> extraTifs; // Handles to decode from several threads
+    size_t written = 0;   // Number of directories (images) in the file
+    tdir_t dirCount = 0;  // Number of directories, including thumbnails
 
     /** Open the file for this format. The path and mode
      * should be set before calling this function.
@@ -61,8 +66,22 @@ public:
      */
     void closeFile() override
     {
+        // Images that were not written are added empty, so the file
+        // contains all the images of its dimensions
+        if (fileMode != File::Mode::READ_ONLY && written < vHeader.size())
+        {
+            std::vector<char> blank(dim.getItemSize() * type.getSize(), 0);
+            while (written < vHeader.size())
+                appendDirectory(blank.data());
+        }
+
         TIFFClose(tif);
 
+        for (auto handle: extraTifs)
+            TIFFClose(handle);
+        extraTifs.clear();
+        setCacheMode(ImageFile::CACHED);
+
         //TODO: we have to evaluate if we want to check this issue or relay onto programmer
         /* When creating a TIFF file without adding an image the file is 8 bytes
          * and this same file returns an error when trying to open again, we are going
@@ -75,6 +94,41 @@ public:
     }
 
 
+    /** Read the tags of the current directory */
+    void readDirectoryHeader(TiffHeader &header)
+    {
+        header.imageSampleFormat = SAMPLEFORMAT_VOID;
+        if (TIFFGetField(tif, TIFFTAG_BITSPERSAMPLE,  &header.bitsPerSample) == 0)
+            THROW_SYS_ERROR("TiffImageFile: Error reading TIFFTAG_BITSPERSAMPLE");
+        if (TIFFGetField(tif, TIFFTAG_SAMPLESPERPIXEL,&header.samplesPerPixel) == 0)
+            header.samplesPerPixel = 1;
+
+        if (TIFFGetField(tif, TIFFTAG_IMAGEWIDTH,     &header.imageWidth) == 0)
+            THROW_SYS_ERROR("TiffImageFile: Error reading TIFFTAG_IMAGEWIDTH");
+        if (TIFFGetField(tif, TIFFTAG_IMAGELENGTH,    &header.imageLength) == 0)
+            THROW_SYS_ERROR("TiffImageFile: Error reading TIFFTAG_IMAGELENGTH");
+        if (TIFFGetField(tif, TIFFTAG_SUBFILETYPE,    &header.subFileType) == 0)
+            header.subFileType = 0; // Some scanners does not provide this label. So, we set this to zero
+        //            REPORT_ERROR(ERR_IO_NOREAD,"rwTIFF: Error reading TIFFTAG_SUBFILETYPE");
+        TIFFGetField(tif, TIFFTAG_SAMPLEFORMAT,   &header.imageSampleFormat);
+        TIFFGetField(tif, TIFFTAG_RESOLUTIONUNIT, &header.resUnit);
+        TIFFGetField(tif, TIFFTAG_XRESOLUTION,    &header.xTiffRes);
+        TIFFGetField(tif, TIFFTAG_YRESOLUTION,    &header.yTiffRes);
+        TIFFGetField(tif, TIFFTAG_PAGENUMBER,     &header.pNumber, &header.pTotal);
+    } // function readDirectoryHeader
+
+    /** Set the dimensions and type from the first image header */
+    void setDimAndType(size_t n)
+    {
+        dim.x = vHeader[0].imageWidth;
+        dim.y = vHeader[0].imageLength;
+        dim.z = 1;
+        dim.n = n;
+        // We obtain single value mode by adding bitspersample and sampleformat
+        int mode = vHeader[0].bitsPerSample + vHeader[0].imageSampleFormat;
+        type = getTypeFromMode(mode);
+    } // function setDimAndType
+
     void readHeader() override
     {
         TiffHeader header;
@@ -82,50 +136,122 @@ public:
         /* Get TIFF image properties */
         do
         {
-            header.imageSampleFormat = SAMPLEFORMAT_VOID;
-            if (TIFFGetField(tif, TIFFTAG_BITSPERSAMPLE,  &header.bitsPerSample) == 0)
-                THROW_SYS_ERROR("TiffImageFile: Error reading TIFFTAG_BITSPERSAMPLE");
-            if (TIFFGetField(tif, TIFFTAG_SAMPLESPERPIXEL,&header.samplesPerPixel) == 0)
-                header.samplesPerPixel = 1;
-
-            if (TIFFGetField(tif, TIFFTAG_IMAGEWIDTH,     &header.imageWidth) == 0)
-                THROW_SYS_ERROR("TiffImageFile: Error reading TIFFTAG_IMAGEWIDTH");
-            if (TIFFGetField(tif, TIFFTAG_IMAGELENGTH,    &header.imageLength) == 0)
-                THROW_SYS_ERROR("TiffImageFile: Error reading TIFFTAG_IMAGELENGTH");
-            if (TIFFGetField(tif, TIFFTAG_SUBFILETYPE,    &header.subFileType) == 0)
-                header.subFileType = 0; // Some scanners does not provide this label. So, we set this to zero
-            //            REPORT_ERROR(ERR_IO_NOREAD,"rwTIFF: Error reading TIFFTAG_SUBFILETYPE");
-            TIFFGetField(tif, TIFFTAG_SAMPLEFORMAT,   &header.imageSampleFormat);
-            TIFFGetField(tif, TIFFTAG_RESOLUTIONUNIT, &header.resUnit);
-            TIFFGetField(tif, TIFFTAG_XRESOLUTION,    &header.xTiffRes);
-            TIFFGetField(tif, TIFFTAG_YRESOLUTION,    &header.yTiffRes);
-            TIFFGetField(tif, TIFFTAG_PAGENUMBER,     &header.pNumber, &header.pTotal);
+            readDirectoryHeader(header);
 
             if ((header.subFileType & 0x00000001) != 0x00000001) //add image if not a thumbnail
             {
                 header.dirIndex = TIFFCurrentDirectory(tif);
                 vHeader.push_back(header);
             }
+            ++dirCount;
         }
         while(TIFFReadDirectory(tif));
 
         // TODO: swap management
 //    swap = TIFFIsByteSwapped(tif);
 
-        dim.x = vHeader[0].imageWidth;
-        dim.y = vHeader[0].imageLength;
-        dim.z = 1;
-        dim.n = vHeader.size();
-        // We obtain single value mode by adding bitspersample and sampleformat
-        int mode = vHeader[0].bitsPerSample + vHeader[0].imageSampleFormat;
-        type = getTypeFromMode(mode);
+        setDimAndType(vHeader.size());
+        written = vHeader.size();
         // TODO: EMan2 does not write the datatype, using Float by default (do we fix it?)
     }
 
-    void writeHeader() override
+    void scanHeader() override
+    {
+        // Only the first image directory is parsed, for the others just
+        // the sub-file type is read to skip thumbnails as in readHeader
+        size_t n = 0;
+
+        do
+        {
+            unsigned int subFileType = 0;
+            TIFFGetField(tif, TIFFTAG_SUBFILETYPE, &subFileType);
+
+            if ((subFileType & 0x00000001) != 0)  // thumbnail
+                continue;
+
+            if (n++ == 0)
+            {
+                TiffHeader header;
+                readDirectoryHeader(header);
+                header.dirIndex = TIFFCurrentDirectory(tif);
+                vHeader.push_back(header);
+            }
+        }
+        while (TIFFReadDirectory(tif));
+
+        ASSERT_ERROR(n == 0, "TiffImageFile: No images found in file " + path);
+        setDimAndType(n);
+    } // function scanHeader
+
+    /** Return the libtiff code of a compression, or 0 if it is not
+     * known by this version of libtiff. */
+    static uint16 getTiffCompression(ImageFile::Compression compression)
     {
-        vHeader.clear();
+        switch (compression)
+        {
+            case ImageFile::NO_COMPRESSION: return COMPRESSION_NONE;
+            case ImageFile::LZW: return COMPRESSION_LZW;
+            case ImageFile::DEFLATE: return COMPRESSION_ADOBE_DEFLATE;
+#ifdef COMPRESSION_ZSTD
+            case ImageFile::ZSTD: return COMPRESSION_ZSTD;
+#endif
+            default: return 0;
+        }
+    } // function getTiffCompression
+
+    bool supportsCompression(ImageFile::Compression compression) const override
+    {
+        auto code = getTiffCompression(compression);
+        return code != 0 && TIFFIsCODECConfigured(code);
+    } // function supportsCompression
+
+    /** Return the number of rows of each strip. Uncompressed images are
+     * stored in a single strip, while compressed ones are split in strips
+     * of about 1 MiB that can be encoded and decoded in parallel. */
+    uint32 getRowsPerStrip(const TiffHeader &header) const
+    {
+        if (compression == ImageFile::NO_COMPRESSION)
+            return header.imageLength;
+
+        size_t rowSize = header.imageWidth * type.getSize();
+        size_t rows = std::max((size_t) 1, (size_t) (1 << 20) / rowSize);
+        return (uint32) std::min(rows, (size_t) header.imageLength);
+    } // function getRowsPerStrip
 
+    /** Set the tags of the image at position i in the current directory
+     * of the handle. */
+    void setDirectoryHeader(TIFF *handle, const TiffHeader &header, size_t i)
+    {
+        TIFFSetField(handle, TIFFTAG_SAMPLESPERPIXEL,header.samplesPerPixel);
+        TIFFSetField(handle, TIFFTAG_BITSPERSAMPLE,  header.bitsPerSample);
+        TIFFSetField(handle, TIFFTAG_SAMPLEFORMAT,   header.imageSampleFormat);
+        TIFFSetField(handle, TIFFTAG_IMAGEWIDTH,     header.imageWidth);
+        TIFFSetField(handle, TIFFTAG_IMAGELENGTH,    header.imageLength);
+        TIFFSetField(handle, TIFFTAG_RESOLUTIONUNIT, header.resUnit);
+        TIFFSetField(handle, TIFFTAG_XRESOLUTION,    header.xTiffRes);
+        TIFFSetField(handle, TIFFTAG_YRESOLUTION,    header.yTiffRes);
+        TIFFSetField(handle, TIFFTAG_PHOTOMETRIC,    PHOTOMETRIC_MINISBLACK);
+        TIFFSetField(handle, TIFFTAG_COMPRESSION,    getTiffCompression(compression));
+        TIFFSetField(handle, TIFFTAG_ROWSPERSTRIP,   getRowsPerStrip(header));
+        TIFFSetField(handle, TIFFTAG_PLANARCONFIG,   PLANARCONFIG_CONTIG);
+        TIFFSetField(handle, TIFFTAG_ORIENTATION ,   ORIENTATION_TOPLEFT);
+        TIFFSetField(handle, TIFFTAG_SOFTWARE,       EMCORE_VERSION_STRING);
+
+        //if (dim.n == 1 && isStack == false)
+        if (dim.n == 1)
+        {
+            TIFFSetField(handle, TIFFTAG_SUBFILETYPE, (unsigned int) 0x0);
+            TIFFSetField(handle, TIFFTAG_PAGENUMBER, (uint16) 0, (uint16) 0);
+        }
+        else
+        {
+            TIFFSetField(handle, TIFFTAG_SUBFILETYPE, (unsigned int) 0x2);
+            TIFFSetField(handle, TIFFTAG_PAGENUMBER, (uint16) i, (uint16) dim.n);
+        }
+    } // function setDirectoryHeader
+
+    void writeHeader() override
+    {
         TiffHeader header;
 
         header.imageWidth = (unsigned int) dim.x;
@@ -140,168 +266,394 @@ public:
         header.xTiffRes = 1;
         header.yTiffRes = 1;
 
-        //Write each image in a directory
-        for (size_t i = 0; i < dim.n; ++i )
-        {
+        // Directories are not written here but appended when writing
+        // their images (see writeImageData), so only the headers of the
+        // new images are added
+        while (vHeader.size() < dim.n)
             vHeader.push_back(header);
+    }
+
+    /** Append the directory of the next image, with its data */
+    void appendDirectory(const char *data)
+    {
+        TiffHeader &header = vHeader[written];
+        header.dirIndex = dirCount;
+
+        // The current directory could be an existing one after reading
+        TIFFCreateDirectory(tif);
+        setDirectoryHeader(tif, header, written);
+        writeStrips(header, data);
+
+        if (!TIFFWriteDirectory(tif))
+            THROW_ERROR(std::string("TiffImageFile: Error writing "
+                                    "directory to ") + path);
+        ++written;
+        ++dirCount;
+    } // function appendDirectory
+
+    /** In-memory file used to encode strips with libtiff from other
+     * threads, since the codecs state is kept in each TIFF handle. */
+    struct MemoryFile
+    {
+        std::vector<char> data;
+        size_t pos = 0;
+
+        static tmsize_t read(thandle_t handle, void *buffer, tmsize_t size)
+        {
+            auto mf = static_cast<MemoryFile*>(handle);
+            if (mf->pos >= mf->data.size())
+                return 0;
+            size = std::min((size_t) size, mf->data.size() - mf->pos);
+            memcpy(buffer, mf->data.data() + mf->pos, size);
+            mf->pos += size;
+            return size;
+        }
+
+        static tmsize_t write(thandle_t handle, void *buffer, tmsize_t size)
+        {
+            auto mf = static_cast<MemoryFile*>(handle);
+            if (mf->pos + size > mf->data.size())
+                mf->data.resize(mf->pos + size);
+            memcpy(mf->data.data() + mf->pos, buffer, size);
+            mf->pos += size;
+            return size;
+        }
 
-            TIFFSetDirectory(tif,(tdir_t) i);
-
-            // Image header
-            TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL,header.samplesPerPixel);
-            TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE,  header.bitsPerSample);
-            TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT,   header.imageSampleFormat);
-            TIFFSetField(tif, TIFFTAG_IMAGEWIDTH,     header.imageWidth);
-            TIFFSetField(tif, TIFFTAG_IMAGELENGTH,    header.imageLength);
-            TIFFSetField(tif, TIFFTAG_RESOLUTIONUNIT, header.resUnit);
-            TIFFSetField(tif, TIFFTAG_XRESOLUTION,    header.xTiffRes);
-            TIFFSetField(tif, TIFFTAG_YRESOLUTION,    header.yTiffRes);
-            TIFFSetField(tif, TIFFTAG_PHOTOMETRIC,    PHOTOMETRIC_MINISBLACK);
-            TIFFSetField(tif, TIFFTAG_COMPRESSION,    COMPRESSION_NONE);
-            TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP,   (uint32) header.imageLength);
-            TIFFSetField(tif, TIFFTAG_PLANARCONFIG,   PLANARCONFIG_CONTIG);
-            TIFFSetField(tif, TIFFTAG_ORIENTATION ,   ORIENTATION_TOPLEFT);
-            TIFFSetField(tif, TIFFTAG_SOFTWARE,       EMCORE_VERSION_STRING);
-
-            //if (dim.n == 1 && isStack == false)
-            if (dim.n == 1)
+        static toff_t seek(thandle_t handle, toff_t offset, int whence)
+        {
+            auto mf = static_cast<MemoryFile*>(handle);
+            if (whence == SEEK_CUR)
+                offset += mf->pos;
+            else if (whence == SEEK_END)
+                offset += mf->data.size();
+            mf->pos = offset;
+            return offset;
+        }
+
+        static toff_t size(thandle_t handle)
+        {
+            return static_cast<MemoryFile*>(handle)->data.size();
+        }
+
+        static int close(thandle_t) { return 0; }
+        static int map(thandle_t, void**, toff_t*) { return 0; }
+        static void unmap(thandle_t, void*, toff_t) {}
+    }; // struct MemoryFile
+
+    /** Encode the strips [start, end) of an image with the header tags
+     * through an in-memory TIFF, and store the encoded data of each one
+     * in the strips vector. */
+    void encodeStrips(const TiffHeader &header, uint16 tiffCompression,
+                      size_t rowsPerStrip, const char *data,
+                      size_t start, size_t end,
+                      std::vector<std::vector<char>> &strips)
+    {
+        MemoryFile mf;
+        TIFF * handle = TIFFClientOpen("memory", "wm", &mf,
+                                       MemoryFile::read, MemoryFile::write,
+                                       MemoryFile::seek, MemoryFile::close,
+                                       MemoryFile::size, MemoryFile::map,
+                                       MemoryFile::unmap);
+        if (handle == nullptr)
+            THROW_ERROR("TiffImageFile: Error creating encoder.");
+
+        setDirectoryHeader(handle, header, 0);
+        TIFFSetField(handle, TIFFTAG_COMPRESSION, tiffCompression);
+        TIFFSetField(handle, TIFFTAG_ROWSPERSTRIP, (uint32) rowsPerStrip);
+        size_t rowSize = header.imageWidth * type.getSize();
+
+        for (size_t s = start; s < end; ++s)
+        {
+            size_t y = s * rowsPerStrip;
+            size_t rows = std::min(rowsPerStrip, header.imageLength - y);
+
+            if (TIFFWriteEncodedStrip(handle, s, (void*) (data + y * rowSize),
+                                      rows * rowSize) < 0)
             {
-                TIFFSetField(tif, TIFFTAG_SUBFILETYPE, (unsigned int) 0x0);
-                TIFFSetField(tif, TIFFTAG_PAGENUMBER, (uint16) 0, (uint16) 0);
+                TIFFClose(handle);
+                THROW_ERROR("TiffImageFile: Error encoding image data.");
             }
-            else
+
+            toff_t * offsets, * counts;
+            TIFFGetField(handle, TIFFTAG_STRIPOFFSETS, &offsets);
+            TIFFGetField(handle, TIFFTAG_STRIPBYTECOUNTS, &counts);
+            auto begin = mf.data.begin() + offsets[s];
+            strips[s].assign(begin, begin + counts[s]);
+        }
+        TIFFClose(handle);
+    } // function encodeStrips
+
+    /** Write the strips of the image data in the current directory,
+     * with its compression and rows per strip (that could differ from the
+     * current ones in existing files). Compressed strips are encoded from
+     * several threads and then written as raw strips. */
+    void writeStrips(const TiffHeader &header, const char *data)
+    {
+        uint32 rowsPerStrip;
+        uint16 tiffCompression;
+        TIFFGetFieldDefaulted(tif, TIFFTAG_ROWSPERSTRIP, &rowsPerStrip);
+        TIFFGetFieldDefaulted(tif, TIFFTAG_COMPRESSION, &tiffCompression);
+        rowsPerStrip = std::min(rowsPerStrip, header.imageLength);
+
+        size_t rowSize = header.imageWidth * type.getSize();
+        size_t nStrips = TIFFNumberOfStrips(tif);
+        size_t threads = tiffCompression == COMPRESSION_NONE ?
+                         1 : Thread::getChunks(nStrips);
+
+        if (threads == 1)
+        {
+            for (size_t s = 0; s < nStrips; ++s)
             {
-                TIFFSetField(tif, TIFFTAG_SUBFILETYPE, (unsigned int) 0x2);
-                TIFFSetField(tif, TIFFTAG_PAGENUMBER, (uint16) i, (uint16) dim.n);
+                size_t y = s * rowsPerStrip;
+                size_t rows = std::min<size_t>(rowsPerStrip,
+                                               header.imageLength - y);
+
+                if (TIFFWriteEncodedStrip(tif, s, (void*) (data + y * rowSize),
+                                          rows * rowSize) < 0)
+                    THROW_ERROR(std::string("TiffImageFile: Error writing "
+                                            "image data to ") + path);
             }
+            return;
+        }
 
-            size_t writeBuffer = header.imageWidth * type.getSize();
+        std::vector<std::vector<char>> strips(nStrips);
+        Thread::parallelFor(nStrips, [&](size_t start, size_t end, size_t)
+        {
+            encodeStrips(header, tiffCompression, rowsPerStrip, data,
+                         start, end, strips);
+        }, threads);
+
+        for (size_t s = 0; s < nStrips; ++s)
+            if (TIFFWriteRawStrip(tif, s, strips[s].data(),
+                                  strips[s].size()) < 0)
+                THROW_ERROR(std::string("TiffImageFile: Error writing "
+                                        "image data to ") + path);
+    } // function writeStrips
+
+    /** Return n handles of the file to decode from n threads, since a
+     * TIFF handle can not be used concurrently. The first one is the main
+     * handle and the others are opened for reading (only once) and kept
+     * until the file is closed. */
+    std::vector<TIFF*> getHandles(size_t n)
+    {
+        while (extraTifs.size() + 1 < n)
+        {
+            auto handle = TIFFOpen(path.c_str(), "r");
+            if (handle == nullptr)
+                THROW_SYS_ERROR(std::string("Error opening file ") + path);
+            extraTifs.push_back(handle);
+        }
 
-            char*  tif_buf = nullptr;
-            tif_buf = (char*)_TIFFmalloc(writeBuffer);
+        std::vector<TIFF*> handles = {tif};
+        handles.insert(handles.end(), extraTifs.begin(),
+                       extraTifs.begin() + (n - 1));
+        return handles;
+    } // function getHandles
+
+    /** Return the number of threads to decode the strips (or tiles) of
+     * the current directory. Compressed images (e.g. LZW movies) are
+     * decoded from several threads, while uncompressed ones are just
+     * copied by libtiff from the main handle. Extra handles could not see
+     * the data written through the main one, so they are only used when
+     * reading. */
+    size_t getDecodeThreads(size_t blocks)
+    {
+        uint16 compression = COMPRESSION_NONE;
+        TIFFGetFieldDefaulted(tif, TIFFTAG_COMPRESSION, &compression);
 
-            // We create the image to allocate the space in directory to avoid
-            //   because we don't know how to add the image to directory a posteriori
-            for (size_t y = 0; y < header.imageLength; ++y)
-                TIFFWriteScanline(tif, tif_buf, y, 0);
+        if (compression == COMPRESSION_NONE ||
+            fileMode != File::Mode::READ_ONLY)
+            return 1;
 
-            TIFFWriteDirectory(tif);
-        }
-    }
+        return Thread::getChunks(blocks);
+    } // function getDecodeThreads
 
-    void readImageData(const size_t index, Image &image) override
+    /** Return the number of strips (or tiles) of the first sample plane
+     * in the current directory of the handle. Images with separate planes
+     * store all the blocks of each sample after the previous one, and only
+     * the first sample is read. */
+    static size_t getPlaneBlocks(TIFF *handle)
     {
-        char * data;
-        data = static_cast<char*> (image.getData());
+        size_t blocks = TIFFIsTiled(handle) ? TIFFNumberOfTiles(handle)
+                                            : TIFFNumberOfStrips(handle);
+        uint16 planar = PLANARCONFIG_CONTIG, samples = 1;
+        TIFFGetFieldDefaulted(handle, TIFFTAG_PLANARCONFIG, &planar);
+        TIFFGetFieldDefaulted(handle, TIFFTAG_SAMPLESPERPIXEL, &samples);
+
+        return planar == PLANARCONFIG_SEPARATE ? blocks / samples : blocks;
+    } // function getPlaneBlocks
+
+    /** Decode the image idx into data, splitting its strips (or tiles)
+     * among the given handles, one per thread. The directory of the
+     * image is taken from its header, since thumbnails are skipped. */
+    void readDirectory(const std::vector<TIFF*> &handles, size_t idx,
+                       char * data)
+    {
+        ASSERT_ERROR(idx >= written,
+                     std::string("TiffImageFile: Image has not been written "
+                                 "yet in file ") + path);
 
-        char*  tif_buf = nullptr;
-        size_t x, y;
+        const TiffHeader &header = vHeader[idx];
 
-        // Scanline stuff
-        uint32 rowsperstrip;
-        tsize_t scanline;
+        for (auto handle: handles)
+            if (TIFFCurrentDirectory(handle) != header.dirIndex &&
+                !TIFFSetDirectory(handle, header.dirIndex))
+                THROW_ERROR(std::string("TiffImageFile: Error reading "
+                                        "directory of file ") + path);
 
-        // Dimensions of tiles
-        unsigned int tileWidth, tileLength;
+        TIFF * first = handles[0];
+        size_t width = header.imageWidth;
+        size_t length = header.imageLength;
 
-        size_t idx = index - 1;
-        TIFFSetDirectory(tif,(tdir_t) idx);
+        ASSERT_ERROR(width != dim.x || length != dim.y,
+                     std::string("TiffImageFile: Images of different sizes "
+                                 "in file ") + path);
 
-        TiffHeader header = vHeader[idx];
+        // Only the first sample of each pixel is kept when there are more
+        // (e.g. RGB or associated alpha data)
+        size_t pixelSize = type.getSize();
+        size_t filePixelSize = TIFFScanlineSize(first) / width;
+        size_t rowSize = width * pixelSize;
 
-        // If samplesPerPixel is higher than 3 it means there are extra samples,
-        // as associated alpha data
-        // Greyscale images are usually samplesPerPixel=1
-        // RGB images are usually samplesPerPixel=3 (this is only implemented
-        // for untiled 8-bit tiffs)
-        if (header.samplesPerPixel > 3)
-            header.samplesPerPixel = 1;
+        bool tiled = TIFFIsTiled(first);
+        uint32 blockWidth = header.imageWidth, blockLength = 0;
+        size_t blocksAcross = 1;
 
-        if (TIFFIsTiled(tif))
+        if (tiled)
         {
-            TIFFGetField(tif, TIFFTAG_TILEWIDTH,  &tileWidth);
-            TIFFGetField(tif, TIFFTAG_TILELENGTH, &tileLength);
-            tif_buf = (char*)_TIFFmalloc(TIFFTileSize(tif));
+            TIFFGetField(first, TIFFTAG_TILEWIDTH,  &blockWidth);
+            TIFFGetField(first, TIFFTAG_TILELENGTH, &blockLength);
+            blocksAcross = (width + blockWidth - 1) / blockWidth;
         }
         else
         {
-            TIFFGetFieldDefaulted(tif, TIFFTAG_ROWSPERSTRIP, &rowsperstrip);
-            scanline = TIFFScanlineSize(tif);
-            tif_buf = (char*)_TIFFmalloc(scanline);
-        }
-        if (tif_buf == 0)
-        {
-            TIFFError(TIFFFileName(tif), "No space for strip buffer");
-            THROW_ERROR("TiffImageFile: strip buffer allocation failed.");
+            TIFFGetFieldDefaulted(first, TIFFTAG_ROWSPERSTRIP, &blockLength);
+            blockLength = std::min(blockLength, header.imageLength);
         }
+        size_t blocks = getPlaneBlocks(first);
 
-        /* Start to convert the TIFF image to type T */
+        // Strips with the same row layout as the image are decoded straight
+        // into it, the others (and tiles) through a buffer for each thread
+        bool direct = !tiled && filePixelSize == pixelSize;
+        size_t bufferSize = tiled ? TIFFTileSize(first) : TIFFStripSize(first);
 
-        int mode = header.bitsPerSample + header.imageSampleFormat;
-
-        if (TIFFIsTiled(tif))
-        {
-            THROW_ERROR("TiffImageFile::readData not implemented yet for Tiled files.");
-
-            /*           for (y = 0; y < vHeader[0].imageLength; y += tileLength)
-                           for (x = 0; x < vHeader[0].imageWidth; x += tileWidth)
-                           {
-                               TIFFReadTile(tif, tif_buf, x, y, 0, 0);
-                               if (swap)
-                                   swapPage((char*)tif_buf, TIFFTileSize(tif)*sizeof(unsigned char), datatype);
-
-                               castTiffTile2T((pad*imReaded), tif_buf, x, y,
-                                              header.imageWidth, header.imageLength,
-                                              tileWidth, tileLength,
-                                              header.samplesPerPixel,
-                                              datatype);
-                           }
-           */        }
-        else
+        Thread::parallelFor(blocks, [&](size_t start, size_t end, size_t chunk)
         {
-            size_t readSize = header.imageWidth * type.getSize();
+            TIFF * handle = handles[chunk];
+            std::unique_ptr<char, void(*)(void*)> buffer(
+                    direct ? nullptr : (char*)_TIFFmalloc(bufferSize),
+                    _TIFFfree);
+
+            if (!direct && buffer == nullptr)
+                THROW_ERROR("TiffImageFile: strip buffer allocation failed.");
 
-            for (y = 0; y < header.imageLength; y++)
+            for (size_t b = start; b < end; ++b)
             {
-                TIFFReadScanline(tif, tif_buf, y);
-                memcpy(data + y*readSize, tif_buf, readSize);
+                size_t x0 = (b % blocksAcross) * blockWidth;
+                size_t y0 = (b / blocksAcross) * blockLength;
+                ASSERT_ERROR(y0 >= length,
+                             std::string("TiffImageFile: Invalid layout of "
+                                         "image data in file ") + path);
+                char * blockData = direct ? data + y0 * rowSize : buffer.get();
+
+                auto size = tiled ?
+                    TIFFReadEncodedTile(handle, b, blockData, -1) :
+                    TIFFReadEncodedStrip(handle, b, blockData, -1);
+
+                if (size < 0)
+                    THROW_ERROR(std::string("TiffImageFile: Error decoding "
+                                            "image data from ") + path);
+                if (direct)
+                    continue;
+
+                size_t rows = std::min<size_t>(blockLength, length - y0);
+                size_t cols = std::min<size_t>(blockWidth, width - x0);
+
+                for (size_t y = 0; y < rows; ++y)
+                {
+                    char * src = blockData + y * blockWidth * filePixelSize;
+                    char * dst = data + (y0 + y) * rowSize + x0 * pixelSize;
+
+                    if (filePixelSize == pixelSize)
+                        memcpy(dst, src, cols * pixelSize);
+                    else
+                        for (size_t x = 0; x < cols; ++x)
+                            memcpy(dst + x * pixelSize,
+                                   src + x * filePixelSize, pixelSize);
+                }
             }
-        }
-        _TIFFfree(tif_buf);
-    }
+        }, handles.size());
+    } // function readDirectory
 
-    void writeImageData(const size_t index, const Image &image) override
+    void readImageData(const size_t index, Image &image) override
     {
         size_t idx = index - 1;
-        TiffHeader &header = vHeader[idx];
+        if (idx < written)
+            TIFFSetDirectory(tif, vHeader[idx].dirIndex);
 
-        TIFFSetDirectory(tif,(tdir_t) idx);
+        auto handles = getHandles(getDecodeThreads(getPlaneBlocks(tif)));
+        readDirectory(handles, idx, static_cast<char*>(image.getData()));
+    } // function readImageData
 
-        char*  tif_buf = nullptr;
-        size_t writeBuffer = header.imageWidth * type.getSize();
-        tif_buf = (char*)_TIFFmalloc(writeBuffer);
+    /** Decode the images at the given indexes into consecutive places of
+     * the image, each thread decoding whole images with its own handle. */
+    void readItemsData(const std::vector<size_t> &indexes,
+                       Image &image) override
+    {
+        std::lock_guard<std::mutex> lock(decodeMutex);
+        size_t count = indexes.size();
+        auto data = static_cast<char*>(image.getData());
+        size_t itemSize = dim.getItemSize() * type.getSize();
 
-        if (tif_buf == 0)
+        if (count == 1)
         {
-            TIFFError(TIFFFileName(tif), "No space for strip buffer");
-            THROW_ERROR("TiffImageFile: strip buffer allocation failed.");
+            ArrayDim adim(dim);
+            adim.n = 1;
+            Image item(adim, type, data);
+            readImageData(indexes[0], item);
+            return;
         }
 
-        char * data;
-        data = const_cast<char*>(static_cast<const char*> (image.getData()));
+        if (indexes[0] - 1 < written)
+            TIFFSetDirectory(tif, vHeader[indexes[0] - 1].dirIndex);
+        size_t threads = getDecodeThreads(count);
+        auto handles = getHandles(threads);
 
-        for (size_t y = 0; y < header.imageLength; ++y)
+        Thread::parallelFor(count, [&](size_t start, size_t end, size_t chunk)
         {
-            memcpy(tif_buf, data + y*writeBuffer, writeBuffer);
-            TIFFWriteScanline(tif, tif_buf, y, 0);
-        }
+            for (size_t i = start; i < end; ++i)
+                readDirectory({handles[chunk]}, indexes[i] - 1,
+                              data + i * itemSize);
+        }, threads);
+    } // function readItemsData
 
-        TIFFWriteDirectory(tif);
 
-        TIFFFlushData(tif);
+    void writeImageData(const size_t index, const Image &image) override
+    {
+        size_t idx = index - 1;
+        auto data = static_cast<const char*>(image.getData());
 
-        _TIFFfree(tif_buf);
+        // Images are appended when written in order, the ones skipped are
+        // added empty and existing ones are written in their directory
+        if (idx >= written)
+        {
+            if (idx > written)
+            {
+                std::vector<char> blank(dim.getItemSize() * type.getSize(), 0);
+                while (written < idx)
+                    appendDirectory(blank.data());
+            }
+            appendDirectory(data);
+        }
+        else
+        {
+            TIFFSetDirectory(tif, vHeader[idx].dirIndex);
+            writeStrips(vHeader[idx], data);
 
+            if (!TIFFWriteDirectory(tif))
+                THROW_ERROR(std::string("TiffImageFile: Error writing "
+                                        "directory to ") + path);
+        }
     } // function writeImageData
 
     const IntTypeMap &getTypeMap() const override
@@ -335,8 +687,10 @@ public:
 
     void expand() override
     {
-        /* Expansion of data has to be implemented at the same time with header
-         * as image data has to be included in TIFF Directory when created */
+        /* Image data has to be included in the TIFF directory when it is
+         * created, so new directories are appended when their images are
+         * written (or empty when closing the file) */
+        writeHeader();
     }
 }; // class TiffImageFile
 
@@ -0,0 +1,164 @@
+//
+// Created on 10/18/26.
+//
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <algorithm>
+
+#include "emc/base/error.h"
+#include "emc/base/image_reader.h"
+
+
+using namespace emcore;
+
+
+// ===================== ImageReader Implementation =======================
+
+class ImageReader::Impl
+{
+public:
+    ImageFile &imgFile;
+    size_t first, last;
+    std::vector<Image> buffers;
+
+    // Number of images read by the background thread and consumed
+    // (i.e. released by next()) so far, the current image is at
+    // consumed % buffers.size()
+    size_t readCount = 0;
+    size_t consumed = 0;
+    bool started = false;  // True after the first call to next
+    bool stop = false;
+    std::exception_ptr error;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::thread thread;
+
+    Impl(ImageFile &imgFile, size_t first, size_t last, size_t prefetch):
+        imgFile(imgFile), first(first), last(last),
+        buffers(std::max(prefetch, (size_t) 1))
+    {
+        if (first <= last)
+            thread = std::thread(&Impl::readLoop, this);
+    }
+
+    size_t getSize() const
+    {
+        return first <= last ? last - first + 1 : 0;
+    }
+
+    /** Function of the background thread, it reads each image when
+     * its buffer has been released by the consumer. */
+    void readLoop()
+    {
+        size_t n = getSize();
+
+        for (size_t i = 0; i < n; ++i)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cond.wait(lock, [this, i] {
+                    return stop || i < consumed + buffers.size();
+                });
+                if (stop)
+                    return;
+            }
+
+            std::exception_ptr readError;
+
+            try
+            {
+                imgFile.read(first + i, buffers[i % buffers.size()]);
+            }
+            catch (...)
+            {
+                readError = std::current_exception();
+            }
+
+            {
+                // The failed image is also counted, but nothing else
+                // will be read after it
+                std::lock_guard<std::mutex> lock(mutex);
+                error = readError;
+                ++readCount;
+            }
+            cond.notify_all();
+
+            if (readError)
+                return;
+        }
+    } // function readLoop
+
+    ~Impl()
+    {
+        if (thread.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stop = true;
+            }
+            cond.notify_all();
+            thread.join();
+        }
+    }
+}; // class ImageReader::Impl
+
+ImageReader::ImageReader(ImageFile &imgFile, size_t prefetch):
+    ImageReader(imgFile, 1, imgFile.getDim().n, prefetch)
+{
+} // Ctor ImageReader
+
+ImageReader::ImageReader(ImageFile &imgFile, size_t first, size_t last,
+                         size_t prefetch)
+{
+    ASSERT_ERROR(first < 1 || last > imgFile.getDim().n,
+                 "Invalid range of indexes");
+    impl = new Impl(imgFile, first, last, prefetch);
+} // Ctor ImageReader
+
+bool ImageReader::next()
+{
+    std::unique_lock<std::mutex> lock(impl->mutex);
+
+    // Release the buffer of the current image
+    if (impl->started)
+        ++impl->consumed;
+    impl->started = true;
+    impl->cond.notify_all();
+
+    if (impl->consumed >= impl->getSize())
+        return false;
+
+    impl->cond.wait(lock, [this] {
+        return impl->readCount > impl->consumed;
+    });
+
+    // Images read before the error are still returned
+    if (impl->error && impl->readCount == impl->consumed + 1)
+    {
+        impl->consumed = impl->getSize();  // No more images after the error
+        std::rethrow_exception(impl->error);
+    }
+
+    return true;
+} // function ImageReader.next
+
+size_t ImageReader::getIndex() const
+{
+    return impl->first + impl->consumed;
+} // function ImageReader.getIndex
+
+Image& ImageReader::getImage()
+{
+    ASSERT_ERROR(!impl->started || impl->consumed >= impl->getSize(),
+                 "There is no current image, next() should be called first.");
+    return impl->buffers[impl->consumed % impl->buffers.size()];
+} // function ImageReader.getImage
+
+ImageReader::~ImageReader()
+{
+    delete impl;
+} // Dtor ImageReader
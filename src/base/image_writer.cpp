@@ -0,0 +1,178 @@
+//
+// Created on 10/18/26.
+//
+
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <algorithm>
+
+#include "emc/base/error.h"
+#include "emc/base/image_writer.h"
+
+
+using namespace emcore;
+
+
+// ===================== ImageWriter Implementation =======================
+
+class ImageWriter::Impl
+{
+public:
+    ImageFile &imgFile;
+    size_t queueSize;
+
+    // Images waiting to be written, sorted by index
+    std::map<size_t, Image> queue;
+    size_t writing = 0;  // Number of images being written
+    bool stop = false;
+    std::exception_ptr error;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::thread thread;
+
+    Impl(ImageFile &imgFile, size_t queueSize):
+        imgFile(imgFile), queueSize(std::max(queueSize, (size_t) 1)),
+        thread(&Impl::writeLoop, this)
+    {
+    }
+
+    /** Function of the background thread, it takes the images with
+     * consecutive indexes from the beginning of the queue and writes
+     * them together. */
+    void writeLoop()
+    {
+        std::vector<Image> images;
+        std::vector<const Image*> ptrs;
+
+        while (true)
+        {
+            size_t first;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cond.wait(lock, [this] { return stop || !queue.empty(); });
+
+                if (queue.empty())
+                    return;
+
+                first = queue.begin()->first;
+                images.clear();
+                for (auto it = queue.begin();
+                     it != queue.end() && it->first == first + images.size();
+                     it = queue.erase(it))
+                    images.push_back(std::move(it->second));
+                writing = images.size();
+            }
+            // Producers can queue more images while these are written
+            cond.notify_all();
+
+            std::exception_ptr writeError;
+            ptrs.clear();
+            for (auto& image: images)
+                ptrs.push_back(&image);
+
+            try
+            {
+                imgFile.writeImages(first, ptrs);
+            }
+            catch (...)
+            {
+                writeError = std::current_exception();
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                writing = 0;
+                // Discard pending images after an error
+                if (writeError)
+                {
+                    error = writeError;
+                    queue.clear();
+                }
+            }
+            cond.notify_all();
+        }
+    } // function writeLoop
+
+    /** Re-throw the error of the background thread, if any, only once.
+     * The mutex should be locked. */
+    void checkError()
+    {
+        if (error)
+        {
+            auto e = error;
+            error = nullptr;
+            std::rethrow_exception(e);
+        }
+    } // function checkError
+
+    void push(size_t index, Image &&image)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        ASSERT_ERROR(stop, "The writer has already been closed.");
+        cond.wait(lock, [this] {
+            return error || queue.size() + writing < queueSize;
+        });
+        checkError();
+        queue[index] = std::move(image);
+        cond.notify_all();
+    } // function push
+
+    /** Wait until nothing is queued or being written */
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [this] { return queue.empty() && writing == 0; });
+        checkError();
+    } // function wait
+
+    /** Stop the thread after writing the queued images */
+    void join()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        cond.notify_all();
+
+        if (thread.joinable())
+            thread.join();
+    } // function join
+}; // class ImageWriter::Impl
+
+ImageWriter::ImageWriter(ImageFile &imgFile, size_t queueSize)
+{
+    impl = new Impl(imgFile, queueSize);
+} // Ctor ImageWriter
+
+void ImageWriter::write(size_t index, Image &&image)
+{
+    ASSERT_ERROR(index == ImageLocation::ALL, "Invalid index");
+    impl->push(index, std::move(image));
+} // function ImageWriter.write
+
+void ImageWriter::write(size_t index, const Image &image)
+{
+    write(index, Image(image));
+} // function ImageWriter.write
+
+void ImageWriter::flush()
+{
+    impl->wait();
+} // function ImageWriter.flush
+
+void ImageWriter::close()
+{
+    impl->join();
+    std::lock_guard<std::mutex> lock(impl->mutex);
+    impl->checkError();
+} // function ImageWriter.close
+
+ImageWriter::~ImageWriter()
+{
+    impl->join();
+    delete impl;
+} // Dtor ImageWriter
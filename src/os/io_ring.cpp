@@ -0,0 +1,308 @@
+//
+// Created on 10/18/26.
+//
+
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <algorithm>
+
+#include "emc/base/error.h"
+#include "emc/os/io_ring.h"
+
+#ifdef EM_CORE_IO_URING
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+
+using namespace emcore;
+
+
+// ===================== IORing::Impl Implementation =======================
+
+class IORing::Impl
+{
+public:
+    size_t depth = 0;
+
+#ifdef EM_CORE_IO_URING
+    int fd = -1;
+
+    // Rings shared with the kernel and the array of submission entries
+    uint8_t * sqRing = nullptr;
+    uint8_t * cqRing = nullptr;
+    size_t sqRingSize = 0, cqRingSize = 0;
+    struct io_uring_sqe * sqes = nullptr;
+    size_t sqesSize = 0;
+
+    unsigned * sqHead = nullptr, * sqTail = nullptr, * sqMask = nullptr;
+    unsigned * sqArray = nullptr;
+    unsigned * cqHead = nullptr, * cqTail = nullptr, * cqMask = nullptr;
+    struct io_uring_cqe * cqes = nullptr;
+
+    /** Map one of the regions of the ring given by its offset */
+    void * mapRegion(size_t size, off_t offset)
+    {
+        auto ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd, offset);
+
+        if (ptr == MAP_FAILED)
+        {
+            int err = errno;
+            release();
+            errno = err;
+            THROW_SYS_ERROR("Could not 'mmap' the io_uring queues.");
+        }
+        return ptr;
+    } // function mapRegion
+
+    void setup(unsigned entries)
+    {
+        struct io_uring_params params;
+        memset(&params, 0, sizeof(params));
+
+        fd = (int) syscall(__NR_io_uring_setup, entries, &params);
+
+        if (fd < 0)
+            THROW_SYS_ERROR("Could not create the io_uring instance.");
+
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes +
+                     params.cq_entries * sizeof(struct io_uring_cqe);
+        // Newer kernels map both rings with a single call
+        bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+
+        if (single)
+            sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+
+        sqRing = static_cast<uint8_t *>(mapRegion(sqRingSize,
+                                                  IORING_OFF_SQ_RING));
+        cqRing = single ? sqRing : static_cast<uint8_t *>(
+                mapRegion(cqRingSize, IORING_OFF_CQ_RING));
+        sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+        sqes = static_cast<struct io_uring_sqe *>(mapRegion(sqesSize,
+                                                            IORING_OFF_SQES));
+
+        auto sqPtr = [this](unsigned off)
+        {
+            return reinterpret_cast<unsigned *>(sqRing + off);
+        };
+        auto cqPtr = [this](unsigned off)
+        {
+            return reinterpret_cast<unsigned *>(cqRing + off);
+        };
+
+        sqHead = sqPtr(params.sq_off.head);
+        sqTail = sqPtr(params.sq_off.tail);
+        sqMask = sqPtr(params.sq_off.ring_mask);
+        sqArray = sqPtr(params.sq_off.array);
+        cqHead = cqPtr(params.cq_off.head);
+        cqTail = cqPtr(params.cq_off.tail);
+        cqMask = cqPtr(params.cq_off.ring_mask);
+        cqes = reinterpret_cast<struct io_uring_cqe *>(cqRing +
+                                                       params.cq_off.cqes);
+        depth = params.sq_entries;
+    } // function setup
+
+    void release()
+    {
+        if (sqes != nullptr)
+            munmap(sqes, sqesSize);
+        if (cqRing != nullptr && cqRing != sqRing)
+            munmap(cqRing, cqRingSize);
+        if (sqRing != nullptr)
+            munmap(sqRing, sqRingSize);
+        if (fd >= 0)
+            close(fd);
+
+        sqes = nullptr;
+        sqRing = cqRing = nullptr;
+        fd = -1;
+    } // function release
+
+    /** Submit the queued entries and wait for at least wait completions.
+     * Return the number of entries consumed by the kernel. */
+    unsigned enter(unsigned toSubmit, unsigned wait)
+    {
+        while (true)
+        {
+            int ret = (int) syscall(__NR_io_uring_enter, fd, toSubmit, wait,
+                                    wait > 0 ? IORING_ENTER_GETEVENTS : 0,
+                                    nullptr, 0);
+            if (ret >= 0)
+                return (unsigned) ret;
+
+            if (errno != EINTR)
+                THROW_SYS_ERROR("Could not submit reads to io_uring.");
+        }
+    } // function enter
+#endif
+}; // class IORing::Impl
+
+
+// ===================== IORing Implementation =======================
+
+bool IORing::isAvailable()
+{
+#ifdef EM_CORE_IO_URING
+    // Check only once if the kernel allows to create a ring and supports
+    // the read operation (added in 5.6, as the probe itself, so a failed
+    // probe means that reads are not supported)
+    static const bool available = []()
+    {
+        struct io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        int fd = (int) syscall(__NR_io_uring_setup, 1, &params);
+
+        if (fd < 0)
+            return false;
+
+        const unsigned nops = 256;
+        std::vector<uint8_t> buffer(sizeof(struct io_uring_probe) +
+                                    nops * sizeof(struct io_uring_probe_op));
+        auto probe = reinterpret_cast<struct io_uring_probe *>(buffer.data());
+
+        bool supported = syscall(__NR_io_uring_register, fd,
+                                 IORING_REGISTER_PROBE, probe, nops) == 0 &&
+                         probe->ops_len > IORING_OP_READ &&
+                         (probe->ops[IORING_OP_READ].flags &
+                          IO_URING_OP_SUPPORTED) != 0;
+        close(fd);
+        return supported;
+    }();
+
+    return available;
+#else
+    return false;
+#endif
+} // function IORing::isAvailable
+
+IORing::IORing(size_t depth)
+{
+    ASSERT_ERROR(!isAvailable(), "io_uring is not available in this system.");
+    ASSERT_ERROR(depth == 0, "The depth of the ring should be greater than 0.");
+
+    impl = new Impl();
+#ifdef EM_CORE_IO_URING
+    try
+    {
+        impl->setup((unsigned) std::min(depth, (size_t) 4096));
+    }
+    catch (...)
+    {
+        delete impl;
+        throw;
+    }
+#endif
+} // IORing ctor
+
+IORing::~IORing()
+{
+#ifdef EM_CORE_IO_URING
+    impl->release();
+#endif
+    delete impl;
+} // IORing dtor
+
+size_t IORing::getDepth() const
+{
+    return impl->depth;
+} // function IORing.getDepth
+
+void IORing::read(const std::vector<Request> &requests)
+{
+#ifdef EM_CORE_IO_URING
+    size_t n = requests.size();
+
+    if (n == 0)
+        return;
+
+    // Remaining part of each request, reads can complete partially and
+    // very big ones are split (the length of each entry is 32 bits)
+    const size_t maxRead = 1 << 30;
+    std::vector<Request> pending(requests);
+    std::vector<size_t> toSubmit(n);
+    for (size_t i = 0; i < n; ++i)
+        toSubmit[i] = n - 1 - i;  // Used as a stack, so submitted in order
+
+    size_t done = 0;
+    unsigned inFlight = 0, queued = 0;
+    int error = 0;
+    const char * errorMsg = nullptr;
+
+    while (done < n && (error == 0 || inFlight > 0))
+    {
+        // Fill the submission queue (unless there was some error)
+        unsigned tail = *impl->sqTail;
+
+        while (error == 0 && !toSubmit.empty() &&
+               inFlight < impl->depth)
+        {
+            size_t i = toSubmit.back();
+            toSubmit.pop_back();
+            auto &r = pending[i];
+            unsigned slot = tail & *impl->sqMask;
+            auto sqe = &impl->sqes[slot];
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = r.fd;
+            sqe->addr = (uint64_t) r.data;
+            sqe->len = (uint32_t) std::min(r.size, maxRead);
+            sqe->off = r.offset;
+            sqe->user_data = i;
+            impl->sqArray[slot] = slot;
+            ++tail;
+            ++inFlight;
+            ++queued;
+        }
+        // Make the new entries visible to the kernel
+        __atomic_store_n(impl->sqTail, tail, __ATOMIC_RELEASE);
+
+        queued -= impl->enter(queued, 1);
+
+        // Process all the completed reads
+        unsigned head = *impl->cqHead;
+        unsigned cqTail = __atomic_load_n(impl->cqTail, __ATOMIC_ACQUIRE);
+
+        for (; head != cqTail; ++head)
+        {
+            auto cqe = &impl->cqes[head & *impl->cqMask];
+            auto &r = pending[cqe->user_data];
+            int res = cqe->res;
+            --inFlight;
+
+            if (res < 0 || (res == 0 && r.size > 0))
+            {
+                if (error == 0)
+                {
+                    error = res < 0 ? -res : EIO;
+                    errorMsg = res < 0 ? "Could not read data with io_uring."
+                                       : "Unexpected end of file reading "
+                                         "data with io_uring.";
+                }
+            }
+            else if ((size_t) res < r.size)
+            {
+                r.data = static_cast<uint8_t *>(r.data) + res;
+                r.size -= res;
+                r.offset += res;
+                toSubmit.push_back(cqe->user_data);
+            }
+            else
+                ++done;
+        }
+        __atomic_store_n(impl->cqHead, head, __ATOMIC_RELEASE);
+    }
+
+    if (error != 0)
+    {
+        errno = error;
+        THROW_SYS_ERROR(errorMsg);
+    }
+#else
+    THROW_ERROR("io_uring is not available in this system.");
+#endif
+} // function IORing.read
@@ -0,0 +1,197 @@
+//
+// Created on 10/18/26.
+//
+
+#include <thread>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <algorithm>
+
+#include "emc/os/thread.h"
+
+
+using namespace emcore;
+
+
+// ===================== Thread methods Implementation =======================
+
+// Atomic since it can be changed while other threads query it
+static std::atomic<size_t> defaultThreads(0);
+
+size_t Thread::getDefaultThreads()
+{
+    size_t threads = defaultThreads.load();
+    if (threads > 0)
+        return threads;
+
+    // hardware_concurrency can return 0 if the value is not computable
+    return std::max(std::thread::hardware_concurrency(), 1u);
+} // function Thread::getDefaultThreads
+
+void Thread::setDefaultThreads(size_t threads)
+{
+    defaultThreads.store(threads);
+} // function Thread::setDefaultThreads
+
+size_t Thread::getChunks(size_t n, size_t threads, size_t minChunk)
+{
+    if (n == 0)
+        return 0;
+
+    if (threads == 0)
+        threads = getDefaultThreads();
+
+    minChunk = std::max(minChunk, (size_t) 1);
+    size_t maxChunks = (n + minChunk - 1) / minChunk;
+
+    return std::min(threads, maxChunks);
+} // function Thread::getChunks
+
+/** Range split in chunks by a parallelFor call. Chunks are claimed by the
+ * calling thread and the pool workers until all of them are taken. */
+class ParallelJob
+{
+public:
+    const Thread::RangeFunc &func;
+    size_t n, chunks;
+    std::atomic<size_t> next;
+    std::vector<std::exception_ptr> errors;
+
+    ParallelJob(const Thread::RangeFunc &func, size_t n, size_t chunks):
+        func(func), n(n), chunks(chunks), next(0), errors(chunks) {}
+
+    /** Run chunks until there are no more to claim */
+    void run()
+    {
+        for (size_t chunk = next++; chunk < chunks; chunk = next++)
+        {
+            try
+            {
+                func(chunk * n / chunks, (chunk + 1) * n / chunks, chunk);
+            }
+            catch (...)
+            {
+                errors[chunk] = std::current_exception();
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (++done == chunks)
+                finished.notify_all();
+        }
+    } // function run
+
+    /** Wait until all chunks have been run, also the ones taken by the
+     * workers. */
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [this] { return done == chunks; });
+    } // function wait
+
+private:
+    std::mutex mutex;
+    std::condition_variable finished;
+    size_t done = 0;
+}; // class ParallelJob
+
+
+/** Worker threads kept for the whole process and shared by all
+ * parallelFor calls, so no thread is started for each call. New workers
+ * are added when a call needs more than the current ones. Since the
+ * calling thread also runs the chunks of its job, nested calls from a
+ * worker do not wait for workers that may be busy. */
+class ThreadPool
+{
+public:
+    static ThreadPool& getInstance()
+    {
+        static ThreadPool pool;
+        return pool;
+    } // function getInstance
+
+    void submit(const std::shared_ptr<ParallelJob> &job, size_t workers)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        while (threads.size() < workers)
+            threads.emplace_back(&ThreadPool::work, this);
+
+        jobs.push_back(job);
+        cv.notify_all();
+    } // function submit
+
+    void remove(const std::shared_ptr<ParallelJob> &job)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = std::find(jobs.begin(), jobs.end(), job);
+        if (it != jobs.end())
+            jobs.erase(it);
+    } // function remove
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+            cv.notify_all();
+        }
+        for (auto &thread: threads)
+            thread.join();
+    } // ThreadPool dtor
+
+private:
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::shared_ptr<ParallelJob>> jobs;
+    std::vector<std::thread> threads;
+    bool stop = false;
+
+    void work()
+    {
+        while (true)
+        {
+            std::shared_ptr<ParallelJob> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [this] { return stop || !jobs.empty(); });
+                if (stop)
+                    return;
+                job = jobs.front();
+            }
+            job->run();
+            remove(job);
+        }
+    } // function work
+}; // class ThreadPool
+
+
+void Thread::parallelFor(size_t n, const RangeFunc &func,
+                         size_t threads, size_t minChunk)
+{
+    size_t chunks = getChunks(n, threads, minChunk);
+
+    if (chunks == 0)
+        return;
+
+    if (chunks == 1)
+    {
+        func(0, n, 0);
+        return;
+    }
+
+    auto job = std::make_shared<ParallelJob>(func, n, chunks);
+    auto &pool = ThreadPool::getInstance();
+    pool.submit(job, chunks - 1);
+    job->run();
+    pool.remove(job);
+    job->wait();
+
+    for (auto &error: job->errors)
+        if (error)
+            std::rethrow_exception(error);
+} // function Thread::parallelFor
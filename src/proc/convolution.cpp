@@ -0,0 +1,275 @@
+//
+// Created on 10/18/26.
+//
+
+#include <cmath>
+#include <complex>
+#include <algorithm>
+
+#include "emc/base/error.h"
+#include "emc/os/thread.h"
+#include "emc/proc/convolution.h"
+
+
+using namespace emcore;
+
+
+// ===================== Convolver Implementation =======================
+
+/** Return the smallest size not less than n with only 2, 3 and 5 as
+ * prime factors, for which FFTW is efficient. */
+static size_t _goodFftSize(size_t n)
+{
+    for (;; ++n)
+    {
+        size_t m = n;
+        for (size_t p: {2, 3, 5})
+            while (m % p == 0)
+                m /= p;
+        if (m == 1)
+            return n;
+    }
+} // function _goodFftSize
+
+/** Return the FFT size along one axis of n elements and a kernel of k
+ * elements, minimizing the cost per output element of overlap-save */
+static size_t _tileSize(size_t n, size_t k, size_t maxSize)
+{
+    size_t minSize = _goodFftSize(std::max(2 * k, (size_t) 32));
+    size_t maxT = std::min(_goodFftSize(n + k - 1), maxSize);
+
+    if (minSize >= maxT)
+        return std::max(maxT, _goodFftSize(k));
+
+    size_t best = minSize;
+    double bestCost = -1;
+
+    for (size_t t = minSize; t <= maxT; t = _goodFftSize(t + 1))
+    {
+        // Number of output blocks times the cost of a tile
+        size_t blocks = (n + t - k) / (t - k + 1);
+        double cost = blocks * t * log2((double) t);
+        if (bestCost < 0 || cost < bestCost)
+        {
+            best = t;
+            bestCost = cost;
+        }
+    }
+
+    return best;
+} // function _tileSize
+
+/** Approximate number of operations per output pixel of the FFT methods
+ * with tiles of tileDim, used to select the method. */
+static double _fftCost(const ArrayDim &dim, const ArrayDim &tileDim,
+                       size_t kx, size_t ky)
+{
+    double t = tileDim.x * tileDim.y;
+    double blocks = double((dim.x + tileDim.x - kx) / (tileDim.x - kx + 1)) *
+                    double((dim.y + tileDim.y - ky) / (tileDim.y - ky + 1));
+    // Forward and backward real transforms, and the complex product
+    return blocks * (5 * t * log2(t) + 4 * t) / (dim.x * dim.y);
+} // function _fftCost
+
+Convolver::Convolver(Method method): method(method) {}
+
+void Convolver::setKernel(const Image &kernel, bool correlate)
+{
+    auto dim = kernel.getDim();
+    ASSERT_ERROR(dim.z > 1 || dim.n > 1, "Only 2D kernels are supported.");
+
+    Image localKernel;
+    localKernel.copy(kernel, typeFloat);
+    auto data = static_cast<const float *>(localKernel.getData());
+
+    kx = dim.x;
+    ky = dim.y;
+    weights.resize(kx * ky);
+
+    // Store the kernel in correlation form, flipping it for convolution
+    if (correlate)
+    {
+        std::copy(data, data + kx * ky, weights.begin());
+        ox = kx / 2;
+        oy = ky / 2;
+    }
+    else
+    {
+        for (size_t j = 0; j < ky; ++j)
+            for (size_t i = 0; i < kx; ++i)
+                weights[j * kx + i] = data[(ky - 1 - j) * kx + (kx - 1 - i)];
+        ox = kx - 1 - kx / 2;
+        oy = ky - 1 - ky / 2;
+    }
+
+    kernelTileDim = ArrayDim();  // Invalidate the kernel FT
+} // function Convolver.setKernel
+
+void Convolver::setMaxFftSize(size_t size)
+{
+    maxFftSize = size;
+} // function Convolver.setMaxFftSize
+
+ArrayDim Convolver::getTileDim(const ArrayDim &inputDim, Method method) const
+{
+    if (method == FULL_FFT)
+        return ArrayDim(_goodFftSize(inputDim.x + kx - 1),
+                        _goodFftSize(inputDim.y + ky - 1));
+
+    return ArrayDim(_tileSize(inputDim.x, kx, maxFftSize),
+                    _tileSize(inputDim.y, ky, maxFftSize));
+} // function Convolver.getTileDim
+
+Convolver::Method Convolver::getMethod(const ArrayDim &inputDim) const
+{
+    if (method != AUTO)
+        return method;
+
+    // Multiplication and addition for each kernel element
+    double directCost = 2.0 * kx * ky;
+    auto fullDim = getTileDim(inputDim, FULL_FFT);
+    auto tileDim = getTileDim(inputDim, TILED_FFT);
+    double tiledCost = _fftCost(inputDim, tileDim, kx, ky);
+    Method best = TILED_FFT;
+
+    if (fullDim.x <= maxFftSize && fullDim.y <= maxFftSize &&
+        _fftCost(inputDim, fullDim, kx, ky) <= tiledCost)
+    {
+        best = FULL_FFT;
+        tiledCost = _fftCost(inputDim, fullDim, kx, ky);
+    }
+
+    return directCost <= tiledCost ? DIRECT : best;
+} // function Convolver.getMethod
+
+void Convolver::apply(const Image &input, Image &output)
+{
+    ASSERT_ERROR(weights.empty(), "Kernel should be set before applying it.");
+
+    auto dim = input.getDim();
+    ASSERT_ERROR(dim.z > 1 || dim.n > 1, "Only 2D images are supported.");
+
+    Image localInput;
+    const Image *inputPtr = &input;
+    if (input.getType() != typeFloat)
+    {
+        localInput.copy(input, typeFloat);
+        inputPtr = &localInput;
+    }
+
+    output.resize(dim, typeFloat);
+    auto in = static_cast<const float *>(inputPtr->getData());
+    auto out = static_cast<float *>(output.getData());
+    auto m = getMethod(dim);
+
+    if (m == DIRECT)
+        applyDirect(in, dim, out);
+    else
+        applyTiled(in, dim, out, getTileDim(dim, m));
+} // function Convolver.apply
+
+void Convolver::applyDirect(const float *in, const ArrayDim &dim, float *out)
+{
+    long nx = dim.x, ny = dim.y;
+
+    Thread::parallelFor(dim.y, [&](size_t yStart, size_t yEnd, size_t)
+    {
+        for (long y = yStart; y < (long) yEnd; ++y)
+            for (long x = 0; x < nx; ++x)
+            {
+                double sum = 0;
+                // Range of kernel elements that fall inside the input
+                long i0 = std::max(0L, ox - x);
+                long i1 = std::min((long) kx, nx - x + ox);
+
+                for (long j = 0; j < (long) ky; ++j)
+                {
+                    long yy = y + j - oy;
+                    if (yy < 0 || yy >= ny)
+                        continue;
+                    auto inRow = in + yy * nx + x - ox;
+                    auto wRow = weights.data() + j * kx;
+                    for (long i = i0; i < i1; ++i)
+                        sum += inRow[i] * wRow[i];
+                }
+                out[y * nx + x] = (float) sum;
+            }
+    });
+} // function Convolver.applyDirect
+
+void Convolver::applyTiled(const float *in, const ArrayDim &dim, float *out,
+                           const ArrayDim &tileDim)
+{
+    long tx = tileDim.x, ty = tileDim.y;
+    long nx = dim.x, ny = dim.y;
+    // Size of the output blocks computed from each tile
+    long bx = tx - kx + 1, by = ty - ky + 1;
+    size_t nbx = (nx + bx - 1) / bx, nby = (ny + by - 1) / by;
+    size_t nTiles = nbx * nby;
+    size_t chunks = Thread::getChunks(nTiles);
+
+    while (transformers.size() < chunks)
+        transformers.emplace_back(new FourierTransformer());
+    tiles.resize(chunks);
+    fTiles.resize(chunks);
+
+    // Compute the FT of the kernel, wrapped around the tile origin,
+    // only if the tile dimensions changed
+    if (kernelTileDim != tileDim)
+    {
+        Image kImg(tileDim, typeFloat);
+        auto kData = static_cast<float *>(kImg.getData());
+        std::fill(kData, kData + tx * ty, 0.f);
+        for (long j = 0; j < (long) ky; ++j)
+            for (long i = 0; i < (long) kx; ++i)
+                kData[((oy - j + ty) % ty) * tx + (ox - i + tx) % tx] =
+                        weights[j * kx + i];
+        transformers[0]->forward(kImg, kernelFT);
+        kernelTileDim = tileDim;
+    }
+
+    auto kFT = static_cast<const cfloat *>(kernelFT.getData());
+    size_t fSize = kernelFT.getDim().getSize();
+
+    Thread::parallelFor(nTiles, [&](size_t start, size_t end, size_t c)
+    {
+        auto& tile = tiles[c];
+        auto& fTile = fTiles[c];
+        tile.resize(tileDim, typeFloat);
+        auto tData = static_cast<float *>(tile.getData());
+
+        for (size_t t = start; t < end; ++t)
+        {
+            long x0 = (t % nbx) * bx, y0 = (t / nbx) * by;
+
+            // Read the tile from the input, zero outside of it
+            for (long v = 0; v < ty; ++v)
+            {
+                auto tRow = tData + v * tx;
+                long yy = y0 + v - oy;
+                std::fill(tRow, tRow + tx, 0.f);
+                if (yy < 0 || yy >= ny)
+                    continue;
+                long u0 = std::max(0L, ox - x0);
+                long u1 = std::min(tx, nx - x0 + ox);
+                if (u1 > u0)
+                    std::copy(in + yy * nx + x0 + u0 - ox,
+                              in + yy * nx + x0 + u1 - ox, tRow + u0);
+            }
+
+            transformers[c]->forward(tile, fTile);
+            auto fData = static_cast<cfloat *>(fTile.getData());
+            for (size_t i = 0; i < fSize; ++i)
+                fData[i] *= kFT[i];
+            transformers[c]->backward(fTile, tile);
+
+            // Copy the valid part of the circular convolution
+            long w = std::min(bx, nx - x0), h = std::min(by, ny - y0);
+            for (long y = 0; y < h; ++y)
+            {
+                auto tRow = tData + (y + oy) * tx + ox;
+                std::copy(tRow, tRow + w, out + (y0 + y) * nx + x0);
+            }
+        }
+    }, chunks);
+} // function Convolver.applyTiled
@@ -0,0 +1,255 @@
+//
+// Created on 10/18/26.
+//
+
+#include <cmath>
+#include <complex>
+#include <algorithm>
+#include <cstring>
+
+#include "emc/base/error.h"
+#include "emc/proc/correlation.h"
+
+
+using namespace emcore;
+
+
+std::ostream& emcore::operator<< (std::ostream &ostrm, const CorrPeak &p)
+{
+    ostrm << "shift: (" << p.x << ", " << p.y << ", " << p.z << ") "
+          << "value: " << p.value;
+    return ostrm;
+} // function operator<< CorrPeak
+
+
+// ===================== Correlator Implementation =======================
+
+/** Return the input image if it is float, otherwise convert it into
+ * the working image and return it. */
+static const Image& _toFloat(const Image &img, Image &work)
+{
+    if (img.getType() == typeFloat)
+        return img;
+
+    work.copy(img, typeFloat);
+    return work;
+} // function _toFloat
+
+/** Return the norm of the image values after removing the mean */
+static double _centeredNorm(const Image &img)
+{
+    auto data = static_cast<const float *>(img.getData());
+    auto n = img.getDim().getSize();
+    double sum = 0, sum2 = 0;
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        double v = data[i];
+        sum += v;
+        sum2 += v * v;
+    }
+
+    return sqrt(std::max(sum2 - sum * sum / n, 0.0));
+} // function _centeredNorm
+
+Correlator::Correlator(Mode mode): mode(mode) {}
+
+Correlator::Mode Correlator::getMode() const
+{
+    return mode;
+} // function Correlator.getMode
+
+void Correlator::setReference(const Image &ref)
+{
+    ASSERT_ERROR(ref.getDim().n > 1,
+                 "Reference should be a single image or volume.");
+
+    auto& input = _toFloat(ref, rImg);
+    ft.forward(input, refFT);
+
+    auto data = static_cast<cfloat *>(refFT.getData());
+    auto n = refFT.getDim().getSize();
+
+    for (size_t i = 0; i < n; ++i)
+        data[i] = std::conj(data[i]);
+
+    if (mode == NORMALIZED)
+    {
+        data[0] = 0;  // Remove the mean
+        refNorm = _centeredNorm(input);
+    }
+} // function Correlator.setReference
+
+void Correlator::correlateItem(const Image &input)
+{
+    ft.forward(input, fImg);
+
+    auto data = static_cast<cfloat *>(fImg.getData());
+    auto ref = static_cast<const cfloat *>(refFT.getData());
+    auto n = fImg.getDim().getSize();
+
+    if (mode == PHASE)
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            auto v = data[i] * ref[i];
+            auto a = std::abs(v);
+            data[i] = a > 1e-20f ? v / a : cfloat(0);
+        }
+    }
+    else
+    {
+        float scale = 1;
+
+        if (mode == NORMALIZED)
+        {
+            double norm = refNorm * _centeredNorm(input);
+            scale = norm > 0 ? float(1 / norm) : 0.f;
+        }
+
+        for (size_t i = 0; i < n; ++i)
+            data[i] *= ref[i] * scale;
+    }
+
+    ccWork.resize(input.getDim(), typeFloat);
+    ft.backward(fImg, ccWork);
+} // function Correlator.correlateItem
+
+void Correlator::correlate(const Image &img, Image &ccMap)
+{
+    ASSERT_ERROR(refFT.getDim().getSize() == 0,
+                 "Reference should be set before correlating images.");
+
+    auto& input = _toFloat(img, rImg);
+    auto rDim = input.getDim();
+    size_t count = rDim.n;
+    rDim.n = 1;
+
+    ASSERT_ERROR(FourierTransformer::getDimFT(rDim) != refFT.getDim(),
+                 "Image and reference should have the same dimensions.");
+
+    if (count == 1)
+    {
+        correlateItem(input);
+        // Move the zero shift to the center of the map
+        ft.shift(ccWork, ccMap);
+        return;
+    }
+
+    ArrayDim mapsDim(rDim);
+    mapsDim.n = count;
+    ccMap.resize(mapsDim, typeFloat);
+
+    size_t itemSize = rDim.getSize();
+    auto inData = static_cast<float *>(const_cast<void *>(input.getData()));
+    auto outData = static_cast<float *>(ccMap.getData());
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        Image item(rDim, typeFloat, inData + i * itemSize);
+        correlateItem(item);
+        ft.shift(ccWork);
+        memcpy(outData + i * itemSize, ccWork.getData(),
+               itemSize * sizeof(float));
+    }
+} // function Correlator.correlate
+
+void Correlator::correlate(const Image &img1, const Image &img2,
+                           Image &ccMap)
+{
+    setReference(img1);
+    correlate(img2, ccMap);
+} // function Correlator.correlate
+
+CorrPeak Correlator::findPeak(const Image &img)
+{
+    ASSERT_ERROR(img.getDim().n > 1,
+                 "Use findPeak with a vector of peaks for stacks.");
+    Image ccMap;
+    correlate(img, ccMap);
+    return getPeak(ccMap);
+} // function Correlator.findPeak
+
+void Correlator::findPeak(const Image &img, std::vector<CorrPeak> &peaks)
+{
+    Image ccMap;
+    correlate(img, ccMap);
+    getPeak(ccMap, peaks);
+} // function Correlator.findPeak
+
+/** Return the sub-pixel offset of the vertex of the parabola through
+ * the values at positions -1, 0 and 1 */
+static inline double _parabolicOffset(double left, double center,
+                                      double right)
+{
+    double denom = left - 2 * center + right;
+
+    if (denom >= 0)  // Not a maximum
+        return 0;
+
+    return std::max(-0.5, std::min(0.5, 0.5 * (left - right) / denom));
+} // function _parabolicOffset
+
+/** Return the peak of a single item of a correlation map, whose
+ * data starts at data */
+static CorrPeak _getItemPeak(const float * data, const ArrayDim &dim)
+{
+    long n = dim.x * dim.y * dim.z;
+    auto maxIdx = std::max_element(data, data + n) - data;
+
+    long xy = dim.x * dim.y;
+    long pos[3] = {maxIdx % (long) dim.x, (maxIdx / (long) dim.x) % (long) dim.y,
+                   maxIdx / xy};
+    long size[3] = {(long) dim.x, (long) dim.y, (long) dim.z};
+    long stride[3] = {1, (long) dim.x, xy};
+    double shift[3];
+
+    for (int i = 0; i < 3; ++i)
+    {
+        shift[i] = pos[i] - size[i] / 2;
+
+        if (size[i] < 3)  // Not enough neighbours to refine
+            continue;
+
+        // Neighbours with periodic boundaries
+        long prev = (pos[i] + size[i] - 1) % size[i];
+        long next = (pos[i] + 1) % size[i];
+        auto base = maxIdx - pos[i] * stride[i];
+        shift[i] += _parabolicOffset(data[base + prev * stride[i]],
+                                     data[maxIdx],
+                                     data[base + next * stride[i]]);
+    }
+
+    CorrPeak peak;
+    peak.x = shift[0];
+    peak.y = shift[1];
+    peak.z = shift[2];
+    peak.value = data[maxIdx];
+
+    return peak;
+} // function _getItemPeak
+
+CorrPeak Correlator::getPeak(const Image &ccMap)
+{
+    ASSERT_ERROR(ccMap.getType() != typeFloat,
+                 "Correlation map should be of type float.");
+    ASSERT_ERROR(ccMap.getDim().n > 1,
+                 "Use getPeak with a vector of peaks for stacks.");
+
+    return _getItemPeak(static_cast<const float *>(ccMap.getData()),
+                        ccMap.getDim());
+} // function Correlator.getPeak
+
+void Correlator::getPeak(const Image &ccMap, std::vector<CorrPeak> &peaks)
+{
+    ASSERT_ERROR(ccMap.getType() != typeFloat,
+                 "Correlation map should be of type float.");
+
+    auto dim = ccMap.getDim();
+    auto data = static_cast<const float *>(ccMap.getData());
+    auto itemSize = dim.getItemSize();
+    peaks.resize(dim.n);
+
+    for (size_t i = 0; i < dim.n; ++i)
+        peaks[i] = _getItemPeak(data + i * itemSize, dim);
+} // function Correlator.getPeak
@@ -3,15 +3,39 @@
 //
 
 #include <fftw3.h>
+#include <vector>
+#include <map>
+#include <tuple>
+#include <mutex>
+#include <cstring>
+#include <complex>
+#include <algorithm>
 
 #include "emc/proc/fft.h"
 #include "emc/base/array.h"
-#include "emc/base/legacy.h"
+#include "emc/os/thread.h"
 
 
 using namespace emcore;
 
 
+/** Alignment (in bytes) taken into account when caching FFTW plans.
+ * A plan can only be executed on new arrays with the same alignment
+ * (modulo this value) of the arrays used to create it.
+ */
+#define FFT_ALIGNMENT 16
+
+
+/** The FFTW planner is not thread-safe, so plans creation and destruction
+ * should be protected when there are transformers in several threads.
+ */
+static std::mutex& getPlannerMutex()
+{
+    static std::mutex plannerMutex;
+    return plannerMutex;
+} // function getPlannerMutex
+
+
 /** Base underlying implementation for wrapping FFTW functions.
  * It will be subclasses to support float and double operations
  */
@@ -25,12 +49,52 @@ public:
     void * inputData = nullptr;
     void * outputData = nullptr;
 
+    /** Plans are cached by the dimensions (also the number of items) and
+     * the alignment of the input and output memory, so they can be
+     * executed again on other images with the same dimensions.
+     */
+    using PlanKey = std::tuple<size_t, size_t, size_t, size_t, size_t, size_t>;
+
     virtual void cleanup() = 0;
+
+    /** Set the current plans for inputDim and the alignment of the
+     * current input and output data. Plans are only created if they
+     * are not found in the cache. */
     virtual void createPlans() = 0;
     virtual void destroyPlans() = 0;
 
     virtual void transform(FT direction) = 0;
-    virtual void normalize() = 0;
+
+    /** Normalize the output of the backward transform. If modulate is true,
+     * the (-1)^(y+z) checkerboard is applied in the same pass. */
+    virtual void normalize(bool modulate) = 0;
+
+    /** Return the key for the plans of the current dimensions and data */
+    PlanKey getPlanKey() const
+    {
+        return PlanKey(inputDim.x, inputDim.y, inputDim.z, inputDim.n,
+                       reinterpret_cast<size_t>(inputData) % FFT_ALIGNMENT,
+                       reinterpret_cast<size_t>(outputData) % FFT_ALIGNMENT);
+    }
+
+    /** Set the dimensions to the dims array as expected by FFTW and
+     * return the starting index within dims, that depends on the rank. */
+    int setDims()
+    {
+        dims[0] = (int)inputDim.z;
+        dims[1] = (int)inputDim.y;
+        dims[2] = (int)inputDim.x;
+        return 3 - inputDim.getRank();
+    }
+
+    /** Return the number of elements of each item in real space and in
+     * Fourier space, used as distances between the items of a batch. */
+    std::pair<int, int> getItemDistances() const
+    {
+        ArrayDim itemDim(inputDim.x, inputDim.y, inputDim.z);
+        return std::make_pair((int) itemDim.getSize(),
+                              (int) getDimFT(itemDim).getSize());
+    }
 
     /** Set the images that will be used for the transform. */
     void setImages(const Image &rImg, Image &fImg)
@@ -57,13 +121,14 @@ public:
             fImg.resize(dimOut, typeOut);
         }
 
-        if (dim != inputDim || rImg.getData() != inputData ||
-            fImg.getData() != outputData)
+        auto key = getPlanKey();
+        // Remote the const-ness to store the input pointer to data
+        // Believe me, we are not going to modify it (for now)
+        inputData = const_cast<void*>(rImg.getData());
+        outputData = fImg.getData();
+
+        if (dim != inputDim || key != getPlanKey())
         {
-            // Remote the const-ness to store the input pointer to data
-            // Believe me, we are not going to modify it (for now)
-            inputData = const_cast<void*>(rImg.getData());
-            outputData = fImg.getData();
             inputDim = dim;
             createPlans();
         }
@@ -73,12 +138,39 @@ public:
 }; // class FourierTransformer::Impl
 
 
+/** Multiply all items in data by a checkerboard of +value/-value.
+ * The sign of each row depends on its y and z coordinates, and it is the
+ * same for all the elements of the row, since X is not shifted in the
+ * half-complex layout.
+ */
+template <class T>
+void _checkerboard(T * data, const ArrayDim &adim, T value)
+{
+    size_t xdim = adim.x;
+
+    for (size_t n = 0; n < adim.n; ++n)
+        for (size_t z = 0; z < adim.z; ++z)
+            for (size_t y = 0; y < adim.y; ++y, data += xdim)
+            {
+                T sign = (z + y) % 2 == 0 ? value : -value;
+                for (size_t x = 0; x < xdim; ++x)
+                    data[x] *= sign;
+            }
+} // function _checkerboard<T>
+
 template <class T>
-void _normalize(void * rawData, size_t n)
+void _normalize(void * rawData, const ArrayDim &adim, bool modulate)
 {
-    auto data = static_cast<float*>(rawData);
-    for (size_t i = 0; i < n; ++i, ++data)
-        *data /= n;
+    auto data = static_cast<T*>(rawData);
+    size_t n = adim.getSize();
+    // Each item of a batch is normalized by its own size
+    T value = T(1) / adim.getItemSize();
+
+    if (modulate)
+        _checkerboard(data, adim, value);
+    else
+        for (size_t i = 0; i < n; ++i, ++data)
+            *data *= value;
 } // function normalize<T>
 
 
@@ -86,10 +178,21 @@ void _normalize(void * rawData, size_t n)
 class FtFloatImpl: public FourierTransformer::Impl
 {
 private:
-    bool hasPlans = false;  // True if the plans are set
-    fftwf_plan plan, iplan; // Direct and inverse plans
+    using PlanPair = std::pair<fftwf_plan, fftwf_plan>;
+    std::map<PlanKey, PlanPair> plans; // Cache of direct and inverse plans
+    fftwf_plan plan = nullptr, iplan = nullptr; // Current plans
 
 public:
+    FtFloatImpl()
+    {
+        inputType = typeFloat;
+    }
+
+    virtual ~FtFloatImpl()
+    {
+        destroyPlans();
+    }
+
     virtual void cleanup() override
     {
         fftwf_cleanup();
@@ -97,39 +200,62 @@ public:
 
     virtual void createPlans() override
     {
-        destroyPlans();
-        int rank = inputDim.getRank();
-        auto input = static_cast<float*>(inputData);
-        auto output = static_cast<fftwf_complex *>(outputData);
-        // Set the dimensions to the dims array as expected by FFTW
-        dims[0] = (int)inputDim.z;
-        dims[1] = (int)inputDim.y;
-        dims[2] = (int)inputDim.x;
-        // The starting memory within dims will depends on the rank of the input
-        int index = 3 - inputDim.getRank();
-        plan = fftwf_plan_dft_r2c(rank, dims + index, input, output,
-                                  FFTW_ESTIMATE); // TODO: consider other flags??
-        iplan = fftwf_plan_dft_c2r(rank, dims + index, output, input,
-                                   FFTW_ESTIMATE); // TODO: consider other flags??
+        auto key = getPlanKey();
+        auto it = plans.find(key);
+
+        if (it == plans.end())
+        {
+            int rank = inputDim.getRank();
+            auto input = static_cast<float*>(inputData);
+            auto output = static_cast<fftwf_complex *>(outputData);
+            // The starting memory within dims will depends on the rank
+            int index = setDims();
+            std::lock_guard<std::mutex> lock(getPlannerMutex());
+            // Items of a stack are transformed in a single batched plan
+            int howmany = (int) inputDim.n;
+            auto dist = getItemDistances();
+            PlanPair pair;
+            pair.first = fftwf_plan_many_dft_r2c(
+                    rank, dims + index, howmany, input, nullptr, 1,
+                    dist.first, output, nullptr, 1, dist.second,
+                    FFTW_ESTIMATE); // TODO: consider other flags??
+            pair.second = fftwf_plan_many_dft_c2r(
+                    rank, dims + index, howmany, output, nullptr, 1,
+                    dist.second, input, nullptr, 1, dist.first,
+                    FFTW_ESTIMATE); // TODO: consider other flags??
+            it = plans.emplace(key, pair).first;
+        }
+
+        plan = it->second.first;
+        iplan = it->second.second;
     }
 
     virtual void destroyPlans() override
     {
-        if (hasPlans)
+        std::lock_guard<std::mutex> lock(getPlannerMutex());
+        for (auto &kv: plans)
         {
-            fftwf_destroy_plan(plan);
-            fftwf_destroy_plan(iplan);
+            fftwf_destroy_plan(kv.second.first);
+            fftwf_destroy_plan(kv.second.second);
         }
+        plans.clear();
+        plan = iplan = nullptr;
     }
 
     virtual void transform(FT direction) override
     {
-        fftwf_execute(direction == FT::FORWARD ? plan : iplan);
+        auto input = static_cast<float*>(inputData);
+        auto output = static_cast<fftwf_complex *>(outputData);
+
+        if (direction == FT::FORWARD)
+            fftwf_execute_dft_r2c(plan, input, output);
+        else
+            fftwf_execute_dft_c2r(iplan, output, input);
     }
 
-    virtual void normalize() override
+    virtual void normalize(bool modulate) override
     {
-        _normalize<float>(inputData, inputDim.getSize());
+        _normalize<float>(inputData, inputDim, modulate);
     }
 }; // class FtFloatImpl
 
@@ -137,10 +263,21 @@ public:
 class FtDoubleImpl: public FourierTransformer::Impl
 {
 private:
-    bool hasPlans = false;  // True if the plans are set
-    fftw_plan plan, iplan; // Direct and inverse plans
+    using PlanPair = std::pair<fftw_plan, fftw_plan>;
+    std::map<PlanKey, PlanPair> plans; // Cache of direct and inverse plans
+    fftw_plan plan = nullptr, iplan = nullptr; // Current plans
 
 public:
+    FtDoubleImpl()
+    {
+        inputType = typeDouble;
+    }
+
+    virtual ~FtDoubleImpl()
+    {
+        destroyPlans();
+    }
+
     virtual void cleanup() override
     {
         fftw_cleanup();
@@ -148,42 +285,77 @@ public:
 
     virtual void createPlans() override
     {
-        destroyPlans();
-        int rank = inputDim.getRank();
-        auto input = static_cast<double*>(inputData);
-        auto output = static_cast<fftw_complex *>(outputData);
-        // Set the dimensions to the dims array as expected by FFTW
-        dims[0] = (int)inputDim.z;
-        dims[1] = (int)inputDim.y;
-        dims[2] = (int)inputDim.x;
-        // The starting memory within dims will depends on the rank of the input
-        int index = 3 - inputDim.getRank();
-        plan = fftw_plan_dft_r2c(rank, dims + index, input, output,
-                                  FFTW_ESTIMATE); // TODO: consider other flags??
-        iplan = fftw_plan_dft_c2r(rank, dims + index, output, input,
-                                   FFTW_ESTIMATE); // TODO: consider other flags??
+        auto key = getPlanKey();
+        auto it = plans.find(key);
+
+        if (it == plans.end())
+        {
+            int rank = inputDim.getRank();
+            auto input = static_cast<double*>(inputData);
+            auto output = static_cast<fftw_complex *>(outputData);
+            // The starting memory within dims will depends on the rank
+            int index = setDims();
+            std::lock_guard<std::mutex> lock(getPlannerMutex());
+            // Items of a stack are transformed in a single batched plan
+            int howmany = (int) inputDim.n;
+            auto dist = getItemDistances();
+            PlanPair pair;
+            pair.first = fftw_plan_many_dft_r2c(
+                    rank, dims + index, howmany, input, nullptr, 1,
+                    dist.first, output, nullptr, 1, dist.second,
+                    FFTW_ESTIMATE); // TODO: consider other flags??
+            pair.second = fftw_plan_many_dft_c2r(
+                    rank, dims + index, howmany, output, nullptr, 1,
+                    dist.second, input, nullptr, 1, dist.first,
+                    FFTW_ESTIMATE); // TODO: consider other flags??
+            it = plans.emplace(key, pair).first;
+        }
+
+        plan = it->second.first;
+        iplan = it->second.second;
     }
 
     virtual void destroyPlans() override
     {
-        if (hasPlans)
+        std::lock_guard<std::mutex> lock(getPlannerMutex());
+        for (auto &kv: plans)
         {
-            fftw_destroy_plan(plan);
-            fftw_destroy_plan(iplan);
+            fftw_destroy_plan(kv.second.first);
+            fftw_destroy_plan(kv.second.second);
         }
+        plans.clear();
+        plan = iplan = nullptr;
     }
 
     virtual void transform(FT direction) override
     {
-        fftw_execute(direction == FT::FORWARD ? plan : iplan);
+        auto input = static_cast<double*>(inputData);
+        auto output = static_cast<fftw_complex *>(outputData);
+
+        if (direction == FT::FORWARD)
+            fftw_execute_dft_r2c(plan, input, output);
+        else
+            fftw_execute_dft_c2r(iplan, output, input);
     }
 
-    virtual void normalize() override
+    virtual void normalize(bool modulate) override
     {
-        _normalize<double>(inputData, inputDim.getSize());
+        _normalize<double>(inputData, inputDim, modulate);
     }
 }; // class FtDoubleImpl
 
+
+/** Create the implementation to transform images of the given type */
+static FourierTransformer::Impl * createImpl(const Type &type)
+{
+    if (type == typeFloat)
+        return new FtFloatImpl();
+    else if (type == typeDouble)
+        return new FtDoubleImpl();
+
+    THROW_ERROR(std::string("Unsupported FFT type: ") + type.getName());
+} // function createImpl
+
 FourierTransformer::FourierTransformer()
 {
     impl = nullptr;
@@ -191,9 +363,7 @@ FourierTransformer::FourierTransformer()
 
 FourierTransformer::~FourierTransformer()
 {
-    if (impl != nullptr)
-        impl->destroyPlans();
-    delete impl;
+    delete impl;  // Plans are destroyed by the implementation
 }
 
 void FourierTransformer::forward(const Image &rImg, Image &fImg)
@@ -201,160 +371,248 @@ void FourierTransformer::forward(const Image &rImg, Image &fImg)
 //    std::cout << "FourierTransformer::forward" << std::endl
 //              << "     rMem: " << rImg.getData() << std::endl
 //              << "     fMem: " << fImg.getData() << std::endl;
-    if (impl == nullptr)
-        impl = new FtFloatImpl();
+    auto& type = rImg.getType();
+
+    if (impl == nullptr || impl->inputType != type)
+    {
+        delete impl;
+        impl = createImpl(type);
+    }
 
     impl->setImages(rImg, fImg);
     impl->transform(FT::FORWARD);
 } // function FourierTransform.forward
 
-void FourierTransformer::backward(Image &fImg, Image &rImg)
+void FourierTransformer::forward(Image &rImg, Image &fImg, bool implicitShift)
+{
+    if (implicitShift)
+        checkerboard(rImg);
+
+    forward(static_cast<const Image&>(rImg), fImg);
+} // function FourierTransform.forward
+
+void FourierTransformer::backward(Image &fImg, Image &rImg, bool implicitShift)
 {
-    if (impl == nullptr)
-        impl = new FtFloatImpl();
+    // The type of the real space image is given by the FT one
+    auto& type = fImg.getType() == typeCDouble ? typeDouble : typeFloat;
+
+    if (impl == nullptr || impl->inputType != type)
+    {
+        delete impl;
+        impl = createImpl(type);
+    }
 //
 //    std::cout << "FourierTransformer::backward" << std::endl
 //              << "     rMem: " << rImg.getData() << std::endl
 //              << "     fMem: " << fImg.getData() << std::endl;
     impl->setImages(rImg, fImg);
     impl->transform(FT::BACKWARD);
-    impl->normalize();
+    impl->normalize(implicitShift);
 } // function FourierTransformer.backward
 
+/** Return the offset of the element that will be placed in the first
+ * position when shifting an axis of n elements in the given direction.
+ * The element at position i will be taken from (i + offset) % n.
+ */
+static inline size_t _shiftOffset(size_t n, bool isForward)
+{
+    return isForward ? n - n / 2 : n / 2;
+} // function _shiftOffset
+
+/** Copy a row of rowSize bytes from src to dst, rotated in such a way that
+ * the first offset bytes of src are placed at the end of dst.
+ * Both memory locations should not overlap.
+ */
+static inline void _copyRowShifted(uint8_t * dst, const uint8_t * src,
+                                   size_t rowSize, size_t offset)
+{
+    memcpy(dst, src + offset, rowSize - offset);
+    memcpy(dst + rowSize - offset, src, offset);
+} // function _copyRowShifted
+
 void FourierTransformer::shift(const Image &fImgIn, Image &fImgOut,
                                FT direction)
 {
-    // FIXME: The assignment does not seem to resize the image
-    fImgOut = fImgIn;
-    shift(fImgOut, direction); // TODO: Shift could be more efficient if not inplace
+    if (fImgIn.getData() == fImgOut.getData())
+    {
+        shift(fImgOut, direction);
+        return;
+    }
+
+    auto adim = fImgIn.getDim();
+    auto& type = fImgIn.getType();
+    fImgOut.resize(adim, type);
+
+    bool isForward = direction == FT::FORWARD;
+    size_t rowSize = adim.x * type.getSize();
+    size_t sliceSize = rowSize * adim.y;
+    size_t itemSize = sliceSize * adim.z;
+    size_t xOffset = _shiftOffset(adim.x, isForward) * type.getSize();
+    size_t yOffset = _shiftOffset(adim.y, isForward);
+    size_t zOffset = _shiftOffset(adim.z, isForward);
+
+    auto inData = fImgIn.getDataAsChar();
+    auto outData = fImgOut.getDataAsChar();
+
+    // Each output row is written only once, reading from its source row
+    for (size_t n = 0; n < adim.n; ++n)
+    {
+        for (size_t z = 0; z < adim.z; ++z)
+        {
+            auto inSlice = inData + ((z + zOffset) % adim.z) * sliceSize;
+            for (size_t y = 0; y < adim.y; ++y, outData += rowSize)
+                _copyRowShifted(outData,
+                                inSlice + ((y + yOffset) % adim.y) * rowSize,
+                                rowSize, xOffset);
+        }
+        inData += itemSize;
+    }
 } // function FourierTransformer.shift
 
 void FourierTransformer::shift(Image &inOutImg, FT direction)
 {
     auto adim = inOutImg.getDim();
-    auto rank = adim.getRank();
-    auto type = inOutImg.getType();
-    auto size = type.getSize();
+    auto& type = inOutImg.getType();
 
     bool isForward = direction == FT::FORWARD;
-    size_t n = adim.x; // assuming all dimensions are the same
-    size_t r = n % 2;
-    size_t h = n / 2;
-
-    // Left memory position is always 0, let's calculate
-    // the left size and right pos and size depending on the
-    // direction and also if the input dim is even or odd
-    size_t lIndex = isForward ? h + r : h;  // number of items in first half
-    size_t lJump = isForward ? lIndex - r: lIndex + r;
-    size_t rJump = lJump - n;  // assuming all dimensions are the same
-    size_t lSize =  lIndex * size;
-    size_t ldPos = lJump * size;
-    size_t rPos = (isForward ? h + r : h) * size;
-    size_t rSize = (isForward ? h : h + r) * size;
-
-
-#define SWAP(mem1, mem2, buffer, msize) { memcpy(buffer, mem1, msize); \
-                                          memcpy(mem1, mem2, msize); \
-                                          memcpy(mem2, buffer, msize); }
-
-#define SWAPX(mem) { memcpy(buffer, mem, lSize); \
-                     memcpy(mem, mem+rPos, rSize); \
-                     memcpy(mem+ldPos, buffer, lSize); }
-
-    uint8_t * buffer = nullptr;
-    auto data = static_cast<uint8_t *>(inOutImg.getData());
-
-    switch (rank)
+    size_t rowSize = adim.x * type.getSize();
+    size_t xOffset = _shiftOffset(adim.x, isForward) * type.getSize();
+    size_t yOffset = _shiftOffset(adim.y, isForward);
+    size_t zOffset = _shiftOffset(adim.z, isForward);
+    size_t rows = adim.y * adim.z; // Number of rows in each item
+
+    std::vector<uint8_t> buffer(rowSize);
+    std::vector<bool> done(rows);
+    auto data = inOutImg.getDataAsChar();
+
+    // The shift moves whole rows from (z, y) to another (z', y') position
+    // and rotates each row along x. We follow the cycles of this rows
+    // permutation so every row is read and written only once, keeping the
+    // first row of each cycle in the buffer.
+    for (size_t n = 0; n < adim.n; ++n, data += rows * rowSize)
     {
-        case 1:
-        {
-            // Half a row size to do shift in X
-            buffer = new uint8_t[(h + r) * size];
-            SWAPX(data);
-            break;
-        }
-        case 2:
-        {
-            size_t rowSize = n * size;
-            buffer = new uint8_t[rowSize];
-
-            auto rowData = data;
-            auto otherRow = data;
+        std::fill(done.begin(), done.end(), false);
 
-            size_t rowHalfJump = rowSize * h;
+        for (size_t start = 0; start < rows; ++start)
+        {
+            if (done[start])
+                continue;
 
-            // First of all, swap X all rows
-            for (size_t row = 0; row < n; ++row, rowData += rowSize)
-                SWAPX(rowData)
+            memcpy(buffer.data(), data + start * rowSize, rowSize);
+            size_t current = start;
 
-            rowData = data;
-            // If r = 0, we can do a more direct swap, if not
-            // we need to jump to the next position
-            if (r == 0)
+            while (true)
             {
-                // Example: n = 4 (forward)
-                // 0 <-> 2,  1 <-> 3
-                for (size_t row = 0; row < h; ++row, rowData += rowSize)
+                done[current] = true;
+                size_t y = current % adim.y;
+                size_t z = current / adim.y;
+                size_t next = ((z + zOffset) % adim.z) * adim.y +
+                              (y + yOffset) % adim.y;
+                auto dst = data + current * rowSize;
+
+                if (next == start)
                 {
-                    otherRow = rowData + rowHalfJump;
-                    SWAP(rowData, otherRow, buffer, rowSize);
-                }
-            }
-            else
-            {
-                // Example: n = 5 (forward)
-                // 0 -> 2,  2 -> 4,   4 -> 1,   1 -> 3,  3 -> 0
-                // Copy first row to the buffer
-                memcpy(buffer, data, rowSize);
-                for (size_t i = 0, index = 0; i < n; ++i)
-                {
-                    index += index < lIndex ? lJump : rJump;
-                    // Now swap it to the next position (this will store
-                    // the next position in buffer for next iter)
-                    // Using the first row as a new 'buffer'
-                    if (index == 0) // for the last index we just need to copy
-                        memcpy(data, buffer, rowSize);
-                    else
-                        SWAP(buffer, data + index * rowSize, data, rowSize);
+                    _copyRowShifted(dst, buffer.data(), rowSize, xOffset);
+                    break;
                 }
+
+                _copyRowShifted(dst, data + next * rowSize, rowSize, xOffset);
+                current = next;
             }
-            break;
         }
+    }
+} // function FourierTransformer.shift
 
-        case 3:
-            break;
-    } // switch rank
+void FourierTransformer::checkerboard(Image &rImg)
+{
+    auto& type = rImg.getType();
+    auto adim = rImg.getDim();
 
-    delete buffer;
-} // function FourierTransformer.shift
+    if (type == typeFloat)
+        _checkerboard(static_cast<float*>(rImg.getData()), adim, 1.0f);
+    else if (type == typeDouble)
+        _checkerboard(static_cast<double*>(rImg.getData()), adim, 1.0);
+    else
+        THROW_ERROR("Only images of Float or Double are allowed.");
+} // function FourierTransformer.checkerboard
 
 
+/** Return the logical frequency of the physical index i in an axis
+ * of n elements of a Fourier transform (not the half-complex x axis).
+ */
+static inline long _logicalIndex(size_t i, size_t n)
+{
+    return i < n / 2 + 1 ? (long) i : (long) i - (long) n;
+} // function _logicalIndex
+
+/** Return the physical index of the logical frequency l in an axis
+ * of n elements, or -1 if the frequency is not in that axis.
+ */
+static inline long _physicalIndex(long l, size_t n)
+{
+    long h = n / 2 + 1;
+    if (l >= h || l < h - (long) n)
+        return -1;
+    return l < 0 ? l + (long) n : l;
+} // function _physicalIndex
+
 template <class T>
 void _windowFT(const Image &fImgIn, Image &fImgOut)
 {
+    using Complex = std::complex<T>;
+
     auto idim = fImgIn.getDim();
     auto odim = fImgOut.getDim();
-
-    LegacyArray<std::complex<T>> in(idim, const_cast<void *>(fImgIn.getData()));
-    LegacyArray<std::complex<T>> out(odim, fImgOut.getData());
-
-    if (fImgOut.getDim().x > fImgIn.getDim().x)
-    {
-        long int max_r2 = (XSIZE(in) -1) * (XSIZE(in) - 1);
-        FOR_ALL_ELEMENTS_IN_FFTW_TRANSFORM(in)
-        {
-            // Make sure windowed FT has nothing in the corners, otherwise we end up with an asymmetric FT!
-            if (kp*kp + ip*ip + jp*jp <= max_r2)
-                FFTW_ELEM(out, kp, ip, jp) = FFTW_ELEM(in, kp, ip, jp);
-        }
-    }
-    else
+    auto in = static_cast<const Complex *>(fImgIn.getData());
+    auto out = static_cast<Complex *>(fImgOut.getData());
+
+    size_t xCopy = std::min(idim.x, odim.x);
+    bool enlarge = odim.x > idim.x;
+    // Make sure windowed FT has nothing in the corners when enlarging,
+    // otherwise we end up with an asymmetric FT!
+    long maxR2 = (idim.x - 1) * (idim.x - 1);
+
+    // Each z-plane of each item of the output is computed independently
+    Thread::parallelFor(odim.n * odim.z, [&](size_t pStart, size_t pEnd,
+                                             size_t)
     {
-        FOR_ALL_ELEMENTS_IN_FFTW_TRANSFORM(out)
+        for (size_t p = pStart; p < pEnd; ++p)
         {
-            FFTW_ELEM(out, kp, ip, jp) = FFTW_ELEM(in, kp, ip, jp);
+            size_t k = p % odim.z;
+            auto itemIn = in + (p / odim.z) * idim.getItemSize();
+            auto itemOut = out + (p / odim.z) * odim.getItemSize();
+            long kp = _logicalIndex(k, odim.z);
+            long kIn = _physicalIndex(kp, idim.z);
+
+            for (size_t i = 0; i < odim.y; ++i)
+            {
+                long ip = _logicalIndex(i, odim.y);
+                long iIn = _physicalIndex(ip, idim.y);
+                auto outRow = itemOut + (k * odim.y + i) * odim.x;
+                size_t x = 0;
+
+                if (kIn >= 0 && iIn >= 0)
+                {
+                    auto inRow = itemIn + (kIn * idim.y + iIn) * idim.x;
+
+                    if (enlarge)
+                    {
+                        // The radius increases with x, so we can stop
+                        // the copy at the first value outside the sphere
+                        long r2 = kp * kp + ip * ip;
+                        for (; x < xCopy && r2 + (long)(x * x) <= maxR2; ++x)
+                            outRow[x] = inRow[x];
+                    }
+                    else
+                    {
+                        std::copy(inRow, inRow + xCopy, outRow);
+                        x = xCopy;
+                    }
+                }
+                std::fill(outRow + x, outRow + odim.x, Complex(0));
+            }
         }
-    }
+    });
 } // helper function _windowFT
 
 void FourierTransformer::windowFT(const Image &fImgIn, Image &fImgOut, size_t newdim)
@@ -362,14 +620,15 @@ void FourierTransformer::windowFT(const Image &fImgIn, Image &fImgOut, size_t ne
     auto idim = fImgIn.getDim();
     auto& type = fImgIn.getType();
     size_t &y = idim.y;
+    int rank = idim.getRank();
 
-    ASSERT_ERROR(idim.getRank() != 2, "Only implemented for rank=2");
+    ASSERT_ERROR(rank < 2, "Only implemented for rank=2 or rank=3");
 
     size_t newhdim = newdim / 2 + 1;
 
-    auto odim = ArrayDim(newhdim, newdim);
+    auto odim = ArrayDim(newhdim, newdim, rank == 3 ? newdim : 1, idim.n);
 
-    ASSERT_ERROR(y > 1 && y / 2 + 1 != idim.x,
+    ASSERT_ERROR(y / 2 + 1 != idim.x || (rank == 3 && idim.z != y),
                  "Fourier Transform should be an image of equal sizes in "
                  "all dimensions.")
 
@@ -394,7 +653,7 @@ void FourierTransformer::scale(const Image &inputImg, Image &outputImg,
     Image fImg1, fImg2;
     forward(inputImg, fImg1);
     windowFT(fImg1, fImg2, newdim);
-    ArrayDim odim(newdim, newdim);
+    ArrayDim odim(newdim, newdim, 1, inputImg.getDim().n);
     if (inputImg.getDim().getRank() == 3)
         odim.z = newdim;
     outputImg.resize(odim, inputImg.getType());
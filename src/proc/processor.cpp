@@ -2,7 +2,11 @@
 // Created by josem on 11/7/17.
 //
 
+#include <cmath>
+#include <complex>
+
 #include "emc/base/string.h"
+#include "emc/os/thread.h"
 #include "emc/proc/processor.h"
 #include "../../include/emc/proc/fft.h"
 
@@ -138,7 +142,6 @@ void ImageScaleProc::validateParams()
 
 void ImageScaleProc::process(const Image &input, Image &output)
 {
-    FourierTransformer ft;
     // TODO: Check if we need to convert always
     auto inputDim = input.getDim();
 
@@ -311,4 +314,349 @@ void ImageWindowProc::process(Image &image)
     Image tmp;
     process(image, tmp);
     std::swap(image, tmp);  // Move the result to image
-} // function ImageWindowProc.process
\ No newline at end of file
+} // function ImageWindowProc.process
+
+// -------------- ImageFourierFilterProc Implementation ---------------------
+ImageFourierFilterProc::ImageFourierFilterProc(const ObjectDict &params)
+{
+    setParams(params);
+} // ImageFourierFilterProc ctor
+
+void ImageFourierFilterProc::validateParams()
+{
+    ASSERT_ERROR(!hasParam(OPERATION), "Please provide the filter operation.");
+
+    float angpix = hasParam("angpix") ? params["angpix"].get<float>() : 1;
+
+    // Convert resolution values (in A) into digital frequencies
+    if (hasParam("lowpass_res"))
+        params["freq_high"] = angpix / params["lowpass_res"].get<float>();
+    if (hasParam("highpass_res"))
+        params["freq_low"] = angpix / params["highpass_res"].get<float>();
+    if (!hasParam("freq_decay"))
+        params["freq_decay"] = 0.02f;
+
+    auto op = params[OPERATION].get<OP>();
+
+    if (op == FILTER_LOWPASS || op == FILTER_BANDPASS || op == FILTER_GAUSSIAN)
+        ASSERT_ERROR(!hasParam("freq_high"),
+                     "Please provide 'freq_high' or 'lowpass_res'.");
+    if (op == FILTER_HIGHPASS || op == FILTER_BANDPASS)
+        ASSERT_ERROR(!hasParam("freq_low"),
+                     "Please provide 'freq_low' or 'highpass_res'.");
+
+    weightsDim = ArrayDim();  // Parameters changed, weights are not valid
+} // function ImageFourierFilterProc.validateParams
+
+/** Return the value of a raised-cosine low-pass filter of given cutoff
+ * frequency and decay (width of the transition band) at frequency f */
+static inline float _raisedCosine(float f, float cutoff, float decay)
+{
+    float f1 = cutoff - decay / 2;
+
+    if (f <= f1)
+        return 1;
+    if (f >= f1 + decay)
+        return 0;
+
+    return 0.5f * (1 + cosf(M_PI * (f - f1) / decay));
+} // function _raisedCosine
+
+/** Return the logical frequency (cycles per pixel) of the physical index i
+ * of an axis of n elements in Fourier space (but not the x axis) */
+static inline float _digitalFreq(size_t i, size_t n)
+{
+    long l = i < n / 2 + 1 ? (long) i : (long) i - (long) n;
+    return float(l) / n;
+} // function _digitalFreq
+
+const Image& ImageFourierFilterProc::getWeights(const ArrayDim &rDim)
+{
+    ArrayDim dim(rDim.x, rDim.y, rDim.z);
+
+    if (dim == weightsDim)
+        return weights;
+
+    auto fdim = FourierTransformer::getDimFT(dim);
+    weights.resize(fdim, typeFloat);
+    auto data = static_cast<float *>(weights.getData());
+
+    auto op = params[OPERATION].get<OP>();
+    float decay = params["freq_decay"].get<float>();
+    float freqLow = hasParam("freq_low") ? params["freq_low"].get<float>() : 0;
+    float freqHigh = hasParam("freq_high") ? params["freq_high"].get<float>() : 0;
+    float sigma2 = 2 * freqHigh * freqHigh;
+
+    for (size_t z = 0; z < fdim.z; ++z)
+    {
+        float fz = _digitalFreq(z, dim.z);
+        for (size_t y = 0; y < fdim.y; ++y)
+        {
+            float fy = _digitalFreq(y, dim.y);
+            float fzy2 = fz * fz + fy * fy;
+            for (size_t x = 0; x < fdim.x; ++x, ++data)
+            {
+                float fx = float(x) / dim.x;
+                float f2 = fzy2 + fx * fx;
+                float f = sqrtf(f2);
+
+                switch (op)
+                {
+                    case FILTER_LOWPASS:
+                        *data = _raisedCosine(f, freqHigh, decay);
+                        break;
+                    case FILTER_HIGHPASS:
+                        *data = 1 - _raisedCosine(f, freqLow, decay);
+                        break;
+                    case FILTER_BANDPASS:
+                        *data = _raisedCosine(f, freqHigh, decay) *
+                                (1 - _raisedCosine(f, freqLow, decay));
+                        break;
+                    case FILTER_GAUSSIAN:
+                        *data = expf(-f2 / sigma2);
+                        break;
+                    default:
+                        THROW_ERROR("Unsupported filter operation.");
+                }
+            }
+        }
+    }
+
+    weightsDim = dim;
+    return weights;
+} // function ImageFourierFilterProc.getWeights
+
+/** Multiply each Fourier coefficient by its weight. The same weights
+ * are applied to every item of a stack. */
+template <class T>
+void _applyWeights(Image &fImg, const Image &weights)
+{
+    auto data = static_cast<std::complex<T> *>(fImg.getData());
+    auto w = static_cast<const float *>(weights.getData());
+    auto itemSize = weights.getDim().getItemSize();
+    auto n = fImg.getDim().n;
+
+    for (size_t i = 0; i < n; ++i, data += itemSize)
+        for (size_t j = 0; j < itemSize; ++j)
+            data[j] *= T(w[j]);
+} // function _applyWeights
+
+void ImageFourierFilterProc::process(const Image &input, Image &output)
+{
+    auto& type = input.getType();
+
+    if (type == typeFloat || type == typeDouble)
+        output = input;
+    else
+        output.copy(input, typeFloat);
+
+    process(output);
+} // function ImageFourierFilterProc.process
+
+void ImageFourierFilterProc::process(Image &image)
+{
+    auto& type = image.getType();
+
+    if (type != typeFloat && type != typeDouble)
+    {
+        Image tmp;
+        process(image, tmp);
+        std::swap(image, tmp);  // Move the result to image
+        return;
+    }
+
+    // Weights are computed for a single item and all items of a stack
+    // are transformed together in the same batched plan
+    auto& w = getWeights(image.getDim());
+    ft.forward(image, fImg);
+
+    if (type == typeDouble)
+        _applyWeights<double>(fImg, w);
+    else
+        _applyWeights<float>(fImg, w);
+
+    ft.backward(fImg, image);
+} // function ImageFourierFilterProc.process
+
+
+// -------------- ImagePowerSpectrumProc Implementation ---------------------
+ImagePowerSpectrumProc::ImagePowerSpectrumProc(const ObjectDict &params)
+{
+    setParams(params);
+} // ImagePowerSpectrumProc ctor
+
+void ImagePowerSpectrumProc::validateParams()
+{
+    if (!hasParam("tile_size"))
+        params["tile_size"] = 512;
+    if (!hasParam("tile_overlap"))
+        params["tile_overlap"] = 0.5f;
+
+    auto overlap = params["tile_overlap"].get<float>();
+    ASSERT_ERROR(params["tile_size"].get<int>() < 2,
+                 "Tile size should be at least 2.");
+    ASSERT_ERROR(overlap < 0 || overlap >= 1,
+                 "Tile overlap should be between 0 and 1 (not included).");
+} // function ImagePowerSpectrumProc.validateParams
+
+/** Return the start positions of the tiles along an axis */
+static std::vector<size_t> _tilePositions(size_t n, size_t tile, size_t step)
+{
+    std::vector<size_t> positions;
+    for (size_t p = 0; p + tile <= n; p += step)
+        positions.push_back(p);
+    return positions;
+} // function _tilePositions
+
+void ImagePowerSpectrumProc::process(const Image &input, Image &output)
+{
+    auto dim = input.getDim();
+    auto tile = (size_t) params["tile_size"].get<int>();
+    auto overlap = params["tile_overlap"].get<float>();
+    auto step = std::max((size_t) 1, (size_t) roundf(tile * (1 - overlap)));
+
+    ASSERT_ERROR(dim.z > 1 || dim.n > 1,
+                 "Power spectrum is only implemented for single 2D images.");
+    ASSERT_ERROR(dim.x < tile || dim.y < tile,
+                 "Image should not be smaller than the tile size.");
+
+    auto xPos = _tilePositions(dim.x, tile, step);
+    auto yPos = _tilePositions(dim.y, tile, step);
+    tilesCount = xPos.size() * yPos.size();
+
+    Image localInput;
+    const Image *inputPtr = &input;
+    if (input.getType() != typeFloat)
+    {
+        localInput.copy(input, typeFloat);
+        inputPtr = &localInput;
+    }
+    auto inData = static_cast<const float *>(inputPtr->getData());
+
+    if (window.size() != tile)
+    {
+        window.resize(tile);
+        for (size_t i = 0; i < tile; ++i)
+            window[i] = 0.5 * (1 - cos(2 * M_PI * i / tile));
+    }
+
+    // Prepare one transformer and working images per thread
+    size_t chunks = Thread::getChunks(tilesCount);
+    ArrayDim tileDim(tile, tile);
+    ArrayDim fDim = FourierTransformer::getDimFT(tileDim);
+    size_t fSize = fDim.getSize();
+
+    while (transformers.size() < chunks)
+        transformers.emplace_back(new FourierTransformer());
+    tiles.resize(chunks);
+    fTiles.resize(chunks);
+    std::vector<std::vector<double>> sums(chunks);
+
+    // Tiles are transformed in batches with a single FFTW plan, the last
+    // batch of each thread can be smaller (its plan is also cached)
+    const size_t batch = 8;
+    size_t tileSize = tileDim.getSize();
+
+    Thread::parallelFor(tilesCount, [&](size_t start, size_t end, size_t c)
+    {
+        auto& tileImg = tiles[c];
+        auto& fImg = fTiles[c];
+        auto& sum = sums[c];
+        sum.assign(fSize, 0);
+
+        for (size_t t0 = start; t0 < end; t0 += batch)
+        {
+            size_t count = std::min(batch, end - t0);
+            tileImg.resize(ArrayDim(tile, tile, 1, count), typeFloat);
+            auto tData = static_cast<float *>(tileImg.getData());
+
+            for (size_t b = 0; b < count; ++b, tData += tileSize)
+            {
+                size_t t = t0 + b;
+                size_t x0 = xPos[t % xPos.size()], y0 = yPos[t / xPos.size()];
+                double mean = 0;
+
+                for (size_t y = 0; y < tile; ++y)
+                {
+                    auto row = inData + (y0 + y) * dim.x + x0;
+                    std::copy(row, row + tile, tData + y * tile);
+                    for (size_t x = 0; x < tile; ++x)
+                        mean += row[x];
+                }
+                mean /= tile * tile;
+
+                for (size_t y = 0; y < tile; ++y)
+                    for (size_t x = 0; x < tile; ++x)
+                    {
+                        auto& v = tData[y * tile + x];
+                        v = float((v - mean) * window[y] * window[x]);
+                    }
+            }
+
+            transformers[c]->forward(tileImg, fImg);
+            auto fData = static_cast<const cfloat *>(fImg.getData());
+            for (size_t b = 0; b < count; ++b, fData += fSize)
+                for (size_t i = 0; i < fSize; ++i)
+                    sum[i] += std::norm(fData[i]);
+        }
+    }, chunks);
+
+    // Reduce the partial sums of all threads
+    auto& total = sums[0];
+    for (size_t c = 1; c < chunks; ++c)
+        for (size_t i = 0; i < fSize; ++i)
+            total[i] += sums[c][i];
+
+    // Build the full centered spectrum from the half-complex layout,
+    // using the Hermitian symmetry P(-k) = P(k)
+    output.resize(tileDim, typeFloat);
+    auto outData = static_cast<float *>(output.getData());
+    size_t half = tile / 2;
+    size_t nBins = half + 1;
+    std::vector<double> binSums(nBins, 0);
+    std::vector<size_t> binCounts(nBins, 0);
+
+    for (size_t y = 0; y < tile; ++y)
+    {
+        long ky = (long) y - (long) half;
+        size_t fy = (ky + tile) % tile;
+        for (size_t x = 0; x < tile; ++x)
+        {
+            long kx = (long) x - (long) half;
+            size_t fx = (size_t) std::abs(kx);
+            // Negative x frequencies are taken from the conjugate (-ky)
+            size_t fyy = kx < 0 ? (tile - fy) % tile : fy;
+            double value = total[fyy * fDim.x + fx] / tilesCount;
+            outData[y * tile + x] = (float) value;
+
+            auto r = (size_t) round(sqrt(double(kx * kx + ky * ky)));
+            if (r < nBins)
+            {
+                binSums[r] += value;
+                binCounts[r]++;
+            }
+        }
+    }
+
+    profile.assign(nBins, 0);
+    for (size_t r = 0; r < nBins; ++r)
+        if (binCounts[r] > 0)
+            profile[r] = binSums[r] / binCounts[r];
+} // function ImagePowerSpectrumProc.process
+
+void ImagePowerSpectrumProc::process(Image &image)
+{
+    Image tmp;
+    process(image, tmp);
+    std::swap(image, tmp);  // Move the result to image
+} // function ImagePowerSpectrumProc.process
+
+const std::vector<double>& ImagePowerSpectrumProc::getRadialProfile() const
+{
+    return profile;
+} // function ImagePowerSpectrumProc.getRadialProfile
+
+size_t ImagePowerSpectrumProc::getTilesCount() const
+{
+    return tilesCount;
+} // function ImagePowerSpectrumProc.getTilesCount
@@ -2,6 +2,17 @@
 // Created by josem on 11/7/17.
 //
 
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cstring>
+#include <list>
+#include <map>
+#include <tuple>
+
+#include "emc/base/image_reader.h"
+#include "emc/os/thread.h"
 #include "emc/proc/stats.h"
 
 using namespace emcore;
@@ -9,47 +20,144 @@ namespace emc = emcore;
 
 // -------------- Stats Implementation ---------------------------
 
-template <typename T>
-Stats computeStats(const T * data, size_t size, Stats::Operation op)
+/** Number of elements processed at once, small enough to stay in cache
+ * while computing the mean and the squared deviations of the block. */
+#define STATS_BLOCK 4096
+/** Minimum number of elements to be processed by each thread */
+#define STATS_MIN_CHUNK (1 << 18)
+/** Number of independent accumulators, to allow vectorization */
+#define STATS_LANES 4
+/** Maximum number of circular masks kept in the cache */
+#define STATS_MASK_CACHE 32
+
+/** Partial statistics of a range of values. Partials of consecutive
+ * ranges can be merged exactly (Chan et al. pairwise update), so the
+ * variance is computed from squared deviations and not from E[x^2]-E[x]^2.
+ */
+struct StatsPartial
 {
-    Stats s;
-    s.min = s.max = static_cast<double>(data[0]);
-    s.std = s.mean = 0;
-    auto iter = data;
+    size_t n = 0;
+    double min = 0, max = 0, mean = 0, m2 = 0;
 
-    if (op == Stats::MIN_MAX)  // Only compute min and max
+    void merge(const StatsPartial &other)
     {
-        for (size_t i = 0; i < size; ++i, ++iter)
+        if (other.n == 0)
+            return;
+
+        if (n == 0)
         {
-            double v = static_cast<double>(*iter);
-            if (v < s.min)
-                s.min = v;
-            else if (v > s.max)
-                s.max = v;
+            *this = other;
+            return;
         }
+
+        min = std::min(min, other.min);
+        max = std::max(max, other.max);
+        size_t total = n + other.n;
+        double delta = other.mean - mean;
+        double ratio = double(other.n) / total;
+        mean += delta * ratio;
+        m2 += other.m2 + delta * delta * n * ratio;
+        n = total;
     }
-    else
-    {
-        for (size_t i = 0; i < size; ++i)
+}; // struct StatsPartial
+
+/** Compute min, max and, unless only min and max are requested, the mean
+ * and the sum of squared deviations of a block of values. */
+template <typename T>
+StatsPartial computeBlock(const T * data, size_t size, Stats::Operation op)
+{
+    StatsPartial p;
+    p.n = size;
+    T lo[STATS_LANES], hi[STATS_LANES];
+    size_t lanesEnd = size - size % STATS_LANES;
+    size_t i;
+
+    for (size_t l = 0; l < STATS_LANES; ++l)
+        lo[l] = hi[l] = data[0];
+
+    for (i = 0; i < lanesEnd; i += STATS_LANES)
+        for (size_t l = 0; l < STATS_LANES; ++l)
         {
-            double v = static_cast<double>(data[i]);
-            if (v < s.min)
-                s.min = v;
-            else if (v > s.max)
-                s.max = v;
-            s.mean += v;
-            s.std += v * v;
+            T v = data[i + l];
+            lo[l] = v < lo[l] ? v : lo[l];
+            hi[l] = v > hi[l] ? v : hi[l];
         }
+    for (; i < size; ++i)
+    {
+        lo[0] = std::min(lo[0], data[i]);
+        hi[0] = std::max(hi[0], data[i]);
+    }
+
+    p.min = *std::min_element(lo, lo + STATS_LANES);
+    p.max = *std::max_element(hi, hi + STATS_LANES);
+
+    if (op == Stats::MIN_MAX)
+        return p;
 
-        if (size > 1)
+    double acc[STATS_LANES] = {0};
+
+    for (i = 0; i < lanesEnd; i += STATS_LANES)
+        for (size_t l = 0; l < STATS_LANES; ++l)
+            acc[l] += static_cast<double>(data[i + l]);
+    for (; i < size; ++i)
+        acc[0] += static_cast<double>(data[i]);
+
+    p.mean = (acc[0] + acc[1] + acc[2] + acc[3]) / size;
+
+    // Second pass over the block (still in cache) for the deviations
+    std::fill(acc, acc + STATS_LANES, 0.0);
+    for (i = 0; i < lanesEnd; i += STATS_LANES)
+        for (size_t l = 0; l < STATS_LANES; ++l)
         {
-            s.mean /= size;
-            s.std = s.std / size - s.mean * s.mean;
-            s.std *= size / (size - 1);
-            // Foreseeing numerical instabilities
-            s.std = sqrt(static_cast< double >(abs(s.std)));
-        } else
-            s.std = 0;
+            double d = static_cast<double>(data[i + l]) - p.mean;
+            acc[l] += d * d;
+        }
+    for (; i < size; ++i)
+    {
+        double d = static_cast<double>(data[i]) - p.mean;
+        acc[0] += d * d;
+    }
+
+    p.m2 = acc[0] + acc[1] + acc[2] + acc[3];
+
+    return p;
+} // template function computeBlock<T>
+
+template <typename T>
+Stats computeStats(const T * data, size_t size, Stats::Operation op)
+{
+    Stats s;
+    s.min = s.max = s.mean = s.std = 0;
+
+    if (size == 0)
+        return s;
+
+    // Each thread reduces a contiguous chunk block by block, the partial
+    // results are merged later in order, so the result is deterministic
+    size_t chunks = Thread::getChunks(size, 0, STATS_MIN_CHUNK);
+    std::vector<StatsPartial> partials(chunks);
+
+    Thread::parallelFor(size, [&](size_t start, size_t end, size_t chunk)
+    {
+        auto& partial = partials[chunk];
+        for (size_t i = start; i < end; i += STATS_BLOCK)
+            partial.merge(computeBlock(data + i,
+                                       std::min(end - i, (size_t) STATS_BLOCK),
+                                       op));
+    }, chunks, STATS_MIN_CHUNK);
+
+    for (size_t c = 1; c < chunks; ++c)
+        partials[0].merge(partials[c]);
+
+    auto& p = partials[0];
+    s.min = p.min;
+    s.max = p.max;
+
+    if (op != Stats::MIN_MAX)
+    {
+        s.mean = p.mean;
+        // Population standard deviation (as numpy.std with ddof=0)
+        s.std = sqrt(p.m2 / p.n);
     }
 
     return s;
@@ -87,4 +195,516 @@ std::ostream& emc::operator<< (std::ostream &ostrm, const Stats &s)
     ostrm << "min: " << s.min << " max: " << s.max
           << " avg: " << s.mean << " std: " << s.std << " ";
     return ostrm;
-}
\ No newline at end of file
+}
+
+
+// -------------- StatsAccumulator Implementation ---------------------------
+
+Stats StatsAccumulator::add(const Array &array)
+{
+    auto s = Stats::compute(array);
+    add(s, array.getDim().getSize());
+    return s;
+} // function StatsAccumulator.add
+
+void StatsAccumulator::add(const Stats &stats, size_t n)
+{
+    StatsPartial other;
+    other.n = n;
+    other.min = stats.min;
+    other.max = stats.max;
+    other.mean = stats.mean;
+    other.m2 = stats.std * stats.std * n;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    StatsPartial p;
+    p.n = count;
+    p.min = min;
+    p.max = max;
+    p.mean = mean;
+    p.m2 = m2;
+    p.merge(other);
+
+    count = p.n;
+    min = p.min;
+    max = p.max;
+    mean = p.mean;
+    m2 = p.m2;
+} // function StatsAccumulator.add
+
+std::vector<Stats> StatsAccumulator::add(ImageFile &imgFile)
+{
+    std::vector<Stats> result;
+    result.reserve(imgFile.getDim().n);
+    // Read the next image while computing the stats of this one
+    ImageReader reader(imgFile, 2);
+
+    while (reader.next())
+        result.push_back(add(reader.getImage()));
+
+    return result;
+} // function StatsAccumulator.add
+
+Stats StatsAccumulator::getStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Stats s;
+    s.min = min;
+    s.max = max;
+    s.mean = mean;
+    s.std = count > 0 ? sqrt(m2 / count) : 0;
+    return s;
+} // function StatsAccumulator.getStats
+
+size_t StatsAccumulator::getCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return count;
+} // function StatsAccumulator.getCount
+
+void StatsAccumulator::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    count = 0;
+    min = max = mean = m2 = 0;
+} // function StatsAccumulator.clear
+
+// -------------- Masked Stats Implementation ---------------------------
+
+/** Minimum number of items to be processed by each thread */
+#define MASKED_MIN_CHUNK 16
+
+template <typename T>
+std::vector<Stats> computeMaskedStats(const T * data, const ArrayDim &dim,
+                                      const StatsMask &mask, Stats::Operation op)
+{
+    std::vector<Stats> result(dim.n);
+    auto& spans = mask.getSpans();
+    size_t itemSize = dim.getItemSize();
+
+    Thread::parallelFor(dim.n, [&](size_t start, size_t end, size_t)
+    {
+        for (size_t i = start; i < end; ++i)
+        {
+            auto item = data + i * itemSize;
+            StatsPartial p;
+            for (auto& span: spans)
+                p.merge(computeBlock(item + span.start, span.length, op));
+
+            auto& s = result[i];
+            s.min = p.min;
+            s.max = p.max;
+            s.mean = op == Stats::MIN_MAX ? 0 : p.mean;
+            s.std = op == Stats::MIN_MAX || p.n == 0 ? 0 : sqrt(p.m2 / p.n);
+        }
+    }, 0, MASKED_MIN_CHUNK);
+
+    return result;
+} // template function computeMaskedStats<T>
+
+std::vector<Stats> Stats::computeMasked(const Array &array,
+                                        const StatsMask &mask, Operation op)
+{
+    auto dim = array.getDim();
+    auto& type = array.getType();
+    auto& mdim = mask.getDim();
+
+    ASSERT_ERROR(dim.x != mdim.x || dim.y != mdim.y || dim.z != mdim.z,
+                 "Mask dimensions should be the same of the array items.");
+
+#define MASKED_IF(T) if (type == Type::get<T>()) \
+        return computeMaskedStats(static_cast<const T*>(array.getData()), \
+                                  dim, mask, op)
+    MASKED_IF(float);
+    MASKED_IF(double);
+    MASKED_IF(int8_t);
+    MASKED_IF(uint8_t);
+    MASKED_IF(int16_t);
+    MASKED_IF(uint16_t);
+    MASKED_IF(int32_t);
+    MASKED_IF(uint32_t);
+    MASKED_IF(int64_t);
+    MASKED_IF(uint64_t);
+    THROW_ERROR(std::string("Stats can not be computed for type: ")
+                + type.getName());
+#undef MASKED_IF
+} // Stats.computeMasked
+
+void StatsMask::addSpan(size_t start, size_t length)
+{
+    if (length == 0)
+        return;
+
+    count += length;
+
+    if (!spans.empty() && spans.back().start + spans.back().length == start)
+        spans.back().length += length;
+    else
+        spans.push_back({start, length});
+} // function StatsMask.addSpan
+
+StatsMask::StatsMask(const Array &mask)
+{
+    Array localMask;
+    localMask.copy(mask, typeFloat);
+    auto data = static_cast<const float *>(localMask.getData());
+    dim = mask.getDim();
+    dim.n = 1;
+    size_t n = dim.getSize();
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (data[i] == 0)
+            continue;
+        size_t j = i;
+        while (j < n && data[j] != 0)
+            ++j;
+        addSpan(i, j - i);
+        i = j;
+    }
+} // StatsMask ctor
+
+std::shared_ptr<const StatsMask> StatsMask::circular(const ArrayDim &dim,
+                                                     double radius,
+                                                     bool inside)
+{
+    using Key = std::tuple<size_t, size_t, size_t, double, bool>;
+    using Entry = std::pair<Key, std::shared_ptr<const StatsMask>>;
+    // Entries sorted from the most to the least recently used
+    static std::list<Entry> entries;
+    static std::map<Key, std::list<Entry>::iterator> index;
+    static std::mutex cacheMutex;
+
+    Key key(dim.x, dim.y, dim.z, radius, inside);
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        auto it = index.find(key);
+
+        if (it != index.end())
+        {
+            entries.splice(entries.begin(), entries, it->second);
+            return it->second->second;
+        }
+    }
+
+    auto maskPtr = std::make_shared<StatsMask>();
+    auto& mask = *maskPtr;
+    mask.dim = ArrayDim(dim.x, dim.y, dim.z);
+    long cx = dim.x / 2, cy = dim.y / 2, cz = dim.z / 2;
+    double r2 = radius * radius;
+
+    for (long z = 0; z < (long) dim.z; ++z)
+        for (long y = 0; y < (long) dim.y; ++y)
+        {
+            size_t row = (z * dim.y + y) * dim.x;
+            double dyz2 = double((z - cz) * (z - cz) + (y - cy) * (y - cy));
+            // Range [x0, x1) of the row inside the circle
+            long x0 = 0, x1 = 0;
+
+            if (dyz2 <= r2)
+            {
+                auto w = (long) floor(sqrt(r2 - dyz2));
+                x0 = std::max(0L, cx - w);
+                x1 = std::min((long) dim.x, cx + w + 1);
+            }
+
+            if (inside)
+                mask.addSpan(row + x0, x1 - x0);
+            else if (x1 > x0)
+            {
+                mask.addSpan(row, x0);
+                mask.addSpan(row + x1, dim.x - x1);
+            }
+            else
+                mask.addSpan(row, dim.x);
+        }
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    auto it = index.find(key);
+
+    // Another thread could have generated the same mask meanwhile
+    if (it != index.end())
+        return it->second->second;
+
+    entries.emplace_front(key, maskPtr);
+    index[key] = entries.begin();
+
+    if (entries.size() > STATS_MASK_CACHE)
+    {
+        index.erase(entries.back().first);
+        entries.pop_back();
+    }
+
+    return maskPtr;
+} // function StatsMask.circular
+
+const ArrayDim& StatsMask::getDim() const
+{
+    return dim;
+} // function StatsMask.getDim
+
+size_t StatsMask::getCount() const
+{
+    return count;
+} // function StatsMask.getCount
+
+const std::vector<StatsMask::Span>& StatsMask::getSpans() const
+{
+    return spans;
+} // function StatsMask.getSpans
+
+// -------------- Histogram Implementation ---------------------------
+
+/** Minimum number of elements to be counted by each thread */
+#define HIST_MIN_CHUNK (1 << 18)
+
+/** Count the values in each bin, given by the function binOf (that should
+ * return a negative value for values that are not counted). Each thread
+ * counts in its own histogram and all of them are added at the end. */
+template <typename T, typename BinFunc>
+std::vector<size_t> countBins(const T * data, size_t size, size_t bins,
+                              BinFunc binOf)
+{
+    size_t chunks = Thread::getChunks(size, 0, HIST_MIN_CHUNK);
+    std::vector<std::vector<size_t>> partials(std::max(chunks, (size_t) 1));
+    partials[0].assign(bins, 0);
+
+    Thread::parallelFor(size, [&](size_t start, size_t end, size_t chunk)
+    {
+        auto& counts = partials[chunk];
+        counts.assign(bins, 0);
+        for (size_t i = start; i < end; ++i)
+        {
+            long b = binOf(data[i]);
+            if (b >= 0)
+                ++counts[b];
+        }
+    }, chunks, HIST_MIN_CHUNK);
+
+    auto& total = partials[0];
+    for (size_t c = 1; c < chunks; ++c)
+        for (size_t b = 0; b < bins; ++b)
+            total[b] += partials[c][b];
+
+    return total;
+} // template function countBins<T>
+
+template <typename T>
+Histogram computeHistogram(const T * data, size_t size, size_t bins,
+                           double min, double max)
+{
+    ASSERT_ERROR(bins == 0, "Histogram should have at least one bin.");
+
+    Histogram h;
+    h.min = min;
+    h.max = max;
+    double scale = max > min ? bins / (max - min) : 0;
+    long last = bins - 1;
+
+    h.counts = countBins(data, size, bins, [=](T value) -> long
+    {
+        double v = static_cast<double>(value);
+        if (!(v >= min && v <= max))  // Also discard NaN values
+            return -1;
+        return std::min(static_cast<long>((v - min) * scale), last);
+    });
+
+    return h;
+} // template function computeHistogram<T>
+
+Histogram Histogram::compute(const Type &type, const void *memory, size_t n,
+                             size_t bins, double min, double max)
+{
+#define HIST_IF(T) if (type == Type::get<T>()) \
+        return computeHistogram(static_cast<const T*>(memory), n, bins, min, max)
+    HIST_IF(float);
+    HIST_IF(double);
+    HIST_IF(int8_t);
+    HIST_IF(uint8_t);
+    HIST_IF(int16_t);
+    HIST_IF(uint16_t);
+    HIST_IF(int32_t);
+    HIST_IF(uint32_t);
+    HIST_IF(int64_t);
+    HIST_IF(uint64_t);
+    THROW_ERROR(std::string("Histogram can not be computed for type: ")
+                + type.getName());
+#undef HIST_IF
+} // Histogram.compute
+
+Histogram Histogram::compute(const Array &array, size_t bins,
+                             double min, double max)
+{
+    return compute(array.getType(), array.getData(),
+                   array.getDim().getSize(), bins, min, max);
+} // Histogram.compute
+
+Histogram Histogram::compute(const Array &array, size_t bins)
+{
+    auto s = Stats::compute(array, Stats::MIN_MAX);
+    return compute(array, bins, s.min, s.max);
+} // Histogram.compute
+
+size_t Histogram::getTotal() const
+{
+    size_t total = 0;
+    for (auto c: counts)
+        total += c;
+    return total;
+} // Histogram.getTotal
+
+double Histogram::getQuantile(double q) const
+{
+    size_t total = getTotal();
+    ASSERT_ERROR(total == 0, "Quantile can not be computed without values.");
+
+    double rank = std::max(0.0, std::min(1.0, q)) * (total - 1);
+    double width = (max - min) / counts.size();
+    size_t cum = 0;
+
+    for (size_t b = 0; b < counts.size(); ++b)
+    {
+        if (counts[b] > 0 && cum + counts[b] > rank)
+            return min + width * (b + (rank - cum + 0.5) / counts[b]);
+        cum += counts[b];
+    }
+
+    return max;
+} // Histogram.getQuantile
+
+/** Map a float to an unsigned key with the same order */
+static inline uint32_t _floatToKey(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+} // function _floatToKey
+
+/** Inverse of _floatToKey */
+static inline float _keyToFloat(uint32_t key)
+{
+    uint32_t bits = (key & 0x80000000u) ? key & 0x7FFFFFFFu : ~key;
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+} // function _keyToFloat
+
+/** Counts of the values in buckets, from which the value at a given rank
+ * (position in the sorted values) can be found. */
+struct RankCounts
+{
+    std::vector<size_t> cumulative;  // Number of values up to each bucket
+    bool exact;  // Each bucket only contains one value
+    double offset;  // Value of the first bucket when exact
+
+    RankCounts(const std::vector<size_t> &counts, bool exact, double offset):
+            cumulative(counts), exact(exact), offset(offset)
+    {
+        for (size_t b = 1; b < cumulative.size(); ++b)
+            cumulative[b] += cumulative[b - 1];
+    }
+
+    size_t getTotal() const
+    {
+        return cumulative.back();
+    }
+
+    double valueAt(size_t rank) const
+    {
+        auto it = std::upper_bound(cumulative.begin(), cumulative.end(), rank);
+        size_t b = it - cumulative.begin();
+
+        if (exact)
+            return offset + b;
+
+        // Values are assumed to be spread uniformly in the bucket
+        size_t first = b > 0 ? cumulative[b - 1] : 0;
+        double lo = _keyToFloat(uint32_t(b << 16));
+        double hi = _keyToFloat(uint32_t(b << 16 | 0xFFFF));
+        if (!std::isfinite(lo) || !std::isfinite(hi))
+            return std::isfinite(lo) ? lo : hi;
+        return lo + (hi - lo) * (rank - first + 0.5) / (*it - first);
+    }
+
+    /** Quantile with linear interpolation between the closest ranks */
+    double quantile(double q) const
+    {
+        double pos = std::max(0.0, std::min(1.0, q)) * (getTotal() - 1);
+        size_t rank = static_cast<size_t>(pos);
+        double v = valueAt(rank);
+
+        if (pos > rank)
+            v += (pos - rank) * (valueAt(rank + 1) - v);
+
+        return v;
+    }
+}; // struct RankCounts
+
+/** Count integer values exactly, with one bucket per possible value */
+template <typename T>
+RankCounts countExact(const T * data, size_t n)
+{
+    long offset = std::numeric_limits<T>::min();
+    size_t bins = size_t(std::numeric_limits<T>::max() - offset) + 1;
+    auto counts = countBins(data, n, bins, [=](T value) -> long
+    {
+        return long(value) - offset;
+    });
+    return RankCounts(counts, true, offset);
+} // template function countExact<T>
+
+/** Count values in the buckets of the sketch, given by the 16 most
+ * significant bits of the ordered float representation */
+template <typename T>
+RankCounts countSketch(const T * data, size_t n)
+{
+    auto counts = countBins(data, n, 1 << 16, [](T value) -> long
+    {
+        float v = static_cast<float>(value);
+        if (v != v)  // NaN values are not counted
+            return -1;
+        return long(_floatToKey(v) >> 16);
+    });
+    return RankCounts(counts, false, 0);
+} // template function countSketch<T>
+
+std::vector<double> Histogram::quantiles(const Type &type, const void *memory,
+                                         size_t n, const std::vector<double> &qs)
+{
+    ASSERT_ERROR(n == 0, "Quantiles can not be computed without values.");
+
+#define COUNT_IF(T, func) if (type == Type::get<T>()) \
+        return func(static_cast<const T*>(memory), n)
+    auto rankCounts = [&]() -> RankCounts
+    {
+        COUNT_IF(int8_t, countExact);
+        COUNT_IF(uint8_t, countExact);
+        COUNT_IF(int16_t, countExact);
+        COUNT_IF(uint16_t, countExact);
+        COUNT_IF(float, countSketch);
+        COUNT_IF(double, countSketch);
+        COUNT_IF(int32_t, countSketch);
+        COUNT_IF(uint32_t, countSketch);
+        COUNT_IF(int64_t, countSketch);
+        COUNT_IF(uint64_t, countSketch);
+        THROW_ERROR(std::string("Quantiles can not be computed for type: ")
+                    + type.getName());
+    }();
+#undef COUNT_IF
+
+    ASSERT_ERROR(rankCounts.getTotal() == 0,
+                 "Quantiles can not be computed without values.");
+
+    std::vector<double> result;
+    for (auto q: qs)
+        result.push_back(rankCounts.quantile(q));
+
+    return result;
+} // Histogram.quantiles
+
+std::vector<double> Histogram::quantiles(const Array &array,
+                                         const std::vector<double> &qs)
+{
+    return quantiles(array.getType(), array.getData(),
+                     array.getDim().getSize(), qs);
+} // Histogram.quantiles
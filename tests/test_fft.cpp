@@ -7,6 +7,9 @@
 
 #include "emc/os/filesystem.h"
 #include "emc/proc/fft.h"
+#include "emc/proc/correlation.h"
+#include "emc/proc/convolution.h"
+#include "emc/os/thread.h"
 #include "emc/base/legacy.h"
 #include "emc/math/functions.h"
 
@@ -192,51 +195,414 @@ TEST(FourierTransformer, shift)
     Image img1, img2, img3;
 
     for (auto adim: {ArrayDim(4), ArrayDim(5),
-                     ArrayDim(4, 4), ArrayDim(5, 5)})
+                     ArrayDim(4, 4), ArrayDim(5, 5),
+                     ArrayDim(4, 5), ArrayDim(6, 3, 1, 2),
+                     ArrayDim(4, 4, 4), ArrayDim(3, 4, 5, 2)})
     {
         img1.resize(adim, typeFloat);
-        auto array = img1.getView<float>();
-        auto data = array.getData();
-        std::cout << "data = " << data << std::endl;
+        auto data = img1.getView<float>().getData();
 
+        // Fill it with consecutive numbers
         auto n = adim.getSize();
-        std::cout << "Number of elements: " << n << std::endl;
+        for (size_t i = 0; i < n; ++i)
+            data[i] = i;
 
-        // Fill it with consecutive numbers
-        std::cout << "Before: " << std::endl;
-        for (size_t y = 0, i = 0; y < adim.y; ++y)
+        ft.shift(img1, img2);
+        ASSERT_EQ(img2.getDim(), adim);
+        auto data2 = img2.getView<float>().getData();
+
+        // Check that the element at position i comes from position
+        // (i + ceil(dim/2)) % dim in each dimension (as in numpy.fftshift)
+        for (size_t k = 0, i = 0; k < adim.n; ++k)
+            for (size_t z = 0; z < adim.z; ++z)
+                for (size_t y = 0; y < adim.y; ++y)
+                    for (size_t x = 0; x < adim.x; ++x, ++i)
+                    {
+                        size_t sx = (x + adim.x - adim.x / 2) % adim.x;
+                        size_t sy = (y + adim.y - adim.y / 2) % adim.y;
+                        size_t sz = (z + adim.z - adim.z / 2) % adim.z;
+                        size_t si = ((k * adim.z + sz) * adim.y + sy) * adim.x + sx;
+                        ASSERT_FLOAT_EQ(data2[i], data[si]);
+                    }
+
+        // The in-place shift should give the same result
+        img3 = img1;
+        ft.shift(img3);
+        ASSERT_EQ(img3, img2);
+
+        // Backward shift should restore the original values
+        ft.shift(img2, img3, FT::BACKWARD);
+        ASSERT_EQ(img3, img1);
+        ft.shift(img2, FT::BACKWARD);
+        ASSERT_EQ(img2, img1);
+    }
+} // TEST FourierTransformer.shift
+
+TEST(FourierTransformer, implicitShift)
+{
+    FourierTransformer ft;
+
+    for (auto adim: {ArrayDim(8, 6), ArrayDim(6, 4, 4), ArrayDim(7, 4, 6)})
+    {
+        Image rImg(adim, typeFloat), rImg2, fImg1, fImg2, fShifted;
+        auto data = rImg.getView<float>().getData();
+        for (size_t i = 0; i < adim.getSize(); ++i)
+            data[i] = (i * 7) % 11;
+        rImg2 = rImg;
+
+        ft.forward(rImg, fImg1);
+        auto fdim = fImg1.getDim();
+        ft.shift(fImg1, fShifted);
+        auto shifted = fShifted.getView<cfloat>();
+
+        ft.forward(rImg2, fImg2, true);
+        ASSERT_EQ(fImg2.getDim(), fdim);
+        auto modulated = fImg2.getView<cfloat>();
+
+        // The whole output should match the explicit shift along Y and Z,
+        // while X is not shifted, so the column of shift() that came from
+        // column x is compared
+        for (size_t z = 0; z < fdim.z; ++z)
+            for (size_t y = 0; y < fdim.y; ++y)
+                for (size_t x = 0; x < fdim.x; ++x)
+                {
+                    auto expected = shifted((x + fdim.x / 2) % fdim.x, y, z);
+                    auto value = modulated(x, y, z);
+                    ASSERT_NEAR(value.real(), expected.real(), 1e-3);
+                    ASSERT_NEAR(value.imag(), expected.imag(), 1e-3);
+                }
+
+        // The backward transform should undo the modulation
+        Image rOut(adim, typeFloat);
+        ft.backward(fImg2, rOut, true);
+        auto outData = rOut.getView<float>().getData();
+        for (size_t i = 0; i < adim.getSize(); ++i)
+            ASSERT_NEAR(outData[i], data[i], 1e-3);
+    }
+} // TEST FourierTransformer.implicitShift
+
+TEST(FourierTransformer, batch)
+{
+    FourierTransformer ft;
+    ArrayDim adim(10, 6), sdim(10, 6, 1, 3);
+    Image stack(sdim, typeFloat), fStack, rStack, item(adim, typeFloat), fItem;
+    auto data = static_cast<float *>(stack.getData());
+    for (size_t i = 0; i < sdim.getSize(); ++i)
+        data[i] = (i * 13) % 17;
+
+    // All items are transformed as if they were done one by one
+    ft.forward(stack, fStack);
+    ASSERT_EQ(fStack.getDim(), ArrayDim(6, 6, 1, 3));
+    size_t itemSize = adim.getSize(), fSize = 36;
+    auto fData = static_cast<const cfloat *>(fStack.getData());
+
+    for (size_t n = 0; n < sdim.n; ++n)
+    {
+        memcpy(item.getData(), data + n * itemSize, itemSize * sizeof(float));
+        ft.forward(item, fItem);
+        auto fItemData = static_cast<const cfloat *>(fItem.getData());
+        for (size_t i = 0; i < fSize; ++i)
         {
-            for (size_t x = 0; x < adim.x; ++x)
+            ASSERT_NEAR(fData[n * fSize + i].real(), fItemData[i].real(), 1e-3);
+            ASSERT_NEAR(fData[n * fSize + i].imag(), fItemData[i].imag(), 1e-3);
+        }
+    }
+
+    // Each item is normalized by its own size in the backward transform
+    rStack.resize(sdim, typeFloat);
+    ft.backward(fStack, rStack);
+    auto rData = static_cast<const float *>(rStack.getData());
+    for (size_t i = 0; i < sdim.getSize(); ++i)
+        ASSERT_NEAR(rData[i], data[i], 1e-3);
+} // TEST FourierTransformer.batch
+
+TEST(FourierTransformer, window3D)
+{
+    FourierTransformer ft;
+
+    // Scaling a constant volume should give a constant volume, check
+    // with both float and double types to use both implementations
+    for (auto type: {typeFloat, typeDouble, typeFloat})
+    {
+        Image rImg(ArrayDim(8, 8, 8), type), rImg2;
+        rImg.set(2);
+        ft.scale(rImg, rImg2, 16);
+        ASSERT_EQ(rImg2.getDim(), ArrayDim(16, 16, 16));
+        ASSERT_EQ(rImg2.getType(), type);
+
+        Image rImg3(rImg2.getDim(), typeDouble);
+        rImg3.copy(rImg2);
+        auto data = rImg3.getView<double>().getData();
+        for (size_t i = 0; i < rImg3.getDim().getSize(); ++i)
+            ASSERT_NEAR(data[i], 2 * 512.0 / 4096, 1e-5);
+    }
+
+    // Enlarge and reduce back the FT of a volume, the frequencies
+    // outside the sphere should be zero and the rest unchanged
+    ArrayDim adim(8, 8, 8);
+    Image rImg(adim, typeFloat), fImg, fImg2, fImg3;
+    auto data = rImg.getView<float>().getData();
+    for (size_t i = 0; i < adim.getSize(); ++i)
+        data[i] = (i * 7) % 11;
+
+    ft.forward(rImg, fImg);
+    ft.windowFT(fImg, fImg2, 16);
+    ASSERT_EQ(fImg2.getDim(), ArrayDim(9, 16, 16));
+    ft.windowFT(fImg2, fImg3, 8);
+    ASSERT_EQ(fImg3.getDim(), fImg.getDim());
+
+    auto fdim = fImg.getDim();
+    auto in = fImg.getView<cfloat>();
+    auto out = fImg3.getView<cfloat>();
+    for (size_t z = 0; z < fdim.z; ++z)
+        for (size_t y = 0; y < fdim.y; ++y)
+            for (size_t x = 0; x < fdim.x; ++x)
             {
-                array(x, y) = ++i;
-                std::cout << array(x, y) << " ";
+                long zp = z < fdim.x ? z : (long) z - 8;
+                long yp = y < fdim.x ? y : (long) y - 8;
+                long r2 = zp * zp + yp * yp + x * x;
+                auto expected = r2 <= 16 ? in(x, y, z) : cfloat(0);
+                ASSERT_EQ(out(x, y, z), expected);
             }
-            std::cout << std::endl;
+
+    // Reducing a 2D FT
+    Image rImg2D(ArrayDim(8, 8), typeFloat), fImg2D, fSmall;
+    rImg2D.set(1);
+    ft.forward(rImg2D, fImg2D);
+    ft.windowFT(fImg2D, fSmall, 4);
+    ASSERT_EQ(fSmall.getDim(), ArrayDim(3, 4));
+    auto small = fSmall.getView<cfloat>();
+    ASSERT_NEAR(small(0, 0).real(), 64, 1e-3);
+    ASSERT_NEAR(std::abs(small(1, 1)), 0, 1e-3);
+
+    // Every item of a stack is windowed as if it was done alone
+    ArrayDim sdim(8, 8, 1, 3);
+    Image rStack(sdim, typeFloat), fStack, fStack2, rItem, fItem, fItem2;
+    auto sdata = static_cast<float *>(rStack.getData());
+    for (size_t i = 0; i < sdim.getSize(); ++i)
+        sdata[i] = (i * 5) % 13;
+
+    ft.forward(rStack, fStack);
+    ft.windowFT(fStack, fStack2, 12);
+    ASSERT_EQ(fStack2.getDim(), ArrayDim(7, 12, 1, 3));
+    auto sOut = static_cast<const cfloat *>(fStack2.getData());
+    size_t itemSize = sdim.getItemSize(), fSize = 7 * 12;
+
+    for (size_t n = 0; n < sdim.n; ++n)
+    {
+        rItem.resize(ArrayDim(8, 8), typeFloat);
+        memcpy(rItem.getData(), sdata + n * itemSize, itemSize * sizeof(float));
+        ft.forward(rItem, fItem);
+        ft.windowFT(fItem, fItem2, 12);
+        auto iOut = static_cast<const cfloat *>(fItem2.getData());
+        for (size_t i = 0; i < fSize; ++i)
+        {
+            ASSERT_NEAR(sOut[n * fSize + i].real(), iOut[i].real(), 1e-3);
+            ASSERT_NEAR(sOut[n * fSize + i].imag(), iOut[i].imag(), 1e-3);
         }
+    }
+} // TEST FourierTransformer.window3D
 
-        img2.resize(adim, typeFloat);
-        ft.shift(img1, img2);
+/** Fill the image with a random pattern circularly shifted by (sx, sy, sz) */
+static void fillShifted(Image &img, long sx, long sy, long sz)
+{
+    auto adim = img.getDim();
+    auto data = img.getView<float>();
+    long X = adim.x, Y = adim.y, Z = adim.z;
 
-        std::cout << "After ft.shift: " << std::endl;
-        auto array2 = img2.getView<float>();
-        for (size_t y = 0; y < adim.y; ++y)
+    for (long z = 0; z < Z; ++z)
+        for (long y = 0; y < Y; ++y)
+            for (long x = 0; x < X; ++x)
+            {
+                long i = ((z - sz + Z) % Z * Y + (y - sy + Y) % Y) * X
+                         + (x - sx + X) % X;
+                data(x, y, z) = (i * 37 + 11) % 23;
+            }
+} // function fillShifted
+
+TEST(Correlator, Basic)
+{
+    ArrayDim adim(32, 24);
+    Image ref(adim, typeFloat), img(adim, typeFloat), ccMap;
+    fillShifted(ref, 0, 0, 0);
+
+    for (auto mode: {Correlator::CROSS, Correlator::NORMALIZED,
+                     Correlator::PHASE})
+    {
+        Correlator corr(mode);
+        corr.setReference(ref);
+
+        // The reference FT is reused for all images
+        for (auto shift: {std::make_pair(5, -3), std::make_pair(-7, 2),
+                          std::make_pair(0, 0)})
         {
-            for (size_t x = 0; x < adim.x; ++x)
-                std::cout << array2(x, y) << " ";
-            std::cout << std::endl;
+            fillShifted(img, shift.first, shift.second, 0);
+            corr.correlate(img, ccMap);
+            ASSERT_EQ(ccMap.getDim(), adim);
+
+            auto peak = Correlator::getPeak(ccMap);
+            ASSERT_NEAR(peak.x, shift.first, 0.5);
+            ASSERT_NEAR(peak.y, shift.second, 0.5);
+            ASSERT_EQ(peak.z, 0);
+            if (mode == Correlator::NORMALIZED)
+            {
+                ASSERT_NEAR(peak.value, 1, 1e-3);
+            }
+            else if (mode == Correlator::PHASE)  // Some FT values are zero
+            {
+                ASSERT_NEAR(peak.value, 1, 0.02);
+            }
         }
 
-        img3.resize(adim, typeFloat);
-        ft.shift(img2, img3, FT::BACKWARD);
-        auto array3 = img3.getView<float>();
-        for (size_t y = 0; y < adim.y; ++y)
+        // A stack is correlated item by item against the same reference
+        Image stack(ArrayDim(adim.x, adim.y, 1, 2), typeFloat), maps;
+        size_t itemSize = adim.getSize();
+        auto stackData = static_cast<float *>(stack.getData());
+        fillShifted(img, 5, -3, 0);
+        memcpy(stackData, img.getData(), itemSize * sizeof(float));
+        corr.correlate(img, ccMap);
+        fillShifted(img, -7, 2, 0);
+        memcpy(stackData + itemSize, img.getData(), itemSize * sizeof(float));
+        corr.correlate(stack, maps);
+        ASSERT_EQ(maps.getDim(), stack.getDim());
+        auto mapsData = static_cast<const float *>(maps.getData());
+        auto mapData = static_cast<const float *>(ccMap.getData());
+        for (size_t i = 0; i < itemSize; ++i)
+            ASSERT_FLOAT_EQ(mapsData[i], mapData[i]);
+        Image second(adim, typeFloat, const_cast<float *>(mapsData) + itemSize);
+        auto peak = Correlator::getPeak(second);
+        ASSERT_NEAR(peak.x, -7, 0.5);
+        ASSERT_NEAR(peak.y, 2, 0.5);
+
+        // One peak per item, each with its own shift
+        std::vector<CorrPeak> peaks;
+        Correlator::getPeak(maps, peaks);
+        ASSERT_EQ(peaks.size(), 2);
+        ASSERT_NEAR(peaks[0].x, 5, 0.5);
+        ASSERT_NEAR(peaks[0].y, -3, 0.5);
+        ASSERT_EQ(peaks[0].z, 0);
+        ASSERT_NEAR(peaks[1].x, -7, 0.5);
+        ASSERT_NEAR(peaks[1].y, 2, 0.5);
+        ASSERT_EQ(peaks[1].z, 0);
+        ASSERT_DOUBLE_EQ(peaks[1].value, peak.value);
+
+        std::vector<CorrPeak> found;
+        corr.findPeak(stack, found);
+        ASSERT_EQ(found.size(), 2);
+        for (size_t i = 0; i < 2; ++i)
         {
-            for (size_t x = 0; x < adim.x; ++x)
-            std::cout << array3(x, y) << " ";
-            std::cout << std::endl;
+            ASSERT_DOUBLE_EQ(found[i].x, peaks[i].x);
+            ASSERT_DOUBLE_EQ(found[i].y, peaks[i].y);
         }
+        ASSERT_THROW(Correlator::getPeak(maps), Error);
+    }
 
-        std::cout << std::endl << std::endl;
+    // The normalized correlation should not depend on scale and offset
+    Image img2(adim, typeDouble);
+    fillShifted(img, 3, 4, 0);
+    img2.copy(img, typeDouble);
+    img2 *= 2;
+    img2 += 7;
+    Correlator ncc(Correlator::NORMALIZED);
+    ncc.setReference(ref);
+    auto peak = ncc.findPeak(img2);
+    ASSERT_NEAR(peak.x, 3, 0.5);
+    ASSERT_NEAR(peak.y, 4, 0.5);
+    ASSERT_NEAR(peak.value, 1, 1e-3);
+
+    // Sub-pixel peak of a Gaussian blob
+    auto blob = [](Image &im, double cx, double cy)
+    {
+        auto d = im.getView<float>();
+        auto dim = im.getDim();
+        for (size_t y = 0; y < dim.y; ++y)
+            for (size_t x = 0; x < dim.x; ++x)
+                d(x, y) = exp(-((x - cx) * (x - cx) + (y - cy) * (y - cy)) / 8);
+    };
+    blob(ref, 16, 12);
+    blob(img, 18.3, 10.6);
+    Correlator cc;
+    cc.correlate(ref, img, ccMap);
+    peak = Correlator::getPeak(ccMap);
+    ASSERT_NEAR(peak.x, 2.3, 0.15);
+    ASSERT_NEAR(peak.y, -1.4, 0.15);
+
+    // Volumes
+    ArrayDim vdim(8, 8, 8);
+    Image vref(vdim, typeFloat), vimg(vdim, typeFloat);
+    fillShifted(vref, 0, 0, 0);
+    fillShifted(vimg, 2, 1, -1);
+    Correlator pc(Correlator::PHASE);
+    pc.setReference(vref);
+    peak = pc.findPeak(vimg);
+    ASSERT_NEAR(peak.x, 2, 1e-3);
+    ASSERT_NEAR(peak.y, 1, 1e-3);
+    ASSERT_NEAR(peak.z, -1, 1e-3);
+} // TEST Correlator.Basic
+
+TEST(Convolver, Basic)
+{
+    ArrayDim adim(100, 73), kdim(7, 6);
+    Image img(adim, typeFloat), kernel(kdim, typeFloat);
+    auto data = img.getView<float>();
+    for (size_t y = 0; y < adim.y; ++y)
+        for (size_t x = 0; x < adim.x; ++x)
+            data(x, y) = ((x * 13 + y * 7) % 17) / 17.f;
+    auto kData = kernel.getView<float>();
+    for (size_t y = 0; y < kdim.y; ++y)
+        for (size_t x = 0; x < kdim.x; ++x)
+            kData(x, y) = float(x) - 2 * y + 0.5f;
+
+    for (bool correlate: {false, true})
+    {
+        // Expected values computed with the definition
+        Image expected(adim, typeFloat);
+        auto eData = expected.getView<float>();
+        long cx = kdim.x / 2, cy = kdim.y / 2;
+        for (long y = 0; y < (long) adim.y; ++y)
+            for (long x = 0; x < (long) adim.x; ++x)
+            {
+                double sum = 0;
+                for (long j = 0; j < (long) kdim.y; ++j)
+                    for (long i = 0; i < (long) kdim.x; ++i)
+                    {
+                        long xx = correlate ? x + i - cx : x - i + cx;
+                        long yy = correlate ? y + j - cy : y - j + cy;
+                        if (xx >= 0 && xx < (long) adim.x &&
+                            yy >= 0 && yy < (long) adim.y)
+                            sum += data(xx, yy) * kData(i, j);
+                    }
+                eData(x, y) = sum;
+            }
+
+        for (auto method: {Convolver::DIRECT, Convolver::FULL_FFT,
+                           Convolver::TILED_FFT})
+        {
+            Convolver conv(method);
+            // Force small tiles to have several of them in several threads
+            Thread::setDefaultThreads(3);
+            conv.setMaxFftSize(32);
+            conv.setKernel(kernel, correlate);
+            Image out;
+            conv.apply(img, out);
+            Thread::setDefaultThreads(0);
+            ASSERT_EQ(out.getDim(), adim);
+            auto oData = out.getView<float>();
+            for (size_t y = 0; y < adim.y; ++y)
+                for (size_t x = 0; x < adim.x; ++x)
+                    ASSERT_NEAR(oData(x, y), eData(x, y), 1e-3);
+        }
     }
 
-}
\ No newline at end of file
+    // Automatic selection of the method
+    Convolver conv;
+    Image small(ArrayDim(3, 3), typeFloat), big(ArrayDim(255, 255), typeFloat);
+    conv.setKernel(small);
+    ASSERT_EQ(conv.getMethod(ArrayDim(4096, 4096)), Convolver::DIRECT);
+    conv.setKernel(big);
+    ASSERT_EQ(conv.getMethod(ArrayDim(512, 512)), Convolver::FULL_FFT);
+    ASSERT_EQ(conv.getMethod(ArrayDim(11520, 11520)), Convolver::TILED_FFT);
+    auto tileDim = conv.getTileDim(ArrayDim(11520, 11520), Convolver::TILED_FFT);
+    ASSERT_LE(tileDim.x, 2048);
+    ASSERT_GE(tileDim.x, 510);
+} // TEST Convolver.Basic
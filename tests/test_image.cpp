@@ -3,11 +3,21 @@
 //
 
 #include <iostream>
+#include <fstream>
+#include <iterator>
+#include <unistd.h>
 #include "gtest/gtest.h"
+#include "tiffio.h"
 
 #include "emc/base/error.h"
 #include "emc/base/image.h"
+#include "emc/base/image_cache.h"
+#include "emc/base/image_reader.h"
+#include "emc/base/image_writer.h"
+#include "emc/base/table.h"
 #include "emc/base/timer.h"
+#include "emc/os/thread.h"
+#include "emc/proc/stats.h"
 
 #include "test_common.h"
 
@@ -205,6 +215,694 @@ TEST(ImageFile, WriteStack)
     output.close();
 }
 
+TEST(MrcFile, HeaderStats)
+{
+    // Write a stack, header stats should be computed from all images
+    std::string fn = "test_header_stats.mrcs";
+    ArrayDim adim(16, 8, 1, 1);
+    Image img(adim, typeFloat), all(ArrayDim(16, 8, 1, 3), typeFloat);
+    auto allData = static_cast<float *>(all.getData());
+    ImageFile output(fn, File::TRUNCATE);
+
+    for (size_t i = 1; i <= 3; ++i)
+    {
+        auto data = static_cast<float *>(img.getData());
+        for (size_t j = 0; j < adim.getSize(); ++j)
+            *allData++ = data[j] = (j * i) % 7 - float(i);
+        output.write(i, img);
+    }
+    output.close();
+
+    auto expected = Stats::compute(all);
+    FILE * file = fopen(fn.c_str(), "r");
+    float values[4];
+    fseek(file, 76, SEEK_SET);
+    ASSERT_EQ(fread(values, sizeof(float), 3, file), 3);
+    fseek(file, 216, SEEK_SET);
+    ASSERT_EQ(fread(values + 3, sizeof(float), 1, file), 1);
+    fclose(file);
+    ASSERT_FLOAT_EQ(values[0], expected.min);
+    ASSERT_FLOAT_EQ(values[1], expected.max);
+    ASSERT_FLOAT_EQ(values[2], expected.mean);
+    ASSERT_FLOAT_EQ(values[3], expected.std);
+
+    // Read the stack with the accumulator, one image at a time
+    ImageFile input(fn, File::READ_ONLY);
+    StatsAccumulator acc;
+    auto itemStats = acc.add(input);
+    input.close();
+    ASSERT_EQ(itemStats.size(), 3);
+    ASSERT_FLOAT_EQ(itemStats[2].min, -3);
+    ASSERT_EQ(acc.getCount(), all.getDim().getSize());
+    ASSERT_NEAR(acc.getStats().mean, expected.mean, 1e-6);
+    ASSERT_NEAR(acc.getStats().std, expected.std, 1e-6);
+
+    // Append one image to the existing file, its stats are merged with
+    // the ones in the header without reading the other images
+    auto readHeaderStats = [&]()
+    {
+        file = fopen(fn.c_str(), "r");
+        fseek(file, 76, SEEK_SET);
+        ASSERT_EQ(fread(values, sizeof(float), 3, file), 3);
+        fseek(file, 216, SEEK_SET);
+        ASSERT_EQ(fread(values + 3, sizeof(float), 1, file), 1);
+        fclose(file);
+    };
+    Image all4(ArrayDim(16, 8, 1, 4), typeFloat);
+    auto all4Data = static_cast<float *>(all4.getData());
+    memcpy(all4Data, all.getData(), all.getDim().getSize() * sizeof(float));
+    std::fill(all4Data + 3 * adim.getSize(), all4Data + 4 * adim.getSize(), 50);
+    ImageFile append(fn, File::READ_WRITE);
+    img.set(50);
+    append.write(4, img);
+    append.close();
+    expected = Stats::compute(all4);
+    readHeaderStats();
+    ASSERT_FLOAT_EQ(values[0], expected.min);
+    ASSERT_FLOAT_EQ(values[1], expected.max);
+    ASSERT_NEAR(values[2], expected.mean, 1e-4);
+    ASSERT_NEAR(values[3], expected.std, 1e-4);
+
+    // Set the cell size and a label, that should be kept when updating
+    // the header stats of an existing file
+    float cella[3] = {32, 16, 2};
+    const char label[] = "Keep this label";
+    file = fopen(fn.c_str(), "r+");
+    fseek(file, 40, SEEK_SET);
+    fwrite(cella, sizeof(float), 3, file);
+    fseek(file, 224, SEEK_SET);
+    fwrite(label, 1, sizeof(label), file);
+    fclose(file);
+
+    // Overwrite one image, the header stats still include the old values
+    // of the image, so all stats are marked as not well determined
+    ImageFile update(fn, File::READ_WRITE);
+    img.set(100);
+    update.write(2, img);
+    update.close();
+    readHeaderStats();
+    ASSERT_LT(values[1], values[0]);
+    ASSERT_LT(values[2], std::min(values[0], values[1]));
+    ASSERT_LT(values[3], 0);
+
+    float cellaRead[3];
+    char labelRead[sizeof(label)];
+    file = fopen(fn.c_str(), "r");
+    fseek(file, 40, SEEK_SET);
+    ASSERT_EQ(fread(cellaRead, sizeof(float), 3, file), 3);
+    fseek(file, 224, SEEK_SET);
+    ASSERT_EQ(fread(labelRead, 1, sizeof(label), file), sizeof(label));
+    fclose(file);
+    for (size_t i = 0; i < 3; ++i)
+        ASSERT_FLOAT_EQ(cellaRead[i], cella[i]);
+    ASSERT_STREQ(labelRead, label);
+    remove(fn.c_str());
+} // TEST MrcFile.HeaderStats
+
+TEST(ImageFile, Mapped)
+{
+    std::string fn = "test_mapped.mrcs";
+    ArrayDim adim(32, 16, 1, 1);
+    Image img(adim, typeFloat);
+    ImageFile output(fn, File::TRUNCATE);
+
+    for (size_t i = 1; i <= 4; ++i)
+    {
+        img.set(i * 10);
+        output.write(i, img);
+    }
+    // Only files opened as READ_ONLY can be mapped
+    ASSERT_THROW(output.map(), Error);
+    output.close();
+
+    ImageFile input(fn, File::READ_ONLY);
+    ASSERT_FALSE(input.isMapped());
+    input.map(ImageFile::RANDOM);
+    ASSERT_TRUE(input.isMapped());
+
+    // Images are read as views of the mapping, in any order
+    Image view;
+    for (size_t i: {3, 1, 4, 2})
+    {
+        input.read(i, view);
+        ASSERT_TRUE(view.isView());
+        ASSERT_EQ(view.getDim(), adim);
+        auto data = static_cast<const float *>(view.getData());
+        ASSERT_FLOAT_EQ(data[0], i * 10);
+        ASSERT_FLOAT_EQ(data[adim.getSize() - 1], i * 10);
+    }
+    // Changing the advice does not remap the file
+    input.map(ImageFile::SEQUENTIAL);
+    input.read(2, img);
+    ASSERT_TRUE(img.isView());
+    input.close();
+
+    // A view can be used again to read without mapping
+    input.open(fn, File::READ_ONLY);
+    input.read(4, img);
+    ASSERT_FALSE(img.isView());
+    ASSERT_FLOAT_EQ(static_cast<const float *>(img.getData())[5], 40);
+    input.close();
+    remove(fn.c_str());
+} // TEST ImageFile.Mapped
+
+TEST(ImageFile, ReadRange)
+{
+    ArrayDim adim(16, 8, 1, 1);
+    Image img(adim, typeFloat), range;
+    size_t itemSize = adim.getItemSize();
+
+    // Stacks with (SPIDER) and without (MRC) padding between images
+    for (std::string fn: {"test_range.mrcs", "test_range.stk"})
+    {
+        ImageFile output(fn, File::TRUNCATE);
+        for (size_t i = 1; i <= 5; ++i)
+        {
+            auto data = static_cast<float *>(img.getData());
+            for (size_t j = 0; j < itemSize; ++j)
+                data[j] = i * 100 + j;
+            output.write(i, img);
+        }
+        output.close();
+
+        ImageFile input(fn, File::READ_ONLY);
+        ASSERT_THROW(input.read(3, 2, range), Error);
+        ASSERT_THROW(input.read(4, 6, range), Error);
+
+        for (bool mapped: {false, true})
+        {
+            if (mapped)
+                input.map();
+
+            input.read(2, 4, range);
+            ASSERT_EQ(range.getDim(), ArrayDim(16, 8, 1, 3));
+            auto data = static_cast<const float *>(range.getData());
+            for (size_t i = 0; i < 3; ++i)
+                for (size_t j = 0; j < itemSize; ++j)
+                    ASSERT_FLOAT_EQ(data[i * itemSize + j], (i + 2) * 100 + j);
+        }
+        input.close();
+        remove(fn.c_str());
+    }
+} // TEST ImageFile.ReadRange
+
+TEST(ImageFile, ReadList)
+{
+    ArrayDim adim(16, 8, 1, 1);
+    Image img(adim, typeFloat), list;
+    size_t itemSize = adim.getItemSize();
+    size_t n = 200;
+
+    // More indexes than the depth of the ring and some of them repeated
+    std::vector<size_t> indexes;
+    for (size_t i = 0; i < 300; ++i)
+        indexes.push_back(i * 37 % n + 1);
+
+    for (std::string fn: {"test_list.mrcs", "test_list.stk"})
+    {
+        ImageFile output(fn, File::TRUNCATE);
+        output.createEmpty(ArrayDim(16, 8, 1, n), typeFloat);
+        for (size_t i = 1; i <= n; ++i)
+        {
+            auto data = static_cast<float *>(img.getData());
+            for (size_t j = 0; j < itemSize; ++j)
+                data[j] = i * 1000 + j;
+            output.write(i, img);
+        }
+        output.close();
+
+        ImageFile input(fn, File::READ_ONLY);
+        ASSERT_EQ(input.getBackend(), ImageFile::getDefaultBackend());
+        ASSERT_THROW(input.read(std::vector<size_t>({1, n + 1}), list), Error);
+
+        for (auto backend: {ImageFile::IO_PREAD, ImageFile::IO_URING})
+        {
+            input.setBackend(backend);
+            input.read(indexes, list);
+            ASSERT_EQ(list.getDim(), ArrayDim(16, 8, 1, indexes.size()));
+            auto data = static_cast<const float *>(list.getData());
+            for (size_t i = 0; i < indexes.size(); ++i)
+                for (size_t j = 0; j < itemSize; ++j)
+                    ASSERT_FLOAT_EQ(data[i * itemSize + j],
+                                    indexes[i] * 1000 + j);
+        }
+        input.close();
+        remove(fn.c_str());
+    }
+} // TEST ImageFile.ReadList
+
+TEST(ImageFile, CacheMode)
+{
+    // Images of 280 bytes after the MRC header, so no position is aligned
+    ArrayDim adim(10, 7, 1, 1);
+    size_t itemSize = adim.getItemSize();
+    size_t n = 50;
+    std::string fn = "test_cache.mrcs";
+    Image img(adim, typeFloat), range;
+
+    for (auto mode: {ImageFile::DIRECT, ImageFile::DONTNEED})
+    {
+        ImageFile::setDefaultCacheMode(mode);
+        ImageFile output(fn, File::TRUNCATE);
+        // DIRECT falls back to DONTNEED if not supported by the file system
+        ASSERT_NE(output.getCacheMode(), ImageFile::CACHED);
+        output.createEmpty(ArrayDim(10, 7, 1, n), typeFloat);
+
+        // Write in a different order to modify the blocks more than once
+        for (size_t i = n; i > 0; --i)
+        {
+            auto data = static_cast<float *>(img.getData());
+            for (size_t j = 0; j < itemSize; ++j)
+                data[j] = i * 1000 + j + mode;
+            output.write(i, img);
+        }
+        output.close();
+        ImageFile::setDefaultCacheMode(ImageFile::CACHED);
+
+        ASSERT_EQ(Path::getFileSize(fn), 1024 + n * itemSize * 4);
+
+        ImageFile input(fn, File::READ_ONLY);
+        for (auto readMode: {ImageFile::CACHED, mode})
+        {
+            input.setCacheMode(readMode);
+            input.read(1, n, range);
+            auto data = static_cast<const float *>(range.getData());
+            for (size_t i = 0; i < n; ++i)
+                for (size_t j = 0; j < itemSize; ++j)
+                    ASSERT_FLOAT_EQ(data[i * itemSize + j],
+                                    (i + 1) * 1000 + j + mode);
+
+            input.readRegion(n, 2, 3, 0, ArrayDim(4, 2, 1), range);
+            data = static_cast<const float *>(range.getData());
+            ASSERT_FLOAT_EQ(data[0], n * 1000 + 32 + mode);
+            ASSERT_FLOAT_EQ(data[7], n * 1000 + 45 + mode);
+
+            // Lists of images with all the backends
+            std::vector<size_t> indexes = {7, 3, 42, 4, 50, 1};
+            for (auto backend: {ImageFile::IO_PREAD, ImageFile::IO_URING})
+            {
+                input.setBackend(backend);
+                input.read(indexes, range);
+                data = static_cast<const float *>(range.getData());
+                for (size_t i = 0; i < indexes.size(); ++i)
+                    for (size_t j = 0; j < itemSize; ++j)
+                        ASSERT_FLOAT_EQ(data[i * itemSize + j],
+                                        indexes[i] * 1000 + j + mode);
+            }
+        }
+        input.close();
+        remove(fn.c_str());
+    }
+} // TEST ImageFile.CacheMode
+
+static void writeEerMovie(const std::string &path, size_t frames,
+                          uint16 compression);
+
+TEST(ImageFile, ScanHeaders)
+{
+    StringVector paths = {"test_scan1.mrc", "test_scan2.mrcs",
+                          "test_scan3.stk"};
+    std::vector<ArrayDim> dims = {ArrayDim(16, 8, 1, 1),
+                                  ArrayDim(10, 10, 1, 5),
+                                  ArrayDim(8, 8, 4, 3)};
+    std::string cachePath = "test_scan.cache";
+    remove(cachePath.c_str());
+
+    for (size_t i = 0; i < paths.size(); ++i)
+    {
+        ImageFile output(paths[i], File::TRUNCATE);
+        output.createEmpty(dims[i], typeFloat);
+        output.close();
+    }
+
+    auto table = ImageFile::scanHeaders(paths, cachePath, 2);
+    ASSERT_EQ(table.getSize(), paths.size());
+    ASSERT_TRUE(Path::exists(cachePath));
+
+    for (size_t i = 0; i < paths.size(); ++i)
+    {
+        auto &row = table[i];
+        ASSERT_EQ(row["path"].toString(), paths[i]);
+        ASSERT_EQ(ArrayDim(row["x"].get<size_t>(), row["y"].get<size_t>(),
+                           row["z"].get<size_t>(), row["n"].get<size_t>()),
+                  dims[i]);
+        ASSERT_EQ(row["type"].toString(), typeFloat.getName());
+        ASSERT_EQ(row["size"].get<size_t>(), Path::getFileSize(paths[i]));
+    }
+
+    // Unchanged files are taken from the cache without opening them, so
+    // changing the cached dimensions should be seen in the results
+    std::ifstream ifs(cachePath);
+    std::string cache((std::istreambuf_iterator<char>(ifs)),
+                      std::istreambuf_iterator<char>());
+    ifs.close();
+    auto pos = cache.find(" 16 8 1 1 ");
+    ASSERT_NE(pos, std::string::npos);
+    cache.replace(pos, 10, " 32 8 1 1 ");
+    std::ofstream(cachePath) << cache;
+
+    table = ImageFile::scanHeaders(paths, cachePath);
+    ASSERT_EQ(table[0]["x"].get<size_t>(), 32);
+
+    // Modified files are scanned again
+    ImageFile output(paths[0], File::TRUNCATE);
+    output.createEmpty(ArrayDim(16, 8, 1, 2), typeFloat);
+    output.close();
+
+    table = ImageFile::scanHeaders(paths, cachePath);
+    ASSERT_EQ(table[0]["x"].get<size_t>(), 16);
+    ASSERT_EQ(table[0]["n"].get<size_t>(), 2);
+    ASSERT_EQ(table[1]["n"].get<size_t>(), 5);
+
+    // Files that can not be scanned are reported in their rows
+    std::ofstream("test_scan_bad.mrc") << "not an MRC header";
+    table = ImageFile::scanHeaders({paths[1], "test_scan_missing.mrc",
+                                    "test_scan_bad.mrc"}, cachePath);
+    ASSERT_EQ(table.getSize(), 3);
+    ASSERT_EQ(table[0]["n"].get<size_t>(), 5);
+    ASSERT_TRUE(table[0]["error"].toString().empty());
+
+    for (size_t i: {1, 2})
+    {
+        ASSERT_EQ(table[i]["type"].toString(), "null");
+        ASSERT_FALSE(table[i]["error"].toString().empty());
+    }
+    remove("test_scan_bad.mrc");
+
+    // The dimensions of EER movies depend on the default rendering,
+    // so their cached entries are only used with the same rendering
+    std::string eerPath = "test_scan.eer";
+    writeEerMovie(eerPath, 4, 65001);
+    for (auto rendering: {std::make_pair(1, 1), std::make_pair(4, 2),
+                          std::make_pair(4, 2), std::make_pair(1, 1)})
+    {
+        ImageFile::setDefaultEerRendering(rendering.first, rendering.second);
+        table = ImageFile::scanHeaders({paths[1], eerPath}, cachePath);
+        ASSERT_TRUE(table[1]["error"].toString().empty());
+        ASSERT_EQ(table[1]["x"].get<size_t>(), 16 * rendering.first);
+        ASSERT_EQ(table[1]["n"].get<size_t>(), 4 / rendering.second);
+        ASSERT_EQ(table[0]["n"].get<size_t>(), 5);
+    }
+    remove(eerPath.c_str());
+
+    for (auto &path: paths)
+        remove(path.c_str());
+    remove(cachePath.c_str());
+} // TEST ImageFile.ScanHeaders
+
+TEST(ImageFile, ReadRegion)
+{
+    std::string fn = "test_region.mrc";
+    // The second volume has rows far apart, so they are read separately
+    for (auto vdim: {ArrayDim(20, 16, 12), ArrayDim(17000, 3, 2)})
+    {
+        Image vol(vdim, typeFloat);
+        auto data = static_cast<float *>(vol.getData());
+        for (size_t i = 0; i < vdim.getSize(); ++i)
+            data[i] = i;
+        vol.write(fn);
+
+        ImageFile input(fn, File::READ_ONLY);
+        Image region;
+        ASSERT_THROW(input.readRegion(1, vdim.x - 3, 0, 0, ArrayDim(6, 2, 2),
+                                      region), Error);
+
+        for (bool mapped: {false, true})
+        {
+            if (mapped)
+                input.map(ImageFile::RANDOM);
+
+            // Sub-volume, full slices and a sub-volume casted to double
+            for (auto rdim: {ArrayDim(6, 2, 2), ArrayDim(vdim.x, vdim.y, 1)})
+            {
+                size_t x = vdim.x - rdim.x, y = vdim.y - rdim.y;
+                size_t z = vdim.z - rdim.z;
+                input.readRegion(1, x, y, z, rdim, region);
+                ASSERT_EQ(region.getDim(), rdim);
+                ASSERT_EQ(region.getType(), typeFloat);
+                auto rData = static_cast<const float *>(region.getData());
+
+                Image dRegion;
+                input.readRegion(1, x, y, z, rdim, dRegion, typeDouble);
+                ASSERT_EQ(dRegion.getType(), typeDouble);
+                auto dData = static_cast<const double *>(dRegion.getData());
+
+                for (size_t k = 0; k < rdim.z; ++k)
+                    for (size_t j = 0; j < rdim.y; ++j)
+                        for (size_t i = 0; i < rdim.x; ++i)
+                        {
+                            size_t r = (k * rdim.y + j) * rdim.x + i;
+                            float v = ((z + k) * vdim.y + y + j) * vdim.x + x + i;
+                            ASSERT_FLOAT_EQ(rData[r], v);
+                            ASSERT_DOUBLE_EQ(dData[r], v);
+                        }
+            }
+        }
+        input.close();
+        remove(fn.c_str());
+    }
+} // TEST ImageFile.ReadRegion
+
+TEST(ImageFile, ConcurrentRead)
+{
+    std::string fn = "test_concurrent.mrcs";
+    ArrayDim adim(64, 64, 1, 1);
+    Image img(adim, typeFloat);
+    ImageFile output(fn, File::TRUNCATE);
+    for (size_t i = 1; i <= 40; ++i)
+    {
+        img.set(i);
+        output.write(i, img);
+    }
+    output.close();
+
+    // All threads read from the same file, each one its own images
+    ImageFile input(fn, File::READ_ONLY);
+    std::vector<float> values(40), regionValues(40);
+    Thread::setDefaultThreads(4);
+    Thread::parallelFor(40, [&](size_t start, size_t end, size_t)
+    {
+        Image image, region;
+        for (size_t i = start; i < end; ++i)
+        {
+            input.read(i + 1, image);
+            values[i] = static_cast<const float *>(image.getData())[100];
+            input.readRegion(i + 1, 10, 10, 0, ArrayDim(4, 4), region,
+                             typeDouble);
+            regionValues[i] = static_cast<const double *>(region.getData())[5];
+        }
+    });
+    Thread::setDefaultThreads(0);
+    input.close();
+    remove(fn.c_str());
+
+    for (size_t i = 0; i < 40; ++i)
+    {
+        ASSERT_FLOAT_EQ(values[i], i + 1);
+        ASSERT_FLOAT_EQ(regionValues[i], i + 1);
+    }
+} // TEST ImageFile.ConcurrentRead
+
+TEST(ImageReader, Basic)
+{
+    std::string fn = "test_reader.mrcs";
+    ArrayDim adim(32, 32, 1, 1);
+    Image img(adim, typeFloat);
+    ImageFile output(fn, File::TRUNCATE);
+    for (size_t i = 1; i <= 10; ++i)
+    {
+        img.set(i);
+        output.write(i, img);
+    }
+    output.close();
+
+    ImageFile input(fn, File::READ_ONLY);
+
+    // Read all images, with less buffers than images
+    for (size_t prefetch: {1, 3, 20})
+    {
+        ImageReader reader(input, prefetch);
+        ASSERT_THROW(reader.getImage(), Error);
+        size_t count = 0;
+
+        while (reader.next())
+        {
+            ++count;
+            ASSERT_EQ(reader.getIndex(), count);
+            auto& image = reader.getImage();
+            ASSERT_EQ(image.getDim(), adim);
+            ASSERT_FLOAT_EQ(static_cast<const float *>(image.getData())[7],
+                            count);
+        }
+        ASSERT_EQ(count, 10);
+        ASSERT_FALSE(reader.next());
+    }
+
+    // Only a range, stopping before the end
+    {
+        ImageReader reader(input, 4, 8, 2);
+        ASSERT_TRUE(reader.next());
+        ASSERT_EQ(reader.getIndex(), 4);
+        ASSERT_TRUE(reader.next());
+        ASSERT_EQ(reader.getIndex(), 5);
+    }
+    ASSERT_THROW(ImageReader(input, 5, 11), Error);
+    input.close();
+
+    // Reading errors are re-thrown when reaching the failed image,
+    // cut the file data after the sixth image
+    truncate(fn.c_str(), 1024 + 6 * adim.getSize() * sizeof(float));
+    input.open(fn, File::READ_ONLY);
+    ImageReader reader(input, 2);
+    for (size_t i = 1; i <= 6; ++i)
+        ASSERT_TRUE(reader.next());
+    ASSERT_THROW(reader.next(), Error);
+    ASSERT_FALSE(reader.next());
+    input.close();
+    remove(fn.c_str());
+} // TEST ImageReader.Basic
+
+TEST(ImageWriter, Basic)
+{
+    ArrayDim adim(32, 16, 1, 1);
+    Image img(adim, typeFloat);
+
+    // Stacks with (SPIDER) and without (MRC) padding between images
+    for (std::string fn: {"test_writer.mrcs", "test_writer.stk"})
+    {
+        ImageFile output(fn, File::TRUNCATE);
+        ImageWriter writer(output, 3);
+
+        // Images are queued in any order, moving or copying them
+        for (size_t i: {2, 1, 3, 4, 8, 7, 6, 5})
+        {
+            img.set(i * 10);
+            if (i % 2)
+                writer.write(i, img);
+            else
+            {
+                Image moved(img);
+                writer.write(i, std::move(moved));
+                ASSERT_EQ(moved.getDim().getSize(), 0);
+            }
+        }
+        writer.flush();
+        ASSERT_EQ(output.getDim().n, 8);
+        img.set(90);
+        writer.write(9, img);
+        writer.close();
+        ASSERT_THROW(writer.write(10, img), Error);
+        output.close();
+
+        ImageFile input(fn, File::READ_ONLY);
+        ASSERT_EQ(input.getDim().n, 9);
+        for (size_t i = 1; i <= 9; ++i)
+        {
+            input.read(i, img);
+            ASSERT_FLOAT_EQ(static_cast<const float *>(img.getData())[3],
+                            i * 10);
+        }
+        input.close();
+        remove(fn.c_str());
+    }
+
+    // Errors are re-thrown from flush, images of a different type
+    // can not be written
+    std::string fn = "test_writer.mrcs";
+    ImageFile output(fn, File::TRUNCATE);
+    ImageWriter writer(output);
+    writer.write(1, img);
+    writer.write(2, Image(adim, typeDouble));
+    ASSERT_THROW(writer.flush(), Error);
+    writer.close();
+    output.close();
+    remove(fn.c_str());
+} // TEST ImageWriter.Basic
+
+TEST(ImageFileCache, Basic)
+{
+    ArrayDim adim(8, 8, 1, 1);
+    Image img(adim, typeFloat), img2;
+    StringVector fns = {"test_cache1.mrcs", "test_cache2.mrcs",
+                        "test_cache3.mrcs"};
+
+    // Write n images with values depending on the file and image index
+    auto writeStack = [&](const std::string &fn, size_t n, float offset)
+    {
+        ImageFile output(fn, File::TRUNCATE);
+        for (size_t i = 1; i <= n; ++i)
+        {
+            img.set(offset + i);
+            output.write(i, img);
+        }
+    };
+    auto getValue = [](const Image &image)
+    {
+        return static_cast<const float *>(image.getData())[0];
+    };
+
+    for (size_t i = 0; i < fns.size(); ++i)
+        writeStack(fns[i], 5, i * 10);
+
+    ImageFileCache cache(2);
+    ASSERT_THROW(cache.setMaxFiles(0), Error);
+    cache.read(ImageLocation(fns[0], 3), img2);
+    ASSERT_FLOAT_EQ(getValue(img2), 3);
+    ASSERT_EQ(cache.getSize(), 1);
+
+    auto file1 = cache.get(fns[0]);
+    ASSERT_EQ(file1.get(), cache.get(fns[0]).get());
+
+    // Opening the third file closes the least recently used one
+    cache.read(ImageLocation(fns[1], 1), img2);
+    cache.read(ImageLocation(fns[2], 5), img2);
+    ASSERT_FLOAT_EQ(getValue(img2), 25);
+    ASSERT_EQ(cache.getSize(), 2);
+    ASSERT_NE(file1.get(), cache.get(fns[0]).get());
+    // Files are kept opened while in use
+    file1->read(2, img2);
+    ASSERT_FLOAT_EQ(getValue(img2), 2);
+
+    // Modified files are opened again
+    writeStack(fns[0], 6, 100);
+    cache.read(ImageLocation(fns[0], 6), img2);
+    ASSERT_FLOAT_EQ(getValue(img2), 106);
+
+    // Read-only requests can use the handle opened for writing
+    auto file2 = cache.get(fns[1], File::READ_WRITE);
+    ASSERT_EQ(file2.get(), cache.get(fns[1]).get());
+    file2.reset();
+
+    img.set(50);
+    cache.write(ImageLocation(fns[1], 4), img);
+    ASSERT_EQ(cache.getSize(), 1);
+    cache.read(ImageLocation(fns[1], 4), img2);
+    ASSERT_FLOAT_EQ(getValue(img2), 50);
+
+    // Threads opening the same file at once end up with a single handle
+    cache.clear();
+    std::vector<ImageFile *> handles(8);
+    Thread::parallelFor(handles.size(), [&](size_t start, size_t end, size_t)
+    {
+        for (size_t i = start; i < end; ++i)
+            handles[i] = cache.get(fns[2]).get();
+    }, handles.size());
+    ASSERT_EQ(cache.getSize(), 1);
+    for (auto handle: handles)
+        ASSERT_EQ(handle, cache.get(fns[2]).get());
+
+    // The location based shortcuts use the default cache
+    auto &defaultCache = ImageFileCache::getDefault();
+    defaultCache.clear();
+    img2.read(ImageLocation(fns[2], 2));
+    ASSERT_FLOAT_EQ(getValue(img2), 22);
+    ASSERT_EQ(defaultCache.getSize(), 1);
+    defaultCache.clear();
+
+    for (auto &fn: fns)
+        remove(fn.c_str());
+} // TEST ImageFileCache.Basic
+
 TEST(Image, CreatePhantom)
 {
     Image phantomMic = Image(ArrayDim(1000, 1000), typeInt8);
@@ -220,6 +918,532 @@ TEST(Image, CreatePhantom)
 } // TEST Image.CreatePhantom
 
 
+/** Write a TIFF stack with libtiff, with the given compression and
+ * stored in strips of some rows (or in tiles if tileSize > 0), where the
+ * value of pixel (x, y) of frame i is i * 1000 + y * 10 + x.
+ * If thumbnails is true, a small thumbnail directory is written before
+ * each frame. */
+static void writeTiffStack(const std::string &path, size_t x, size_t y,
+                           size_t n, uint16 compression,
+                           uint32 rowsPerStrip, uint32 tileSize,
+                           bool thumbnails = false)
+{
+    TIFF * tif = TIFFOpen(path.c_str(), "w");
+    ASSERT_NE(tif, nullptr);
+    std::vector<uint16_t> frame(x * y);
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (thumbnails)
+        {
+            std::vector<uint8_t> thumb(4 * 4, 255);
+            TIFFSetField(tif, TIFFTAG_SUBFILETYPE, (uint32) 1);
+            TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, (uint32) 4);
+            TIFFSetField(tif, TIFFTAG_IMAGELENGTH, (uint32) 4);
+            TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+            TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+            TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+            TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, (uint32) 4);
+            TIFFWriteEncodedStrip(tif, 0, thumb.data(), thumb.size());
+            TIFFWriteDirectory(tif);
+        }
+
+        for (size_t j = 0; j < y; ++j)
+            for (size_t k = 0; k < x; ++k)
+                frame[j * x + k] = i * 1000 + j * 10 + k;
+
+        TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, (uint32) x);
+        TIFFSetField(tif, TIFFTAG_IMAGELENGTH, (uint32) y);
+        TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 16);
+        TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+        TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_UINT);
+        TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+        TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+        TIFFSetField(tif, TIFFTAG_COMPRESSION, compression);
+
+        if (tileSize > 0)
+        {
+            TIFFSetField(tif, TIFFTAG_TILEWIDTH, tileSize);
+            TIFFSetField(tif, TIFFTAG_TILELENGTH, tileSize);
+            std::vector<uint16_t> tile(tileSize * tileSize);
+
+            for (size_t ty = 0; ty < y; ty += tileSize)
+                for (size_t tx = 0; tx < x; tx += tileSize)
+                {
+                    for (size_t j = 0; j < tileSize; ++j)
+                        for (size_t k = 0; k < tileSize; ++k)
+                            tile[j * tileSize + k] =
+                                ty + j < y && tx + k < x ?
+                                frame[(ty + j) * x + tx + k] : 0;
+                    TIFFWriteEncodedTile(tif,
+                                         TIFFComputeTile(tif, tx, ty, 0, 0),
+                                         tile.data(), tile.size() * 2);
+                }
+        }
+        else
+        {
+            TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, rowsPerStrip);
+            for (size_t j = 0; j < y; j += rowsPerStrip)
+                TIFFWriteEncodedStrip(tif, j / rowsPerStrip,
+                                      frame.data() + j * x,
+                                      std::min<size_t>(rowsPerStrip, y - j)
+                                      * x * 2);
+        }
+        TIFFWriteDirectory(tif);
+    }
+    TIFFClose(tif);
+} // function writeTiffStack
+
+TEST(TiffImageFile, Read)
+{
+    size_t x = 50, y = 37, n = 3;
+    std::string fn = "test_read.tif";
+    auto threads = Thread::getDefaultThreads();
+    // Decode with several threads even in machines with one core
+    Thread::setDefaultThreads(4);
+
+    struct Layout { uint16 compression; uint32 rowsPerStrip, tileSize; };
+    for (auto layout: {Layout{COMPRESSION_NONE, 7, 0},
+                       Layout{COMPRESSION_NONE, 37, 0},
+                       Layout{COMPRESSION_LZW, 5, 0},
+                       Layout{COMPRESSION_ADOBE_DEFLATE, 1, 0},
+                       Layout{COMPRESSION_NONE, 0, 16},
+                       Layout{COMPRESSION_LZW, 0, 16}})
+    {
+        writeTiffStack(fn, x, y, n, layout.compression,
+                       layout.rowsPerStrip, layout.tileSize);
+
+        ImageFile input(fn, File::READ_ONLY);
+        ASSERT_EQ(input.getDim(), ArrayDim(x, y, 1, n));
+        ASSERT_EQ(input.getType(), typeUInt16);
+
+        // Check that the images of img are the ones at the given indexes
+        auto checkImages = [&](const Image &img,
+                               const std::vector<size_t> &indexes)
+        {
+            ASSERT_EQ(img.getDim(), ArrayDim(x, y, 1, indexes.size()));
+            auto data = static_cast<const uint16_t *>(img.getData());
+            for (auto i: indexes)
+                for (size_t j = 0; j < y; ++j)
+                    for (size_t k = 0; k < x; ++k, ++data)
+                        ASSERT_EQ(*data, (i - 1) * 1000 + j * 10 + k);
+        };
+
+        Image img;
+        for (size_t i = 1; i <= n; ++i)
+        {
+            input.read(i, img);
+            checkImages(img, {i});
+        }
+
+        // Several images are decoded at the same time
+        input.read(1, n, img);
+        checkImages(img, {1, 2, 3});
+        input.read(std::vector<size_t>({3, 1, 3}), img);
+        checkImages(img, {3, 1, 3});
+        input.close();
+    }
+
+    // Thumbnails are skipped, so each image is read from its own directory
+    writeTiffStack(fn, x, y, n, COMPRESSION_LZW, 5, 0, true);
+    ImageFile input(fn, File::READ_ONLY);
+    ASSERT_EQ(input.getDim(), ArrayDim(x, y, 1, n));
+    Image img;
+    for (size_t i = n; i > 0; --i)
+    {
+        input.read(i, img);
+        auto data = static_cast<const uint16_t *>(img.getData());
+        ASSERT_EQ(data[0], (i - 1) * 1000);
+        ASSERT_EQ(data[x * y - 1], (i - 1) * 1000 + (y - 1) * 10 + x - 1);
+    }
+    std::vector<size_t> indexes = {2, 3, 1};
+    input.read(indexes, img);
+    auto data = static_cast<const uint16_t *>(img.getData());
+    for (size_t i = 0; i < indexes.size(); ++i)
+        ASSERT_EQ(data[i * x * y + 11], (indexes[i] - 1) * 1000 + 11);
+    input.close();
+
+    Thread::setDefaultThreads(threads);
+    remove(fn.c_str());
+} // TEST TiffImageFile.Read
+
+TEST(TiffImageFile, Write)
+{
+    // Sparse values, as in counting mode movies, in images big enough to
+    // be stored in several compressed strips
+    ArrayDim adim(1200, 1000, 1, 1);
+    size_t itemSize = adim.getItemSize(), n = 3;
+    Image img(adim, typeUInt16), stack;
+    std::string fn = "test_write.tif";
+    size_t uncompressedSize = 0;
+    auto threads = Thread::getDefaultThreads();
+    Thread::setDefaultThreads(4);
+
+    for (auto compression: {ImageFile::NO_COMPRESSION, ImageFile::LZW,
+                            ImageFile::DEFLATE, ImageFile::ZSTD})
+    {
+        ImageFile output(fn, File::TRUNCATE);
+        if (!output.supportsCompression(compression))
+            continue;
+
+        output.setCompression(compression);
+        output.createEmpty(ArrayDim(1200, 1000, 1, n), typeUInt16);
+        auto data = static_cast<uint16_t *>(img.getData());
+
+        for (size_t i = 1; i <= n; ++i)
+        {
+            for (size_t j = 0; j < itemSize; ++j)
+                data[j] = (j * i) % 13 == 0 ? i : 0;
+            output.write(i, img);
+        }
+        output.close();
+
+        auto size = Path::getFileSize(fn);
+        if (compression == ImageFile::NO_COMPRESSION)
+            uncompressedSize = size;
+        else
+            ASSERT_LT(size * 3, uncompressedSize);
+
+        ImageFile input(fn, File::READ_ONLY);
+        input.read(1, n, stack);
+        ASSERT_EQ(stack.getDim(), ArrayDim(1200, 1000, 1, n));
+        data = static_cast<uint16_t *>(stack.getData());
+        for (size_t i = 1; i <= n; ++i)
+            for (size_t j = 0; j < itemSize; ++j, ++data)
+                ASSERT_EQ(*data, (j * i) % 13 == 0 ? i : 0);
+        input.close();
+    }
+
+    // The default compression is only used by formats that support it
+    ImageFile::setDefaultCompression(ImageFile::LZW);
+    for (auto ext: {"tif", "mrc"})
+    {
+        ImageFile output(std::string("test_write.") + ext, File::TRUNCATE);
+        bool isTiff = std::string(ext) == "tif";
+        ASSERT_EQ(output.getCompression(),
+                  isTiff ? ImageFile::LZW : ImageFile::NO_COMPRESSION);
+        if (!isTiff)
+        {
+            ASSERT_THROW(output.setCompression(ImageFile::LZW), Error);
+        }
+    }
+    ImageFile::setDefaultCompression(ImageFile::NO_COMPRESSION);
+
+    Thread::setDefaultThreads(threads);
+    remove(fn.c_str());
+    remove("test_write.mrc");
+} // TEST TiffImageFile.Write
+
+TEST(TiffImageFile, Stream)
+{
+    ArrayDim adim(64, 48, 1, 1);
+    size_t itemSize = adim.getItemSize(), n = 100;
+    Image img(adim, typeFloat), stack;
+    auto data = static_cast<float *>(img.getData());
+    std::string fn = "test_stream.tif";
+
+    // No image data is written when creating the file
+    ImageFile output(fn, File::TRUNCATE);
+    output.createEmpty(ArrayDim(64, 48, 1, n), typeFloat);
+    ASSERT_LT(Path::getFileSize(fn), itemSize * sizeof(float));
+
+    // Images 1 and 2 are appended, 3 is added empty before 4 and then
+    // image 1 is written again
+    for (size_t i: {1, 2, 4, 1})
+    {
+        for (size_t j = 0; j < itemSize; ++j)
+            data[j] = i * 10 + j;
+        output.write(i, img);
+    }
+    ASSERT_THROW(output.read(5, img), Error);
+    output.close();
+
+    // Images that were not written are added empty when closing
+    ImageFile input(fn, File::READ_ONLY);
+    ASSERT_EQ(input.getDim(), ArrayDim(64, 48, 1, n));
+    input.read(1, 5, stack);
+    data = static_cast<float *>(stack.getData());
+    for (size_t i = 1; i <= 5; ++i)
+        for (size_t j = 0; j < itemSize; ++j, ++data)
+            ASSERT_FLOAT_EQ(*data, i == 3 || i == 5 ? 0 : i * 10 + j);
+    input.close();
+
+    remove(fn.c_str());
+} // TEST TiffImageFile.Stream
+
+TEST(TiffImageFile, SeparatePlanes)
+{
+    size_t x = 64, y = 32, samples = 3;
+    std::string fn = "test_planes.tif";
+    auto threads = Thread::getDefaultThreads();
+    Thread::setDefaultThreads(4);
+    auto value = [](size_t p, size_t j, size_t k)
+    {
+        return uint8_t(p * 50 + j * 3 + k);
+    };
+
+    // Only the first sample is read, from strips or tiles of each plane
+    for (uint32 tileSize: {0, 16})
+    {
+        TIFF * tif = TIFFOpen(fn.c_str(), "w");
+        ASSERT_NE(tif, nullptr);
+        TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, (uint32) x);
+        TIFFSetField(tif, TIFFTAG_IMAGELENGTH, (uint32) y);
+        TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+        TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, (uint16) samples);
+        TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_UINT);
+        TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
+        TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_SEPARATE);
+
+        size_t blockWidth = tileSize > 0 ? tileSize : x;
+        size_t blockLength = tileSize > 0 ? tileSize : 4;
+        std::vector<uint8_t> block(blockWidth * blockLength);
+
+        if (tileSize > 0)
+        {
+            TIFFSetField(tif, TIFFTAG_TILEWIDTH, tileSize);
+            TIFFSetField(tif, TIFFTAG_TILELENGTH, tileSize);
+        }
+        else
+            TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, (uint32) blockLength);
+
+        for (size_t p = 0; p < samples; ++p)
+            for (size_t y0 = 0; y0 < y; y0 += blockLength)
+                for (size_t x0 = 0; x0 < x; x0 += blockWidth)
+                {
+                    for (size_t j = 0; j < blockLength; ++j)
+                        for (size_t k = 0; k < blockWidth; ++k)
+                            block[j * blockWidth + k] =
+                                    value(p, y0 + j, x0 + k);
+                    if (tileSize > 0)
+                        TIFFWriteEncodedTile(tif, TIFFComputeTile(
+                                tif, x0, y0, 0, (uint16) p),
+                                block.data(), block.size());
+                    else
+                        TIFFWriteEncodedStrip(tif, TIFFComputeStrip(
+                                tif, y0, (uint16) p),
+                                block.data(), block.size());
+                }
+        TIFFWriteDirectory(tif);
+        TIFFClose(tif);
+
+        ImageFile input(fn, File::READ_ONLY);
+        ASSERT_EQ(input.getDim(), ArrayDim(x, y, 1, 1));
+        Image img;
+        input.read(1, img);
+        auto data = static_cast<const uint8_t *>(img.getData());
+        for (size_t j = 0; j < y; ++j)
+            for (size_t k = 0; k < x; ++k)
+                ASSERT_EQ(data[j * x + k], value(0, j, k));
+        input.close();
+    }
+
+    Thread::setDefaultThreads(threads);
+    remove(fn.c_str());
+} // TEST TiffImageFile.SeparatePlanes
+
+TEST(TiffImageFile, ScanThumbnails)
+{
+    std::string fn = "test_thumbs.tif";
+    TIFF * tif = TIFFOpen(fn.c_str(), "w");
+    ASSERT_NE(tif, nullptr);
+    std::vector<uint16_t> frame(16 * 8, 1);
+
+    // A thumbnail of another type before and after three frames
+    for (size_t i = 0; i < 5; ++i)
+    {
+        bool thumb = i == 0 || i == 4;
+        // Reduced resolution images have the bit 0 of the sub-file type
+        TIFFSetField(tif, TIFFTAG_SUBFILETYPE, (uint32) (thumb ? 1 : 0));
+        TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, (uint32) (thumb ? 4 : 16));
+        TIFFSetField(tif, TIFFTAG_IMAGELENGTH, (uint32) (thumb ? 4 : 8));
+        TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, thumb ? 8 : 16);
+        TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+        TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_UINT);
+        TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+        TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, (uint32) (thumb ? 4 : 8));
+        TIFFWriteEncodedStrip(tif, 0, frame.data(), thumb ? 16 : 16 * 8 * 2);
+        TIFFWriteDirectory(tif);
+    }
+    TIFFClose(tif);
+
+    ImageFile input(fn, File::READ_ONLY);
+    ASSERT_EQ(input.getDim(), ArrayDim(16, 8, 1, 3));
+    ASSERT_EQ(input.getType(), typeUInt16);
+    input.close();
+
+    // Scanning the header gives the same as opening the file
+    auto table = ImageFile::scanHeaders({fn});
+    auto &row = table[0];
+    ASSERT_EQ(ArrayDim(row["x"].get<size_t>(), row["y"].get<size_t>(),
+                       row["z"].get<size_t>(), row["n"].get<size_t>()),
+              ArrayDim(16, 8, 1, 3));
+    ASSERT_EQ(row["type"].toString(), typeUInt16.getName());
+
+    remove(fn.c_str());
+} // TEST TiffImageFile.ScanThumbnails
+
+/** Electron events of the synthetic EER frame f, as (position, sub-pixel)
+ * pairs of a 16x16 sensor. The last frame has a single electron after
+ * a run longer than the maximum of the 7-bit encoding. */
+static std::vector<std::pair<size_t, unsigned>> eerEvents(size_t f,
+                                                          size_t frames)
+{
+    std::vector<std::pair<size_t, unsigned>> events;
+    for (size_t p = 0; p < 256; ++p)
+        if (f + 1 == frames ? p == 250 : (p * (f + 3)) % 11 == 0)
+            events.push_back({p, unsigned(p + f) & 15});
+    return events;
+} // function eerEvents
+
+/** Write the events as an EER movie with the 7-bit run length encoding,
+ * given by the compression (65001) or by the tags of 65002. */
+static void writeEerMovie(const std::string &path, size_t frames,
+                          uint16 compression)
+{
+    TIFF * tif = TIFFOpen(path.c_str(), "w");
+    ASSERT_NE(tif, nullptr);
+
+    for (size_t f = 0; f < frames; ++f)
+    {
+        std::vector<uint8_t> bytes;
+        uint64_t bits = 0;
+        unsigned nbits = 0;
+        auto put = [&](uint64_t value, unsigned n)
+        {
+            bits |= value << nbits;
+            for (nbits += n; nbits >= 8; nbits -= 8, bits >>= 8)
+                bytes.push_back(uint8_t(bits));
+        };
+        auto putRun = [&](size_t run)
+        {
+            for (; run >= 127; run -= 127)
+                put(127, 7);
+            put(run, 7);
+        };
+
+        size_t pos = 0;
+        for (auto &event: eerEvents(f, frames))
+        {
+            putRun(event.first - pos);
+            put(event.second ^ 0x0A, 4);
+            pos = event.first + 1;
+        }
+        putRun(256 - pos);
+        put(0, 8);
+
+        TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, 16);
+        TIFFSetField(tif, TIFFTAG_IMAGELENGTH, 16);
+        TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 1);
+        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, 8);
+        TIFFSetField(tif, TIFFTAG_COMPRESSION, compression);
+        if (compression == 65002)
+        {
+            TIFFSetField(tif, 65007, 7);
+            TIFFSetField(tif, 65008, 2);
+            TIFFSetField(tif, 65009, 2);
+        }
+
+        // Events are split in two strips at any byte
+        size_t half = bytes.size() / 2;
+        TIFFWriteRawStrip(tif, 0, bytes.data(), half);
+        TIFFWriteRawStrip(tif, 1, bytes.data() + half, bytes.size() - half);
+        TIFFWriteDirectory(tif);
+    }
+    TIFFClose(tif);
+} // function writeEerMovie
+
+TEST(EerImageFile, Read)
+{
+    std::string fn = "test_read.eer";
+    size_t frames = 5;
+    auto threads = Thread::getDefaultThreads();
+    Thread::setDefaultThreads(4);
+
+    // The tags of 65002 can be written once an EER file has been opened
+    for (uint16 compression: {65001, 65002})
+    {
+        writeEerMovie(fn, frames, compression);
+
+        for (size_t upsampling: {1, 2, 4})
+            for (size_t grouping: {1, 2})
+            {
+                // The rendering is set by default or in the opened file
+                if (grouping == 1)
+                    ImageFile::setDefaultEerRendering(upsampling, grouping);
+                ImageFile input(fn, File::READ_ONLY);
+                if (grouping != 1)
+                    input.setEerRendering(upsampling, grouping);
+
+                size_t size = 16 * upsampling, n = frames / grouping;
+                ASSERT_EQ(input.getDim(), ArrayDim(size, size, 1, n));
+                ASSERT_EQ(input.getEerUpsampling(), upsampling);
+                ASSERT_EQ(input.getEerGrouping(), grouping);
+                ASSERT_EQ(input.getType(), typeUInt16);
+
+                // Expected counts of all the images
+                std::vector<uint16_t> counts(size * size * n, 0);
+                unsigned shift = upsampling == 4 ? 0 :
+                                 upsampling == 2 ? 1 : 2;
+                for (size_t f = 0; f < n * grouping; ++f)
+                    for (auto &event: eerEvents(f, frames))
+                    {
+                        size_t x = ((event.first % 16) << 2 |
+                                    (event.second & 3)) >> shift;
+                        size_t y = ((event.first / 16) << 2 |
+                                    event.second >> 2) >> shift;
+                        ++counts[((f / grouping) * size + y) * size + x];
+                    }
+
+                Image img;
+                size_t itemSize = size * size;
+                for (size_t i = 1; i <= n; ++i)
+                {
+                    input.read(i, img);
+                    auto data = static_cast<const uint16_t *>(img.getData());
+                    for (size_t j = 0; j < itemSize; ++j)
+                        ASSERT_EQ(data[j], counts[(i - 1) * itemSize + j]);
+                }
+
+                input.read(1, n, img);
+                auto data = static_cast<const uint16_t *>(img.getData());
+                for (size_t j = 0; j < counts.size(); ++j)
+                    ASSERT_EQ(data[j], counts[j]);
+                input.close();
+            }
+    }
+
+    ASSERT_THROW(ImageFile::setDefaultEerRendering(3, 1), Error);
+    ASSERT_THROW(ImageFile::setDefaultEerRendering(1, 0), Error);
+
+    // Cached files are opened again if the default rendering changes
+    ImageFileCache cache;
+    ImageFile::setDefaultEerRendering(1, 1);
+    auto file1 = cache.get(fn);
+    ASSERT_EQ(file1->getDim(), ArrayDim(16, 16, 1, frames));
+    ASSERT_EQ(file1.get(), cache.get(fn).get());
+    ImageFile::setDefaultEerRendering(2, 1);
+    auto file2 = cache.get(fn);
+    ASSERT_EQ(file2->getDim(), ArrayDim(32, 32, 1, frames));
+    ASSERT_EQ(cache.getSize(), 2);
+    ImageFile::setDefaultEerRendering(1, 1);
+    ASSERT_EQ(file1.get(), cache.get(fn).get());
+    cache.close(fn);
+    ASSERT_EQ(cache.getSize(), 0);
+
+    // Other formats can not set a rendering
+    Image img(ArrayDim(8, 8, 1, 1), typeFloat);
+    img.write("test_read_eer.mrc");
+    ImageFile other("test_read_eer.mrc", File::READ_ONLY);
+    ASSERT_EQ(other.getEerUpsampling(), 0);
+    ASSERT_THROW(other.setEerRendering(1, 1), Error);
+    other.close();
+    remove("test_read_eer.mrc");
+    Thread::setDefaultThreads(threads);
+    remove(fn.c_str());
+} // TEST EerImageFile.Read
+
 TEST(SpiderImageFile, Read)
 {
     ASSERT_TRUE(ImageFile::hasImpl("spider"));
@@ -403,8 +1627,49 @@ TEST(Image, Constructor)
     header["y"] = 20.5;
     header["filename"] = std::string("/path/to/image/");
     std::cout << img << std::endl;
+
+    // A moved-from image should be empty but still usable
+    Image moved(std::move(img));
+    ASSERT_EQ(moved.getDim(), ArrayDim(10, 10));
+    ASSERT_EQ(moved.getHeader()["x"].get<int>(), 10);
+    ASSERT_EQ(img.getDim(), ArrayDim());
+    img = moved;
+    ASSERT_EQ(img.getDim(), ArrayDim(10, 10));
+    Image moved2(std::move(img));
+    img.resize(ArrayDim(5, 5), typeFloat);
+    ASSERT_EQ(img.getDim(), ArrayDim(5, 5));
+    ASSERT_EQ(img.getType(), typeFloat);
 } // TEST(Image, Constructor)
 
+TEST(Image, ReallocateType)
+{
+    // Reallocate to the same number of bytes with another type, above
+    // (page aligned memory) and below the 1 MiB threshold. The memory
+    // should be reused and later released in the same way it was allocated.
+    std::vector<std::pair<ArrayDim, ArrayDim>> dims = {
+        {ArrayDim(512, 512), ArrayDim(1024, 1024)},
+        {ArrayDim(256, 256), ArrayDim(512, 512)}
+    };
+
+    for (auto &pair: dims)
+    {
+        Image img(pair.first, typeFloat);
+        void * data = img.getData();
+        img.resize(pair.second, typeUInt8);
+        ASSERT_EQ(img.getData(), data);
+        ASSERT_EQ(img.getType(), typeUInt8);
+        ASSERT_EQ(img.getDim(), pair.second);
+
+        Image img2(pair.second, typeUInt8);
+        data = img2.getData();
+        img2.resize(pair.first, typeFloat);
+        ASSERT_EQ(img2.getData(), data);
+        img2.resize(ArrayDim(pair.first.x / 2, pair.first.y), typeCFloat);
+        ASSERT_EQ(img2.getData(), data);
+        ASSERT_EQ(img2.getType(), typeCFloat);
+    }
+} // TEST(Image, ReallocateType)
+
 
 TEST(Image, Performance)
 {
@@ -6,11 +6,17 @@
 // Created by Jose Miguel de la Rosa Trevin on 2017-03-24.
 //
 
+#include <atomic>
 #include <iostream>
+#include <mutex>
+#include <set>
+#include <thread>
 #include "gtest/gtest.h"
 
+#include "emc/base/error.h"
 #include "emc/base/string.h"
 #include "emc/os/filesystem.h"
+#include "emc/os/thread.h"
 
 
 using namespace emcore;
@@ -91,4 +97,56 @@ TEST(Glob, Basic) {
         std::cout << "Glob test can not be run: EM_TEST_DATA not defined in "
                      "environment. " << std::endl;
     }
-}
\ No newline at end of file
+}
+
+TEST(Thread, ParallelFor)
+{
+    std::mutex mutex;
+    std::set<std::thread::id> ids;
+    std::vector<int> counts(1000);
+
+    // Workers are kept between calls, so no more threads than the
+    // requested ones run the chunks
+    for (size_t i = 0; i < 50; ++i)
+        Thread::parallelFor(counts.size(), [&](size_t start, size_t end,
+                                               size_t chunk)
+        {
+            ASSERT_LT(chunk, 4);
+            for (size_t j = start; j < end; ++j)
+                ++counts[j];
+            std::lock_guard<std::mutex> lock(mutex);
+            ids.insert(std::this_thread::get_id());
+        }, 4);
+
+    ASSERT_LE(ids.size(), 4);
+    for (auto c: counts)
+        ASSERT_EQ(c, 50);
+
+    // Nested calls from the chunks do not wait for busy workers
+    std::vector<size_t> sums(8, 0);
+    Thread::parallelFor(8, [&](size_t start, size_t end, size_t)
+    {
+        for (size_t i = start; i < end; ++i)
+            Thread::parallelFor(100, [&](size_t s, size_t e, size_t)
+            {
+                size_t sum = 0;
+                for (size_t j = s; j < e; ++j)
+                    sum += j;
+                std::lock_guard<std::mutex> lock(mutex);
+                sums[i] += sum;
+            }, 4);
+    }, 8);
+
+    for (auto sum: sums)
+        ASSERT_EQ(sum, 4950);
+
+    // Exceptions are re-thrown once all chunks are done
+    std::atomic<size_t> done(0);
+    ASSERT_THROW(Thread::parallelFor(4, [&](size_t start, size_t, size_t)
+    {
+        ++done;
+        if (start == 2)
+            THROW_ERROR("Error in chunk");
+    }, 4), Error);
+    ASSERT_EQ(done, 4);
+} // TEST Thread.ParallelFor
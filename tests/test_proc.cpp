@@ -3,12 +3,14 @@
 //
 
 #include <random>
+#include <algorithm>
 #include "gtest/gtest.h"
 
 #include "emc/proc/processor.h"
 #include "emc/proc/stats.h"
 #include "emc/math/functions.h"
 #include "emc/base/timer.h"
+#include "emc/os/thread.h"
 
 
 
@@ -134,6 +136,186 @@ ASSERT_FLOAT_EQ(s1.mean, 3);
 ASSERT_NEAR(s1.std, 1.4142, error);
 }
 
+TEST(Stats, Stable)
+{
+    // The first element is the maximum
+    float values[] = {9, 1, 2, 3, 4};
+    auto s = Stats::compute(typeFloat, values, 5);
+    ASSERT_FLOAT_EQ(s.min, 1);
+    ASSERT_FLOAT_EQ(s.max, 9);
+    s = Stats::compute(typeFloat, values, 5, Stats::MIN_MAX);
+    ASSERT_FLOAT_EQ(s.min, 1);
+    ASSERT_FLOAT_EQ(s.max, 9);
+
+    // Big offset with small variance, where E[x^2] - E[x]^2 fails,
+    // computed with several threads and an odd number of elements
+    size_t n = 3000001;
+    Array array(ArrayDim(n), typeDouble);
+    auto data = array.getView<double>().getData();
+    for (size_t i = 0; i < n; ++i)
+        data[i] = 1e9 + (i % 2 ? 1 : -1);
+    data[n - 1] = 1e9;
+
+    Thread::setDefaultThreads(4);
+    auto s4 = Stats::compute(array);
+    Thread::setDefaultThreads(1);
+    auto s1 = Stats::compute(array);
+    Thread::setDefaultThreads(0);
+
+    double expectedStd = sqrt((n - 1.0) / n);
+    ASSERT_DOUBLE_EQ(s4.mean, 1e9);
+    ASSERT_NEAR(s4.std, expectedStd, 1e-9);
+    ASSERT_NEAR(s1.std, expectedStd, 1e-9);
+    ASSERT_DOUBLE_EQ(s4.min, 1e9 - 1);
+    ASSERT_DOUBLE_EQ(s4.max, 1e9 + 1);
+
+    // Integer types
+    std::vector<int16_t> ints = {-3, 7, 2, 2, -1, 5, 0};
+    s = Stats::compute(typeInt16, ints.data(), ints.size());
+    ASSERT_FLOAT_EQ(s.min, -3);
+    ASSERT_FLOAT_EQ(s.max, 7);
+    ASSERT_NEAR(s.mean, 12 / 7.0, 1e-9);
+} // TEST Stats.Stable
+
+TEST(Stats, Masked)
+{
+    ArrayDim adim(32, 24, 1, 50);
+    Array stack(adim, typeFloat);
+    std::default_random_engine gen;
+    std::normal_distribution<float> dist(5.0, 2.0);
+    auto data = stack.getView<float>().getData();
+    for (size_t i = 0; i < adim.getSize(); ++i)
+        data[i] = dist(gen);
+
+    for (bool inside: {true, false})
+    {
+        auto maskPtr = StatsMask::circular(adim, 10, inside);
+        auto& mask = *maskPtr;
+        // Masks are only generated once
+        ASSERT_EQ(maskPtr.get(), StatsMask::circular(adim, 10, inside).get());
+
+        Thread::setDefaultThreads(4);
+        auto stats = Stats::computeMasked(stack, mask);
+        Thread::setDefaultThreads(0);
+        ASSERT_EQ(stats.size(), adim.n);
+
+        // Compare with the stats of the values selected pixel by pixel
+        size_t itemSize = adim.getItemSize();
+        for (size_t n = 0; n < adim.n; ++n)
+        {
+            Array values(ArrayDim(itemSize), typeFloat);
+            auto vData = values.getView<float>().getData();
+            size_t count = 0;
+            for (size_t y = 0; y < adim.y; ++y)
+                for (size_t x = 0; x < adim.x; ++x)
+                {
+                    double r2 = (x - 16.0) * (x - 16.0) + (y - 12.0) * (y - 12.0);
+                    if ((r2 <= 100) == inside)
+                        vData[count++] = data[n * itemSize + y * adim.x + x];
+                }
+            ASSERT_EQ(count, mask.getCount());
+            auto expected = Stats::compute(typeFloat, vData, count);
+            ASSERT_FLOAT_EQ(stats[n].min, expected.min);
+            ASSERT_FLOAT_EQ(stats[n].max, expected.max);
+            ASSERT_NEAR(stats[n].mean, expected.mean, 1e-9);
+            ASSERT_NEAR(stats[n].std, expected.std, 1e-9);
+        }
+    }
+
+    // Mask from an array, equivalent to the circular one
+    Array maskArray(ArrayDim(32, 24), typeFloat);
+    auto mData = maskArray.getView<float>().getData();
+    for (size_t y = 0; y < 24; ++y)
+        for (size_t x = 0; x < 32; ++x)
+            mData[y * 32 + x] = (x - 16.0) * (x - 16.0) + (y - 12.0) * (y - 12.0) <= 100 ? 0.5f : 0;
+    StatsMask mask(maskArray);
+    auto circularPtr = StatsMask::circular(adim, 10);
+    auto& circular = *circularPtr;
+    ASSERT_EQ(mask.getCount(), circular.getCount());
+    ASSERT_EQ(mask.getSpans().size(), circular.getSpans().size());
+    auto s1 = Stats::computeMasked(stack, mask);
+    auto s2 = Stats::computeMasked(stack, circular);
+    ASSERT_DOUBLE_EQ(s1[7].mean, s2[7].mean);
+
+    // Sweeping radii does not keep all the masks, but the ones still in
+    // use are valid
+    auto first = StatsMask::circular(adim, 0.5);
+    for (size_t r = 1; r <= 100; ++r)
+        StatsMask::circular(adim, r * 0.1);
+    ASSERT_NE(first.get(), StatsMask::circular(adim, 0.5).get());
+    ASSERT_EQ(first->getCount(), StatsMask::circular(adim, 0.5)->getCount());
+} // TEST Stats.Masked
+
+/** Quantile computed as numpy.quantile from sorted values */
+static double sortedQuantile(const std::vector<double> &sorted, double q)
+{
+    double pos = q * (sorted.size() - 1);
+    size_t rank = static_cast<size_t>(pos);
+    double v = sorted[rank];
+    if (pos > rank)
+        v += (pos - rank) * (sorted[rank + 1] - v);
+    return v;
+}
+
+TEST(Histogram, Basic)
+{
+    // Values 0..99 repeated
+    Array array(ArrayDim(1000), typeUInt8);
+    auto data = array.getView<uint8_t>().getData();
+    for (size_t i = 0; i < 1000; ++i)
+        data[i] = i % 100;
+
+    auto h = Histogram::compute(array, 10, 0, 100);
+    ASSERT_EQ(h.counts.size(), 10);
+    ASSERT_EQ(h.getTotal(), 1000);
+    for (auto c: h.counts)
+        ASSERT_EQ(c, 100);
+
+    // Values outside the range are not counted
+    h = Histogram::compute(array, 5, 10, 19);
+    ASSERT_EQ(h.getTotal(), 100);
+    // Auto range from min and max
+    h = Histogram::compute(array, 100);
+    ASSERT_DOUBLE_EQ(h.min, 0);
+    ASSERT_DOUBLE_EQ(h.max, 99);
+    ASSERT_EQ(h.counts.front(), 10);
+    ASSERT_EQ(h.counts.back(), 10);
+    ASSERT_NEAR(h.getQuantile(0.5), 49.5, 1);
+
+    // Exact quantiles for 16 bits integers
+    std::default_random_engine gen;
+    std::normal_distribution<float> dist(1000, 300);
+    size_t n = 1000001;
+    Array ints(ArrayDim(n), typeInt16);
+    auto iData = ints.getView<int16_t>().getData();
+    std::vector<double> sorted(n);
+    for (size_t i = 0; i < n; ++i)
+        sorted[i] = iData[i] = int16_t(dist(gen));
+    std::sort(sorted.begin(), sorted.end());
+
+    std::vector<double> qs = {0, 0.001, 0.25, 0.5, 0.999, 1};
+    Thread::setDefaultThreads(3);
+    auto values = Histogram::quantiles(ints, qs);
+    for (size_t i = 0; i < qs.size(); ++i)
+        ASSERT_DOUBLE_EQ(values[i], sortedQuantile(sorted, qs[i]));
+
+    // Approximate quantiles of floats, with some hot pixels
+    Array floats(ArrayDim(n), typeFloat);
+    auto fData = floats.getView<float>().getData();
+    for (size_t i = 0; i < n; ++i)
+        sorted[i] = fData[i] = (i % 10000 == 0) ? 1e6f : dist(gen);
+    std::sort(sorted.begin(), sorted.end());
+
+    values = Histogram::quantiles(floats, {0.001, 0.5, 0.999});
+    Thread::setDefaultThreads(0);
+    size_t i = 0;
+    for (auto q: {0.001, 0.5, 0.999})
+    {
+        auto expected = sortedQuantile(sorted, q);
+        ASSERT_NEAR(values[i++], expected, std::abs(expected) / 128);
+    }
+} // TEST Histogram.Basic
+
 TEST(ImageScaleProc, Basic)
 {
     ImageMathProc imgOp;
@@ -174,4 +356,128 @@ TEST(ImageScaleProc, Basic)
         std::cout << "Skipping image processing tests, EM_TEST_DATA not "
         "defined in environment. " << std::endl;
     }
-} // TEST ImageOperator.Basic
\ No newline at end of file
+} // TEST ImageOperator.Basic
+
+TEST(ImageFourierFilterProc, Basic)
+{
+    // Constant image plus a checkerboard (the highest frequency)
+    ArrayDim adim(16, 16);
+    Image img(adim, typeFloat), out;
+    auto data = img.getView<float>();
+    for (size_t y = 0; y < adim.y; ++y)
+        for (size_t x = 0; x < adim.x; ++x)
+            data(x, y) = 5 + ((x + y) % 2 ? -1 : 1);
+
+    ImageFourierFilterProc lowpass({
+        {ImageProcessor::OPERATION, ImageFourierFilterProc::FILTER_LOWPASS},
+        {"freq_high", 0.25f}});
+    lowpass.process(img, out);
+    ASSERT_EQ(out.getDim(), adim);
+
+    // The weights should be computed only once for the same dimensions
+    auto& w1 = lowpass.getWeights(adim);
+    auto& w2 = lowpass.getWeights(adim);
+    ASSERT_EQ(w1.getData(), w2.getData());
+    ASSERT_EQ(w1.getDim(), FourierTransformer::getDimFT(adim));
+    auto wData = static_cast<const float *>(w1.getData());
+    ASSERT_FLOAT_EQ(wData[0], 1);
+    ASSERT_FLOAT_EQ(wData[8 * 9 + 8], 0);  // (8, 8)
+
+    auto outData = out.getView<float>();
+    for (size_t y = 0; y < adim.y; ++y)
+        for (size_t x = 0; x < adim.x; ++x)
+            ASSERT_NEAR(outData(x, y), 5, 1e-4);
+
+    // The high-pass should remove the constant value, and it should
+    // also work with non-float images (the output will be float)
+    Image imgInt;
+    imgInt.copy(img, typeInt16);
+    ImageFourierFilterProc highpass({
+        {ImageProcessor::OPERATION, ImageFourierFilterProc::FILTER_HIGHPASS},
+        {"highpass_res", 10.0f}, {"angpix", 1.0f}});
+    highpass.process(imgInt);
+    ASSERT_EQ(imgInt.getType(), typeFloat);
+    auto intData = imgInt.getView<float>();
+    for (size_t y = 0; y < adim.y; ++y)
+        for (size_t x = 0; x < adim.x; ++x)
+            ASSERT_NEAR(intData(x, y), (x + y) % 2 ? -1 : 1, 1e-4);
+
+    // Band-pass and Gaussian filters in a volume of doubles
+    Image vol(ArrayDim(8, 8, 8), typeDouble);
+    vol.set(3);
+    ImageFourierFilterProc bandpass({
+        {ImageProcessor::OPERATION, ImageFourierFilterProc::FILTER_BANDPASS},
+        {"freq_low", 0.1f}, {"freq_high", 0.3f}});
+    bandpass.process(vol);
+    ASSERT_NEAR(vol.getView<double>()(1, 2, 3), 0, 1e-6);
+
+    ImageFourierFilterProc gaussian({
+        {ImageProcessor::OPERATION, ImageFourierFilterProc::FILTER_GAUSSIAN},
+        {"freq_high", 0.1f}});
+    auto& gw = gaussian.getWeights(vol.getDim());
+    auto gwData = static_cast<const float *>(gw.getData());
+    ASSERT_FLOAT_EQ(gwData[0], 1);
+    ASSERT_NEAR(gwData[1], exp(-1 / 64.0 / 0.02), 1e-5);
+
+    // Every item of a stack should be filtered as if it was alone
+    size_t n = 3, itemSize = adim.getSize();
+    Image stack(ArrayDim(adim.x, adim.y, 1, n), typeFloat), item;
+    auto stackData = static_cast<float *>(stack.getData());
+    for (size_t i = 0; i < n * itemSize; ++i)
+        stackData[i] = (i * 7919 % 101) / 10.0f;
+    Image input;
+    input.copy(stack);
+    lowpass.process(stack);
+    ASSERT_EQ(stack.getDim(), ArrayDim(adim.x, adim.y, 1, n));
+    ASSERT_EQ(lowpass.getWeights(stack.getDim()).getData(), w1.getData());
+
+    auto inputData = static_cast<float *>(input.getData());
+    for (size_t i = 0; i < n; ++i)
+    {
+        Image single(adim, typeFloat, inputData + i * itemSize);
+        lowpass.process(single, item);
+        auto itemData = static_cast<const float *>(item.getData());
+        for (size_t j = 0; j < itemSize; ++j)
+            ASSERT_NEAR(stackData[i * itemSize + j], itemData[j], 1e-4);
+    }
+} // TEST ImageFourierFilterProc.Basic
+
+TEST(ImagePowerSpectrumProc, Basic)
+{
+    // Cosine along x with a period of 4 pixels and along y of 8 pixels
+    ArrayDim adim(256, 200);
+    Image img(adim, typeFloat), spectrum;
+    auto data = img.getView<float>();
+    for (size_t y = 0; y < adim.y; ++y)
+        for (size_t x = 0; x < adim.x; ++x)
+            data(x, y) = 3 + cos(2 * M_PI * x / 4) + 0.5 * cos(2 * M_PI * y / 8);
+
+    ImagePowerSpectrumProc psdProc({{"tile_size", 64}, {"tile_overlap", 0.5f}});
+    Thread::setDefaultThreads(4);
+    psdProc.process(img, spectrum);
+    ASSERT_EQ(spectrum.getDim(), ArrayDim(64, 64));
+    ASSERT_EQ(psdProc.getTilesCount(), 7 * 5);
+
+    auto psd = spectrum.getView<float>();
+    // Peaks should be symmetric and the mean should be removed
+    ASSERT_FLOAT_EQ(psd(32 + 16, 32), psd(32 - 16, 32));
+    ASSERT_FLOAT_EQ(psd(32, 32 + 8), psd(32, 32 - 8));
+    ASSERT_GT(psd(32 + 16, 32), psd(32, 32 + 8));
+    ASSERT_LT(psd(32, 32), 1e-3 * psd(32 + 16, 32));
+
+    auto& profile = psdProc.getRadialProfile();
+    ASSERT_EQ(profile.size(), 33);
+    auto maxIt = std::max_element(profile.begin() + 1, profile.end());
+    ASSERT_EQ(maxIt - profile.begin(), 16);
+    ASSERT_GT(profile[8], profile[12]);
+
+    // The result should not depend on the number of threads
+    Image spectrum1;
+    Thread::setDefaultThreads(1);
+    psdProc.process(img, spectrum1);
+    Thread::setDefaultThreads(0);  // Restore the default
+    auto psd1 = spectrum1.getView<float>();
+    for (size_t y = 0; y < 64; ++y)
+        for (size_t x = 0; x < 64; ++x)
+            ASSERT_NEAR(psd1(x, y), psd(x, y), 1e-3 * psd(32 + 16, 32));
+} // TEST ImagePowerSpectrumProc.Basic